@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Asynchronous acknowledgement of conditions at the device.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include <process.h>
+#include <algorithm>
+#include "IClassicBaseNodeManager.h"
+#include "AckPipeline.h"
+
+using namespace IClassicBaseNodeManager;
+
+//-----------------------------------------------------------------------------
+// CLASS AckPipeline
+//-----------------------------------------------------------------------------
+
+AckPipeline::AckPipeline( AckTarget* target, DWORD dwMaxBatch, DWORD dwMaxAttempts, DWORD dwRetryDelay )
+{
+	m_target             = target;
+	m_dwMaxBatch         = (dwMaxBatch > 0) ? dwMaxBatch : 1;
+	m_dwMaxAttempts      = (dwMaxAttempts > 0) ? dwMaxAttempts : 1;
+	m_dwRetryDelay       = dwRetryDelay;
+	m_lPending           = 0;
+	m_hThread            = NULL;
+	m_hWakeEvent         = NULL;
+	m_hStopEvent         = NULL;
+	m_dwConfirmingThread = 0;
+	InitializeSRWLock( &m_lock );
+}
+
+AckPipeline::~AckPipeline()
+{
+	Stop();
+}
+
+HRESULT AckPipeline::Start()
+{
+	if (m_hThread != NULL) {
+		return S_FALSE;
+	}
+
+	m_hWakeEvent = CreateEvent( NULL, FALSE, FALSE, NULL );
+	m_hStopEvent = CreateEvent( NULL, TRUE, FALSE, NULL );
+	if (m_hWakeEvent != NULL && m_hStopEvent != NULL) {
+		unsigned uThreadID;
+		m_hThread = (HANDLE)_beginthreadex( NULL, 0, ThreadProc, this, 0, &uThreadID );
+	}
+	if (m_hThread == NULL) {
+		HRESULT hr = HRESULT_FROM_WIN32( GetLastError() );
+		Stop();
+		return hr;
+	}
+	SetEvent( m_hWakeEvent );                    // acknowledgements queued before the start
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Stop
+// ----
+//    Stops the thread. Acknowledgements which are not written yet are
+//    discarded.
+//-----------------------------------------------------------------------------
+void AckPipeline::Stop()
+{
+	if (m_hThread != NULL) {
+		SetEvent( m_hStopEvent );
+		// Wait max 10 secs until the thread has terminated.
+		if (WaitForSingleObject( m_hThread, 10000 ) == WAIT_TIMEOUT) {
+			TerminateThread( m_hThread, 1 );
+		}
+		CloseHandle( m_hThread );
+		m_hThread = NULL;
+	}
+	if (m_hWakeEvent != NULL) {
+		CloseHandle( m_hWakeEvent );
+		m_hWakeEvent = NULL;
+	}
+	if (m_hStopEvent != NULL) {
+		CloseHandle( m_hStopEvent );
+		m_hStopEvent = NULL;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Enqueue / Confirm
+// -----------------
+//    Enqueue queues the acknowledgement of a client to be written to the
+//    device. Confirm queues an acknowledgement made at the device to be
+//    confirmed with AckCondition. Both return without waiting.
+//-----------------------------------------------------------------------------
+HRESULT AckPipeline::Enqueue( DWORD dwConditionId, DWORD dwSubConditionId )
+{
+	return Queue( m_queuedWrites, dwConditionId, dwSubConditionId, NULL );
+}
+
+HRESULT AckPipeline::Confirm( DWORD dwConditionId, LPCWSTR comment )
+{
+	return Queue( m_queuedConfirmations, dwConditionId, 0, comment );
+}
+
+HRESULT AckPipeline::Queue( std::vector<AckRequest>& queue, DWORD dwConditionId, DWORD dwSubConditionId, LPCWSTR comment )
+{
+	HRESULT hr = S_OK;
+
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		AckRequest ack;
+		ack.dwConditionId    = dwConditionId;
+		ack.dwSubConditionId = dwSubConditionId;
+		ack.dwAttempts       = 0;
+		ack.due              = 0;
+		if (comment != NULL) {
+			ack.comment = comment;
+		}
+		queue.push_back( ack );
+		InterlockedIncrement( &m_lPending );
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+
+	if (SUCCEEDED( hr ) && m_hWakeEvent != NULL) {
+		SetEvent( m_hWakeEvent );
+	}
+	return hr;
+}
+
+bool AckPipeline::IsConfirming() const
+{
+	return m_dwConfirmingThread != 0 && m_dwConfirmingThread == GetCurrentThreadId();
+}
+
+DWORD AckPipeline::PendingCount() const
+{
+	return (DWORD)m_lPending;
+}
+
+unsigned __stdcall AckPipeline::ThreadProc( LPVOID pAttr )
+{
+	((AckPipeline*)pAttr)->Run();
+	_endthreadex( 0 );
+	return 0;
+}
+
+void AckPipeline::Run()
+{
+	HANDLE events[2] = { m_hStopEvent, m_hWakeEvent };
+
+	for (;;) {
+		if (WaitForMultipleObjects( 2, events, FALSE, NextTimeout( GetTickCount64() ) ) == WAIT_OBJECT_0) {
+			break;                               // stop requested
+		}
+
+		try {
+			TakeQueued();
+			ULONGLONG now = GetTickCount64();
+			WriteDue( now );
+			ConfirmDue( now );
+		}
+		catch (...) {
+			// not enough memory, the remaining acknowledgements are handled next time
+		}
+	}
+}
+
+// Moves the queued acknowledgements to the thread, a condition already
+// waiting to be written is not added again.
+void AckPipeline::TakeQueued()
+{
+	std::vector<AckRequest> writes;
+	std::vector<AckRequest> confirmations;
+
+	AcquireSRWLockExclusive( &m_lock );
+	writes.swap( m_queuedWrites );
+	confirmations.swap( m_queuedConfirmations );
+	ReleaseSRWLockExclusive( &m_lock );
+
+	m_writes.reserve( m_writes.size() + writes.size() );
+	for (size_t i = 0; i < writes.size(); ++i) {
+		ULONGLONG key = ((ULONGLONG)writes[i].dwConditionId << 32) | writes[i].dwSubConditionId;
+		if (m_pendingKeys.insert( key ).second) {
+			m_writes.push_back( writes[i] );
+		}
+		else {
+			InterlockedDecrement( &m_lPending );
+		}
+	}
+	m_confirmations.insert( m_confirmations.end(), confirmations.begin(), confirmations.end() );
+}
+
+//-----------------------------------------------------------------------------
+// Retry
+// -----
+//    Counts the failed attempt and schedules the next one. Returns false
+//    and reports the failure if it was the last attempt.
+//-----------------------------------------------------------------------------
+bool AckPipeline::Retry( AckRequest& ack, HRESULT hrError, ULONGLONG now )
+{
+	if (++ack.dwAttempts >= m_dwMaxAttempts) {
+		m_target->OnAckFailed( ack, hrError );
+		return false;
+	}
+	ack.due = now + ((ULONGLONG)m_dwRetryDelay << std::min<DWORD>( ack.dwAttempts - 1, 16 ));
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// WriteDue
+// --------
+//    Writes the due acknowledgements grouped by device, up to m_dwMaxBatch
+//    with one request.
+//-----------------------------------------------------------------------------
+void AckPipeline::WriteDue( ULONGLONG now )
+{
+	std::vector<std::pair<DWORD, size_t>> due;  // device and index in m_writes
+	for (size_t i = 0; i < m_writes.size(); ++i) {
+		if (m_writes[i].due <= now) {
+			due.push_back( std::make_pair( m_target->GetDevice( m_writes[i].dwConditionId ), i ) );
+		}
+	}
+	if (due.empty()) {
+		return;
+	}
+	std::sort( due.begin(), due.end() );
+
+	std::vector<AckRequest> batch;
+	std::vector<HRESULT>    results;
+	std::vector<bool>       done( m_writes.size(), false );
+
+	for (size_t first = 0; first < due.size(); ) {
+		DWORD  dwDevice = due[first].first;
+		size_t last     = first;
+		while (last < due.size() && last - first < m_dwMaxBatch && due[last].first == dwDevice) {
+			batch.push_back( m_writes[due[last++].second] );
+		}
+
+		results.assign( batch.size(), E_FAIL );
+		HRESULT hr = m_target->WriteAcks( dwDevice, (DWORD)batch.size(), &batch[0], &results[0] );
+
+		for (size_t k = first; k < last; ++k) {
+			HRESULT hrAck = FAILED( hr ) ? hr : results[k - first];
+			if (SUCCEEDED( hrAck ) || !Retry( m_writes[due[k].second], hrAck, now )) {
+				done[due[k].second] = true;
+			}
+		}
+		batch.clear();
+		first = last;
+	}
+
+	// Remove the written and the finally failed acknowledgements
+	size_t count = 0;
+	for (size_t i = 0; i < m_writes.size(); ++i) {
+		if (done[i]) {
+			m_pendingKeys.erase( ((ULONGLONG)m_writes[i].dwConditionId << 32) | m_writes[i].dwSubConditionId );
+			InterlockedDecrement( &m_lPending );
+		}
+		else {
+			if (count != i) {
+				m_writes[count] = m_writes[i];
+			}
+			count++;
+		}
+	}
+	m_writes.resize( count );
+}
+
+//-----------------------------------------------------------------------------
+// ConfirmDue
+// ----------
+//    Confirms the due acknowledgements made at the device with
+//    AckCondition. The OnAckNotification called by the generic server
+//    during AckCondition sees IsConfirming() == true.
+//-----------------------------------------------------------------------------
+void AckPipeline::ConfirmDue( ULONGLONG now )
+{
+	for (size_t i = 0; i < m_confirmations.size(); ) {
+		AckRequest& ack = m_confirmations[i];
+		if (ack.due > now) {
+			++i;
+			continue;
+		}
+
+		m_dwConfirmingThread = GetCurrentThreadId();
+		HRESULT hr = AckCondition( (int)ack.dwConditionId, ack.comment.empty() ? NULL : &ack.comment[0] );
+		m_dwConfirmingThread = 0;
+
+		if (SUCCEEDED( hr ) || !Retry( ack, hr, now )) {
+			m_confirmations[i] = m_confirmations.back();
+			m_confirmations.pop_back();
+			InterlockedDecrement( &m_lPending );
+		}
+		else {
+			++i;
+		}
+	}
+}
+
+// Time in milliseconds until the next retry is due.
+DWORD AckPipeline::NextTimeout( ULONGLONG now ) const
+{
+	ULONGLONG next = MAXULONGLONG;
+	for (size_t i = 0; i < m_writes.size(); ++i) {
+		next = std::min<ULONGLONG>( next, m_writes[i].due );
+	}
+	for (size_t i = 0; i < m_confirmations.size(); ++i) {
+		next = std::min<ULONGLONG>( next, m_confirmations[i].due );
+	}
+
+	if (next == MAXULONGLONG) {
+		return INFINITE;
+	}
+	return (next <= now) ? 0 : (DWORD)std::min<ULONGLONG>( next - now, INFINITE - 1 );
+}
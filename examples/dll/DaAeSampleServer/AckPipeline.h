@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Asynchronous acknowledgement of conditions at the device.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(ACKPIPELINE_H)
+#define ACKPIPELINE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <set>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// STRUCT AckRequest
+//-----------------------------------------------------------------------------
+struct AckRequest
+{
+	DWORD        dwConditionId;
+	DWORD        dwSubConditionId;
+	DWORD        dwAttempts;                     // failed attempts so far
+	ULONGLONG    due;                            // time of the next attempt
+	std::wstring comment;                        // confirmations only
+};
+
+//-----------------------------------------------------------------------------
+// CLASS AckTarget
+// ---------------
+//    Device the acknowledgements are written to. GetDevice returns the
+//    device a condition belongs to; the acknowledgements of one device are
+//    written with a single WriteAcks call which returns a result per
+//    acknowledgement. OnAckFailed is called if an acknowledgement could
+//    not be written to the device or confirmed to the generic server after
+//    the last attempt. The methods are called on the thread of the
+//    AckPipeline and may block.
+//-----------------------------------------------------------------------------
+class AckTarget
+{
+public:
+	virtual ~AckTarget() {}
+
+	virtual DWORD   GetDevice( DWORD dwConditionId ) = 0;
+	virtual HRESULT WriteAcks( DWORD dwDevice, DWORD dwCount, const AckRequest* acks, HRESULT* results ) = 0;
+	virtual void    OnAckFailed( const AckRequest& ack, HRESULT hrError ) = 0;
+};
+
+//-----------------------------------------------------------------------------
+// CLASS AckPipeline
+// -----------------
+//    Writes the acknowledgements of the clients to the device on a thread
+//    of its own, so OnAckNotification only queues them and returns. The
+//    queued acknowledgements are grouped by device and written in batches
+//    of up to dwMaxBatch. Failed writes are retried with a delay doubled
+//    on each attempt, starting with dwRetryDelay milliseconds, up to
+//    dwMaxAttempts attempts. A condition queued again before it was
+//    written is written once.
+//
+//    Acknowledgements made at the device are confirmed to the generic
+//    server with AckCondition on the same thread. The generic server calls
+//    OnAckNotification from AckCondition; IsConfirming returns true during
+//    that call so the acknowledgement is not written back to the device.
+//-----------------------------------------------------------------------------
+class AckPipeline
+{
+public:
+	AckPipeline( AckTarget* target, DWORD dwMaxBatch, DWORD dwMaxAttempts, DWORD dwRetryDelay );
+	~AckPipeline();
+
+	// Operations
+	HRESULT Start();
+	void    Stop();
+	HRESULT Enqueue( DWORD dwConditionId, DWORD dwSubConditionId );
+	HRESULT Confirm( DWORD dwConditionId, LPCWSTR comment );
+
+	// Attributes
+	bool    IsConfirming() const;
+	DWORD   PendingCount() const;
+
+	// Implementation
+protected:
+	static unsigned __stdcall ThreadProc( LPVOID pAttr );
+	void    Run();
+	HRESULT Queue( std::vector<AckRequest>& queue, DWORD dwConditionId, DWORD dwSubConditionId, LPCWSTR comment );
+	void    TakeQueued();
+	void    WriteDue( ULONGLONG now );
+	void    ConfirmDue( ULONGLONG now );
+	bool    Retry( AckRequest& ack, HRESULT hrError, ULONGLONG now );
+	DWORD   NextTimeout( ULONGLONG now ) const;
+
+	AckTarget*              m_target;
+	DWORD                   m_dwMaxBatch;
+	DWORD                   m_dwMaxAttempts;
+	DWORD                   m_dwRetryDelay;
+
+	// Queued by OnAckNotification and Confirm, protected by m_lock
+	std::vector<AckRequest> m_queuedWrites;
+	std::vector<AckRequest> m_queuedConfirmations;
+	mutable SRWLOCK         m_lock;
+
+	// Owned by the thread
+	std::vector<AckRequest> m_writes;
+	std::vector<AckRequest> m_confirmations;
+	std::set<ULONGLONG>     m_pendingKeys;       // conditions in m_writes
+	volatile LONG           m_lPending;
+
+	HANDLE                  m_hThread;
+	HANDLE                  m_hWakeEvent;
+	HANDLE                  m_hStopEvent;
+	volatile DWORD          m_dwConfirmingThread;
+
+private:
+	AckPipeline( const AckPipeline& );
+	AckPipeline& operator=( const AckPipeline& );
+};
+
+#endif // !defined(ACKPIPELINE_H)
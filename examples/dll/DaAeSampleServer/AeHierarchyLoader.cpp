@@ -0,0 +1,375 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Loads the area, source and condition hierarchy of the AE server from a file.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include <unordered_map>
+#include "IClassicBaseNodeManager.h"
+#include "AeHierarchyLoader.h"
+
+using namespace IClassicBaseNodeManager;
+
+//-----------------------------------------------------------------------------
+// CLASS AeHierarchyLoader
+//-----------------------------------------------------------------------------
+
+AeHierarchyLoader::AeHierarchyLoader( DWORD rootAreaId )
+{
+	m_rootAreaId  = rootAreaId;
+	m_dwErrorLine = 0;
+}
+
+//-----------------------------------------------------------------------------
+// LoadFile / LoadText
+// -------------------
+//    Parse and validate the hierarchy. Returns E_INVALIDARG if the content
+//    is not valid; ErrorLine returns the line with the first error then.
+//    LoadFile returns the error of the file system if the file cannot be
+//    read, e.g. HRESULT_FROM_WIN32( ERROR_FILE_NOT_FOUND ).
+//-----------------------------------------------------------------------------
+HRESULT AeHierarchyLoader::LoadFile( LPCWSTR fileName )
+{
+	HANDLE hFile = CreateFile( fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if (hFile == INVALID_HANDLE_VALUE) {
+		return HRESULT_FROM_WIN32( GetLastError() );
+	}
+
+	HRESULT       hr = S_OK;
+	LARGE_INTEGER size;
+	try {
+		if (!GetFileSizeEx( hFile, &size )) {
+			throw HRESULT_FROM_WIN32( GetLastError() );
+		}
+		if (size.QuadPart > 0x7FFFFFFF) {
+			throw E_OUTOFMEMORY;
+		}
+
+		std::vector<char> content( (size_t)size.QuadPart + 2, 0 );
+		DWORD dwRead = 0;
+		if (size.QuadPart > 0 && !ReadFile( hFile, &content[0], (DWORD)size.QuadPart, &dwRead, NULL )) {
+			throw HRESULT_FROM_WIN32( GetLastError() );
+		}
+
+		if (dwRead >= 2 && (BYTE)content[0] == 0xFF && (BYTE)content[1] == 0xFE) {
+			m_text.assign( (LPCWSTR)&content[2], (dwRead - 2) / sizeof (WCHAR) );
+		}
+		else {
+			int offset = (dwRead >= 3 && (BYTE)content[0] == 0xEF && (BYTE)content[1] == 0xBB && (BYTE)content[2] == 0xBF) ? 3 : 0;
+			int length = 0;
+			if ((int)dwRead > offset) {
+				length = MultiByteToWideChar( CP_UTF8, MB_ERR_INVALID_CHARS, &content[offset], (int)dwRead - offset, NULL, 0 );
+				if (length == 0) {
+					throw HRESULT_FROM_WIN32( GetLastError() );
+				}
+			}
+			m_text.assign( length, L'\0' );
+			if (length > 0) {
+				MultiByteToWideChar( CP_UTF8, 0, &content[offset], (int)dwRead - offset, &m_text[0], length );
+			}
+		}
+		hr = Parse();
+	}
+	catch (HRESULT hresEx) {
+		hr = hresEx;
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+	CloseHandle( hFile );
+	return hr;
+}
+
+HRESULT AeHierarchyLoader::LoadText( LPCWSTR text )
+{
+	if (text == NULL) {
+		return E_INVALIDARG;
+	}
+	try {
+		m_text = text;
+	}
+	catch (...) {
+		return E_OUTOFMEMORY;
+	}
+	return Parse();
+}
+
+HRESULT AeHierarchyLoader::Fail( DWORD dwLine )
+{
+	m_dwErrorLine = dwLine;
+	return E_INVALIDARG;
+}
+
+HRESULT AeHierarchyLoader::Parse()
+{
+	m_areas.clear();
+	m_sources.clear();
+	m_existingSources.clear();
+	m_conditions.clear();
+	m_dwErrorLine = 0;
+
+	HRESULT hr    = S_OK;
+	DWORD   dwLine = 0;
+	LPWSTR  line  = m_text.empty() ? NULL : &m_text[0];
+
+	while (line != NULL && SUCCEEDED( hr )) {
+		LPWSTR end = wcspbrk( line, L"\r\n" );
+		if (end != NULL) {
+			bool fCrLf = (end[0] == L'\r' && end[1] == L'\n');
+			*end = L'\0';
+			end += fCrLf ? 2 : 1;
+		}
+		hr = ParseLine( line, ++dwLine );
+		line = end;
+	}
+	if (SUCCEEDED( hr )) {
+		hr = Validate();
+	}
+	return hr;
+}
+
+// Returns the next field of the line and terminates it.
+LPWSTR AeHierarchyLoader::NextField( LPWSTR& text )
+{
+	while (*text == L' ' || *text == L'\t') {
+		text++;
+	}
+	LPWSTR field = text;
+	while (*text != L'\0' && *text != L' ' && *text != L'\t') {
+		text++;
+	}
+	if (*text != L'\0') {
+		*text++ = L'\0';
+	}
+	return field;
+}
+
+bool AeHierarchyLoader::ParseId( LPWSTR& text, bool fArea, DWORD* id ) const
+{
+	LPWSTR field = NextField( text );
+	if (fArea && wcscmp( field, L"ROOT" ) == 0) {
+		*id = m_rootAreaId;
+		return true;
+	}
+	if (*field < L'0' || *field > L'9') {
+		return false;
+	}
+
+	WCHAR*        end;
+	unsigned long value = wcstoul( field, &end, 0 );
+	*id = (DWORD)value;
+	return *end == L'\0';
+}
+
+HRESULT AeHierarchyLoader::ParseLine( LPWSTR line, DWORD dwLine )
+{
+	LPWSTR keyword = NextField( line );
+	if (*keyword == L'\0' || *keyword == L';') {
+		return S_OK;
+	}
+
+	Element element;
+	element.dwValue      = 0;
+	element.name         = 0;
+	element.fMultiSource = false;
+	element.dwLine       = dwLine;
+
+	try {
+		if (wcscmp( keyword, L"AREA" ) == 0 || wcscmp( keyword, L"SOURCE" ) == 0 ||
+			wcscmp( keyword, L"MULTISOURCE" ) == 0) {
+			bool fArea = (keyword[0] == L'A');
+			if (!ParseId( line, fArea, &element.dwId ) || !ParseId( line, true, &element.dwParentId )) {
+				return Fail( dwLine );
+			}
+			while (*line == L' ' || *line == L'\t') {
+				line++;
+			}
+			if (*line == L'\0') {
+				return Fail( dwLine );           // the name is required
+			}
+			LPWSTR end = line + wcslen( line );
+			while (end[-1] == L' ' || end[-1] == L'\t') {
+				*--end = L'\0';
+			}
+			element.name         = line - &m_text[0];
+			element.fMultiSource = (keyword[0] == L'M');
+			(fArea ? m_areas : m_sources).push_back( element );
+		}
+		else if (wcscmp( keyword, L"ADDSOURCE" ) == 0) {
+			if (!ParseId( line, false, &element.dwId ) || !ParseId( line, true, &element.dwParentId ) ||
+				*NextField( line ) != L'\0') {
+				return Fail( dwLine );
+			}
+			m_existingSources.push_back( element );
+		}
+		else if (wcscmp( keyword, L"CONDITION" ) == 0) {
+			if (!ParseId( line, false, &element.dwId ) || !ParseId( line, false, &element.dwParentId ) ||
+				!ParseId( line, false, &element.dwValue ) || *NextField( line ) != L'\0') {
+				return Fail( dwLine );
+			}
+			m_conditions.push_back( element );
+		}
+		else {
+			return Fail( dwLine );
+		}
+	}
+	catch (...) {
+		return E_OUTOFMEMORY;
+	}
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Validate
+// --------
+//    Checks that the IDs are unique and all references are defined, and
+//    orders the areas so every parent area is added before its sub areas.
+//-----------------------------------------------------------------------------
+HRESULT AeHierarchyLoader::Validate()
+{
+	try {
+		std::unordered_map<DWORD, size_t> areas( m_areas.size() * 2 );
+		for (size_t i = 0; i < m_areas.size(); ++i) {
+			if (m_areas[i].dwId == m_rootAreaId || !areas.insert( std::make_pair( m_areas[i].dwId, i ) ).second) {
+				return Fail( m_areas[i].dwLine );
+			}
+		}
+
+		// Depth first from each area to its ancestors; an area is appended
+		// after all of its ancestors. state 1 = on the path, 2 = ordered.
+		std::vector<BYTE>    state( m_areas.size(), 0 );
+		std::vector<Element> ordered;
+		std::vector<size_t>  path;
+		ordered.reserve( m_areas.size() );
+		for (size_t i = 0; i < m_areas.size(); ++i) {
+			for (size_t current = i; state[current] == 0; ) {
+				state[current] = 1;
+				path.push_back( current );
+				if (m_areas[current].dwParentId == m_rootAreaId) {
+					break;
+				}
+				std::unordered_map<DWORD, size_t>::const_iterator parent = areas.find( m_areas[current].dwParentId );
+				if (parent == areas.end() || state[parent->second] == 1) {
+					return Fail( m_areas[current].dwLine );      // unknown parent or cycle
+				}
+				current = parent->second;
+			}
+			while (!path.empty()) {
+				state[path.back()] = 2;
+				ordered.push_back( m_areas[path.back()] );
+				path.pop_back();
+			}
+		}
+		m_areas.swap( ordered );
+
+		std::unordered_map<DWORD, bool> sources( m_sources.size() * 2 );
+		for (size_t i = 0; i < m_sources.size(); ++i) {
+			const Element& source = m_sources[i];
+			if ((source.dwParentId != m_rootAreaId && areas.find( source.dwParentId ) == areas.end()) ||
+				!sources.insert( std::make_pair( source.dwId, source.fMultiSource ) ).second) {
+				return Fail( source.dwLine );
+			}
+		}
+		for (size_t i = 0; i < m_existingSources.size(); ++i) {
+			const Element& source = m_existingSources[i];
+			std::unordered_map<DWORD, bool>::const_iterator it = sources.find( source.dwId );
+			if (it == sources.end() || !it->second ||
+				(source.dwParentId != m_rootAreaId && areas.find( source.dwParentId ) == areas.end())) {
+				return Fail( source.dwLine );
+			}
+		}
+
+		std::unordered_map<DWORD, size_t> conditions( m_conditions.size() * 2 );
+		for (size_t i = 0; i < m_conditions.size(); ++i) {
+			const Element& condition = m_conditions[i];
+			if (sources.find( condition.dwParentId ) == sources.end() ||
+				!conditions.insert( std::make_pair( condition.dwId, i ) ).second) {
+				return Fail( condition.dwLine );
+			}
+		}
+	}
+	catch (...) {
+		return E_OUTOFMEMORY;
+	}
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Register
+// --------
+//    Adds the loaded areas, sources and conditions to the generic server
+//    and notifies the listener, which may be NULL. Stops at the first
+//    element the generic server or the listener rejects; ErrorLine returns
+//    its line.
+//-----------------------------------------------------------------------------
+HRESULT AeHierarchyLoader::Register( AeHierarchyListener* listener )
+{
+	HRESULT hr = S_OK;
+
+	for (size_t i = 0; i < m_areas.size() && SUCCEEDED( hr ); ++i) {
+		const Element& area = m_areas[i];
+		hr = AddArea( (int)area.dwParentId, (int)area.dwId, &m_text[area.name] );
+		if (SUCCEEDED( hr ) && listener != NULL) {
+			hr = listener->AreaAdded( area.dwParentId, area.dwId, &m_text[area.name] );
+		}
+		if (FAILED( hr )) {
+			m_dwErrorLine = area.dwLine;
+		}
+	}
+	for (size_t i = 0; i < m_sources.size() && SUCCEEDED( hr ); ++i) {
+		const Element& source = m_sources[i];
+		hr = AddSource( (int)source.dwParentId, (int)source.dwId, &m_text[source.name], source.fMultiSource );
+		if (SUCCEEDED( hr ) && listener != NULL) {
+			hr = listener->SourceAdded( source.dwParentId, source.dwId );
+		}
+		if (FAILED( hr )) {
+			m_dwErrorLine = source.dwLine;
+		}
+	}
+	for (size_t i = 0; i < m_existingSources.size() && SUCCEEDED( hr ); ++i) {
+		const Element& source = m_existingSources[i];
+		hr = AddExistingSource( (int)source.dwParentId, (int)source.dwId );
+		if (SUCCEEDED( hr ) && listener != NULL) {
+			hr = listener->SourceAdded( source.dwParentId, source.dwId );
+		}
+		if (FAILED( hr )) {
+			m_dwErrorLine = source.dwLine;
+		}
+	}
+	for (size_t i = 0; i < m_conditions.size() && SUCCEEDED( hr ); ++i) {
+		const Element& condition = m_conditions[i];
+		hr = AddCondition( (int)condition.dwParentId, (int)condition.dwValue, (int)condition.dwId );
+		if (SUCCEEDED( hr ) && listener != NULL) {
+			hr = listener->ConditionAdded( condition.dwParentId, condition.dwId );
+		}
+		if (FAILED( hr )) {
+			m_dwErrorLine = condition.dwLine;
+		}
+	}
+	return hr;
+}
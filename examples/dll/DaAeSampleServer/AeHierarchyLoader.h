@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Loads the area, source and condition hierarchy of the AE server from a file.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(AEHIERARCHYLOADER_H)
+#define AEHIERARCHYLOADER_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// CLASS AeHierarchyListener
+// -------------------------
+//    Notified of each area, source and condition after it was added to the
+//    generic server, for components which follow the AE hierarchy. A
+//    source added to a further area is reported again with that area.
+//-----------------------------------------------------------------------------
+class AeHierarchyListener
+{
+public:
+	virtual ~AeHierarchyListener() {}
+
+	virtual HRESULT AreaAdded( DWORD dwParentId, DWORD dwAreaId, LPCWSTR name ) = 0;
+	virtual HRESULT SourceAdded( DWORD dwAreaId, DWORD dwSourceId ) = 0;
+	virtual HRESULT ConditionAdded( DWORD dwSourceId, DWORD dwConditionId ) = 0;
+};
+
+//-----------------------------------------------------------------------------
+// CLASS AeHierarchyLoader
+// -----------------------
+//    Reads the process areas, event sources and conditions of the AE
+//    server from a text file and registers them with the generic server.
+//    Each line of the file defines one element, the fields are separated
+//    by blanks or tabs and the name is the rest of the line:
+//
+//        AREA        <areaId>      <parentAreaId>  <name>
+//        SOURCE      <sourceId>    <areaId>        <name>
+//        MULTISOURCE <sourceId>    <areaId>        <name>
+//        ADDSOURCE   <sourceId>    <areaId>
+//        CONDITION   <conditionId> <sourceId>      <conditionDefinitionId>
+//
+//    IDs are decimal or hexadecimal with the prefix 0x, the area ID ROOT
+//    stands for the root area. ADDSOURCE adds a MULTISOURCE to a further
+//    area. Empty lines and lines starting with ';' are ignored. The file
+//    is UTF-8 or UTF-16 with byte order mark.
+//
+//    The file defines a part of the hierarchy of its own: areas, sources
+//    and conditions may only refer to the root area or to elements of the
+//    same file, not to elements added by the plug-in before. Only the
+//    condition definitions the conditions refer to must exist when
+//    Register is called.
+//
+//    The file is read with one request and parsed in place: the names
+//    point into the text buffer, so the parser allocates nothing per line.
+//    The whole file is validated before anything is registered. Areas may
+//    be defined after their sub areas; Register adds them parents first.
+//    The listener passed to Register, if any, is notified of each
+//    registered element. ErrorLine returns the line of the element which
+//    was rejected by the validation or by Register.
+//-----------------------------------------------------------------------------
+class AeHierarchyLoader
+{
+public:
+	AeHierarchyLoader( DWORD rootAreaId );
+	~AeHierarchyLoader() {}
+
+	// Operations
+	HRESULT LoadFile( LPCWSTR fileName );
+	HRESULT LoadText( LPCWSTR text );
+	HRESULT Register( AeHierarchyListener* listener );
+
+	// Attributes
+	DWORD   ErrorLine() const { return m_dwErrorLine; }
+	DWORD   AreaCount() const { return (DWORD)m_areas.size(); }
+	DWORD   SourceCount() const { return (DWORD)m_sources.size(); }
+	DWORD   ConditionCount() const { return (DWORD)m_conditions.size(); }
+
+	// Implementation
+protected:
+	struct Element
+	{
+		DWORD    dwId;
+		DWORD    dwParentId;                     // area of areas and sources, source of conditions
+		DWORD    dwValue;                        // condition definition of conditions
+		size_t   name;                           // offset in m_text
+		bool     fMultiSource;
+		DWORD    dwLine;
+	};
+
+	HRESULT Parse();
+	HRESULT ParseLine( LPWSTR line, DWORD dwLine );
+	HRESULT Validate();
+	bool    ParseId( LPWSTR& text, bool fArea, DWORD* id ) const;
+	static LPWSTR NextField( LPWSTR& text );
+	HRESULT Fail( DWORD dwLine );
+
+	DWORD                m_rootAreaId;
+	std::wstring         m_text;                 // file content, fields terminated in place
+	std::vector<Element> m_areas;                // parents first after Validate
+	std::vector<Element> m_sources;
+	std::vector<Element> m_existingSources;      // ADDSOURCE
+	std::vector<Element> m_conditions;
+	DWORD                m_dwErrorLine;
+
+private:
+	AeHierarchyLoader( const AeHierarchyLoader& );
+	AeHierarchyLoader& operator=( const AeHierarchyLoader& );
+};
+
+#endif // !defined(AEHIERARCHYLOADER_H)
@@ -0,0 +1,489 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Alarm management KPIs per area maintained from the condition state changes.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include <algorithm>
+#include "AlarmKpis.h"
+
+#define NO_AREA                 MAXDWORD
+
+// The standing and chattering alarms are checked once per second, one
+// revolution of the wheel covers 17 minutes
+#define KPI_TIMER_RESOLUTION    1000
+#define KPI_TIMER_SLOTS         1024
+
+static const LPCWSTR gKpiNames[KPI_COUNT] = {
+	L"AlarmRate", L"ActiveAlarms", L"StandingAlarms", L"ChatteringAlarms"
+};
+
+//-----------------------------------------------------------------------------
+// CLASS AlarmKpis
+//-----------------------------------------------------------------------------
+
+AlarmKpis::AlarmKpis(
+	DWORD   dwRootAreaId,
+	LPCWSTR rootBranch,
+	WCHAR   delimiter,
+	DWORD   dwWindow,
+	DWORD   dwStandingTime,
+	DWORD   dwChatterWindow,
+	DWORD   dwChatterCount )
+	: m_rootBranch( rootBranch ),
+	  m_timers( KPI_TIMER_RESOLUTION, KPI_TIMER_SLOTS )
+{
+	m_dwRootAreaId    = dwRootAreaId;
+	m_delimiter       = delimiter;
+	m_dwWindow        = dwWindow;
+	m_dwStandingTime  = dwStandingTime;
+	m_dwChatterWindow = dwChatterWindow;
+	m_dwChatterCount  = std::max<DWORD>( 2, std::min<DWORD>( dwChatterCount, KPI_MAX_CHATTER_COUNT ) );
+
+	Area root;
+	root.dwParent = NO_AREA;
+	memset( root.kpis, 0, sizeof( root.kpis ) );
+	m_areas.push_back( root );
+	m_areaIndexes[dwRootAreaId] = 0;
+	InitializeSRWLock( &m_lock );
+}
+
+//-----------------------------------------------------------------------------
+// AreaAdded / SourceAdded / ConditionAdded
+// ----------------------------------------
+//    Follow the AE hierarchy. The areas of a condition are resolved when
+//    the condition or a further area of its source is added. Areas can
+//    not be added once SetItemHandle was called.
+//-----------------------------------------------------------------------------
+HRESULT AlarmKpis::AreaAdded( DWORD dwParentId, DWORD dwAreaId, LPCWSTR name )
+{
+	HRESULT hr = S_OK;
+
+	AcquireSRWLockExclusive( &m_lock );
+	std::unordered_map<DWORD, DWORD>::const_iterator parent = m_areaIndexes.find( dwParentId );
+	if (!m_items.empty()) {
+		hr = E_UNEXPECTED;                       // the items are numbered already
+	}
+	else if (parent == m_areaIndexes.end() || m_areaIndexes.find( dwAreaId ) != m_areaIndexes.end()) {
+		hr = E_INVALIDARG;
+	}
+	else {
+		DWORD dwIndex = (DWORD)m_areas.size();
+		try {
+			Area area;
+			area.dwParent = parent->second;
+			area.path     = m_areas[parent->second].path;
+			if (!area.path.empty()) {
+				area.path += m_delimiter;
+			}
+			area.path += name;
+			memset( area.kpis, 0, sizeof( area.kpis ) );
+			m_areas.push_back( area );
+			m_areaIndexes[dwAreaId] = dwIndex;
+		}
+		catch (...) {
+			m_areas.resize( dwIndex );
+			hr = E_OUTOFMEMORY;
+		}
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+HRESULT AlarmKpis::SourceAdded( DWORD dwAreaId, DWORD dwSourceId )
+{
+	HRESULT hr = S_OK;
+
+	AcquireSRWLockExclusive( &m_lock );
+	std::unordered_map<DWORD, DWORD>::const_iterator area = m_areaIndexes.find( dwAreaId );
+	if (area == m_areaIndexes.end()) {
+		hr = E_INVALIDARG;
+	}
+	else {
+		try {
+			m_sourceAreas[dwSourceId].push_back( area->second );
+
+			// A source added to a further area after its conditions
+			std::vector<DWORD>& conditions = m_sourceConditions[dwSourceId];
+			for (size_t i = 0; i < conditions.size(); ++i) {
+				ResolveAreas( m_conditions[conditions[i]] );
+			}
+		}
+		catch (...) {
+			hr = E_OUTOFMEMORY;
+		}
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+HRESULT AlarmKpis::ConditionAdded( DWORD dwSourceId, DWORD dwConditionId )
+{
+	HRESULT hr = S_OK;
+
+	AcquireSRWLockExclusive( &m_lock );
+	if (m_conditionIndexes.find( dwConditionId ) != m_conditionIndexes.end()) {
+		hr = E_INVALIDARG;
+	}
+	else {
+		DWORD dwIndex = (DWORD)m_conditions.size();
+		try {
+			Condition condition;
+			condition.dwId             = dwConditionId;
+			condition.dwSourceId       = dwSourceId;
+			condition.dwSubConditionId = 0;
+			condition.fActive          = false;
+			condition.fStanding        = false;
+			condition.fChattering      = false;
+			condition.dwStandingTag    = 0;
+			condition.dwChatterTag     = 0;
+			condition.lWindowAlarms    = 0;
+			condition.dwAlarms         = 0;
+			m_conditions.push_back( condition );
+			m_conditionIndexes[dwConditionId] = dwIndex;
+			m_sourceConditions[dwSourceId].push_back( dwIndex );
+			ResolveAreas( m_conditions[dwIndex] );
+		}
+		catch (...) {
+			m_conditionIndexes.erase( dwConditionId );
+			m_conditions.resize( dwIndex );
+			hr = E_OUTOFMEMORY;
+		}
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+// Collects the areas of the source of a condition and their parent areas,
+// each area once. Conditions of sources without an area count for the root
+// area only.
+void AlarmKpis::ResolveAreas( Condition& condition )
+{
+	std::vector<DWORD> areas( 1, 0 );
+
+	std::unordered_map<DWORD, std::vector<DWORD>>::const_iterator source = m_sourceAreas.find( condition.dwSourceId );
+	if (source != m_sourceAreas.end()) {
+		for (size_t i = 0; i < source->second.size(); ++i) {
+			for (DWORD dwArea = source->second[i]; dwArea != NO_AREA; dwArea = m_areas[dwArea].dwParent) {
+				if (std::find( areas.begin(), areas.end(), dwArea ) == areas.end()) {
+					areas.push_back( dwArea );
+				}
+			}
+		}
+	}
+	condition.areas.swap( areas );
+}
+
+void AlarmKpis::AddToAreas( const Condition& condition, int kpi, LONG lDelta )
+{
+	for (size_t i = 0; i < condition.areas.size(); ++i) {
+		m_areas[condition.areas[i]].kpis[kpi] += lDelta;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// StateChanged
+// ------------
+//    Updates the KPIs with a state change of a condition. A condition which
+//    becomes active or changes to another active sub-condition is counted
+//    as an alarm; other changes like acknowledgements only end the active
+//    state if the condition became inactive. Conditions which are not part
+//    of the hierarchy are ignored.
+//-----------------------------------------------------------------------------
+void AlarmKpis::StateChanged( DWORD dwConditionId, DWORD dwSubConditionId, bool fActive )
+{
+	ULONGLONG now = GetTickCount64();
+
+	AcquireSRWLockExclusive( &m_lock );
+	std::unordered_map<DWORD, DWORD>::const_iterator it = m_conditionIndexes.find( dwConditionId );
+	if (it != m_conditionIndexes.end()) {
+		DWORD      dwIndex   = it->second;
+		Condition& condition = m_conditions[dwIndex];
+
+		if (!fActive) {
+			if (condition.fActive) {
+				condition.fActive = false;
+				condition.dwStandingTag++;           // cancels the standing timer
+				AddToAreas( condition, KPI_ACTIVE, -1 );
+				if (condition.fStanding) {
+					condition.fStanding = false;
+					AddToAreas( condition, KPI_STANDING, -1 );
+				}
+			}
+		}
+		else if (!condition.fActive || condition.dwSubConditionId != dwSubConditionId) {
+			try {
+				Alarm alarm = { now, dwIndex };
+				m_window.push_back( alarm );
+				condition.lWindowAlarms++;
+				AddToAreas( condition, KPI_ALARM_RATE, 1 );
+			}
+			catch (...) {
+				// not enough memory, the alarm is not counted
+			}
+
+			condition.dwSubConditionId = dwSubConditionId;
+			if (!condition.fActive) {
+				condition.fActive = true;
+				AddToAreas( condition, KPI_ACTIVE, 1 );
+				m_timers.Schedule( dwIndex * 2 + TimerStanding, ++condition.dwStandingTag, now + m_dwStandingTime );
+			}
+
+			// The ring holds the times of the last m_dwChatterCount alarms,
+			// the next slot is the oldest of them
+			condition.recent[condition.dwAlarms % m_dwChatterCount] = now;
+			condition.dwAlarms++;
+			ULONGLONG oldest = condition.recent[condition.dwAlarms % m_dwChatterCount];
+			if (condition.dwAlarms >= m_dwChatterCount && now - oldest < m_dwChatterWindow &&
+				SUCCEEDED( m_timers.Schedule( dwIndex * 2 + TimerChattering, ++condition.dwChatterTag, oldest + m_dwChatterWindow ) )) {
+				if (!condition.fChattering) {
+					condition.fChattering = true;
+					AddToAreas( condition, KPI_CHATTERING, 1 );
+				}
+			}
+		}
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+//-----------------------------------------------------------------------------
+// RestoreActive
+// -------------
+//    Marks a condition which was active before a restart as active without
+//    counting an alarm. It becomes a standing alarm dwStandingTime after
+//    the restart.
+//-----------------------------------------------------------------------------
+void AlarmKpis::RestoreActive( DWORD dwConditionId, DWORD dwSubConditionId )
+{
+	ULONGLONG now = GetTickCount64();
+
+	AcquireSRWLockExclusive( &m_lock );
+	std::unordered_map<DWORD, DWORD>::const_iterator it = m_conditionIndexes.find( dwConditionId );
+	if (it != m_conditionIndexes.end() && !m_conditions[it->second].fActive) {
+		Condition& condition = m_conditions[it->second];
+		condition.fActive          = true;
+		condition.dwSubConditionId = dwSubConditionId;
+		AddToAreas( condition, KPI_ACTIVE, 1 );
+		m_timers.Schedule( it->second * 2 + TimerStanding, ++condition.dwStandingTag, now + m_dwStandingTime );
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+// Removes the alarms which left the window and applies the expired timers
+void AlarmKpis::Advance( ULONGLONG now )
+{
+	while (!m_window.empty() && now - m_window.front().time >= m_dwWindow) {
+		Condition& condition = m_conditions[m_window.front().dwCondition];
+		condition.lWindowAlarms--;
+		AddToAreas( condition, KPI_ALARM_RATE, -1 );
+		m_window.pop_front();
+	}
+
+	m_expired.clear();
+	try {
+		m_timers.Advance( now, m_expired );
+	}
+	catch (...) {
+		// not enough memory, the remaining timers expire with the next call
+	}
+	for (size_t e = 0; e < m_expired.size(); ++e) {
+		Condition& condition = m_conditions[m_expired[e].dwId / 2];
+		if ((m_expired[e].dwId % 2) == TimerStanding) {
+			if (m_expired[e].dwTag == condition.dwStandingTag && condition.fActive && !condition.fStanding) {
+				condition.fStanding = true;
+				AddToAreas( condition, KPI_STANDING, 1 );
+			}
+		}
+		else if (m_expired[e].dwTag == condition.dwChatterTag && condition.fChattering) {
+			condition.fChattering = false;
+			AddToAreas( condition, KPI_CHATTERING, -1 );
+		}
+	}
+}
+
+// Returns the indexes of the conditions with the most alarms within the
+// window, at most KPI_BAD_ACTORS
+void AlarmKpis::RankBadActors( DWORD* ranked, DWORD& dwRanked ) const
+{
+	dwRanked = 0;
+	for (DWORD i = 0; i < (DWORD)m_conditions.size(); ++i) {
+		LONG lAlarms = m_conditions[i].lWindowAlarms;
+		if (lAlarms == 0 || (dwRanked == KPI_BAD_ACTORS && lAlarms <= m_conditions[ranked[dwRanked - 1]].lWindowAlarms)) {
+			continue;
+		}
+		DWORD dwPos = std::min<DWORD>( dwRanked, KPI_BAD_ACTORS - 1 );
+		while (dwPos > 0 && m_conditions[ranked[dwPos - 1]].lWindowAlarms < lAlarms) {
+			ranked[dwPos] = ranked[dwPos - 1];
+			dwPos--;
+		}
+		ranked[dwPos] = i;
+		if (dwRanked < KPI_BAD_ACTORS) {
+			dwRanked++;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Collect
+// -------
+//    Moves the windows and timers to the current time and appends the
+//    items whose value changed since the last call to values. Returns the
+//    number of appended values.
+//-----------------------------------------------------------------------------
+DWORD AlarmKpis::Collect( std::vector<KpiValue>& values )
+{
+	ULONGLONG now     = GetTickCount64();
+	size_t    initial = values.size();
+
+	AcquireSRWLockExclusive( &m_lock );
+	Advance( now );
+
+	DWORD ranked[KPI_BAD_ACTORS];
+	DWORD dwRanked;
+	RankBadActors( ranked, dwRanked );
+
+	try {
+		for (DWORD dwItem = 0; dwItem < (DWORD)m_items.size(); ++dwItem) {
+			LONG  lValue;
+			DWORD dwArea = dwItem / KPI_COUNT;
+			if (dwArea < (DWORD)m_areas.size()) {
+				lValue = m_areas[dwArea].kpis[dwItem % KPI_COUNT];
+			}
+			else {
+				DWORD dwRank = (dwItem - (DWORD)m_areas.size() * KPI_COUNT) / 2;
+				if (dwRank >= dwRanked) {
+					lValue = 0;
+				}
+				else if ((dwItem - (DWORD)m_areas.size() * KPI_COUNT) % 2 == 0) {
+					lValue = (LONG)m_conditions[ranked[dwRank]].dwId;
+				}
+				else {
+					lValue = m_conditions[ranked[dwRank]].lWindowAlarms;
+				}
+			}
+
+			if (m_items[dwItem] != NULL && lValue != m_published[dwItem]) {
+				KpiValue value = { m_items[dwItem], lValue };
+				values.push_back( value );
+				m_published[dwItem] = lValue;
+			}
+		}
+	}
+	catch (...) {
+		// not enough memory, the remaining values are returned with the next call
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return (DWORD)(values.size() - initial);
+}
+
+//-----------------------------------------------------------------------------
+// GetItemId / SetItemHandle
+// -------------------------
+//    The items are numbered from 0 to ItemCount() - 1: KPI_COUNT items per
+//    area followed by the condition ID and the number of alarms of each
+//    bad actor.
+//-----------------------------------------------------------------------------
+HRESULT AlarmKpis::GetItemId( DWORD dwItem, std::wstring& itemId ) const
+{
+	HRESULT hr = S_OK;
+
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwAreaItems = (DWORD)m_areas.size() * KPI_COUNT;
+	try {
+		if (dwItem < dwAreaItems) {
+			const Area& area = m_areas[dwItem / KPI_COUNT];
+			itemId = m_rootBranch + m_delimiter;
+			if (!area.path.empty()) {
+				itemId += area.path + m_delimiter;
+			}
+			itemId += gKpiNames[dwItem % KPI_COUNT];
+		}
+		else if (dwItem < dwAreaItems + KPI_BAD_ACTORS * 2) {
+			WCHAR name[64];
+			swprintf_s( name, 64, L"%cBadActors%c%02u%c%s", m_delimiter, m_delimiter,
+						(dwItem - dwAreaItems) / 2 + 1, m_delimiter,
+						((dwItem - dwAreaItems) % 2 == 0) ? L"ConditionId" : L"Alarms" );
+			itemId = m_rootBranch + name;
+		}
+		else {
+			hr = E_INVALIDARG;
+		}
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+	ReleaseSRWLockShared( &m_lock );
+	return hr;
+}
+
+HRESULT AlarmKpis::SetItemHandle( DWORD dwItem, void* deviceItem )
+{
+	HRESULT hr = S_OK;
+
+	AcquireSRWLockExclusive( &m_lock );
+	DWORD dwCount = (DWORD)m_areas.size() * KPI_COUNT + KPI_BAD_ACTORS * 2;
+	if (dwItem >= dwCount) {
+		hr = E_INVALIDARG;
+	}
+	else {
+		try {
+			m_items.resize( dwCount, NULL );
+			m_published.resize( dwCount, 0 );
+			m_items[dwItem] = deviceItem;
+		}
+		catch (...) {
+			hr = E_OUTOFMEMORY;
+		}
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+DWORD AlarmKpis::ItemCount() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwCount = (DWORD)m_areas.size() * KPI_COUNT + KPI_BAD_ACTORS * 2;
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
+
+DWORD AlarmKpis::AreaCount() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwCount = (DWORD)m_areas.size();
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
+
+bool AlarmKpis::HasCondition( DWORD dwConditionId ) const
+{
+	AcquireSRWLockShared( &m_lock );
+	bool fFound = (m_conditionIndexes.find( dwConditionId ) != m_conditionIndexes.end());
+	ReleaseSRWLockShared( &m_lock );
+	return fFound;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Alarm management KPIs per area maintained from the condition state changes.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(ALARMKPIS_H)
+#define ALARMKPIS_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "AeHierarchyLoader.h"
+#include "TimerWheel.h"
+
+// KPIs of an area
+#define KPI_ALARM_RATE          0                // alarms within the window
+#define KPI_ACTIVE              1                // active alarms
+#define KPI_STANDING            2                // alarms active longer than the standing time
+#define KPI_CHATTERING          3                // chattering alarms
+#define KPI_COUNT               4
+
+#define KPI_BAD_ACTORS          10               // conditions ranked by their alarms
+#define KPI_MAX_CHATTER_COUNT   16
+
+//-----------------------------------------------------------------------------
+// STRUCT KpiValue
+//-----------------------------------------------------------------------------
+struct KpiValue
+{
+	void*    deviceItem;
+	LONG     lValue;
+};
+
+//-----------------------------------------------------------------------------
+// CLASS AlarmKpis
+// ---------------
+//    Alarm management KPIs in the sense of ISA-18.2 per process area,
+//    maintained from the condition state changes while they are reported:
+//
+//        AlarmRate         alarms within the last dwWindow milliseconds
+//        ActiveAlarms      active alarms
+//        StandingAlarms    alarms active for more than dwStandingTime
+//        ChatteringAlarms  conditions with dwChatterCount or more alarms
+//                          within dwChatterWindow milliseconds
+//
+//    An alarm is a condition becoming active or changing to another active
+//    sub-condition. An area includes the alarms of its sub areas; a
+//    condition of a source in several areas is counted once per area. The
+//    KPI_BAD_ACTORS conditions with the most alarms within the window are
+//    ranked in addition.
+//
+//    The counters are updated with each state change. The alarms of the
+//    window are kept in time order and removed from the counters when they
+//    leave the window; standing and chattering alarms end with timers on
+//    a timer wheel. Nothing is recalculated from the history.
+//
+//    The KPIs are exposed as DA items below rootBranch, e.g.
+//        AlarmKpis.AlarmRate                 (all areas)
+//        AlarmKpis.PlantNorth.Device1.StandingAlarms
+//        AlarmKpis.BadActors.01.ConditionId
+//        AlarmKpis.BadActors.01.Alarms
+//    GetItemId returns the IDs of the items, SetItemHandle takes the
+//    handles of the created items and Collect returns the values which
+//    changed since the last call. Areas must be added before the items
+//    are created. The methods are thread safe.
+//-----------------------------------------------------------------------------
+class AlarmKpis : public AeHierarchyListener
+{
+public:
+	AlarmKpis(
+				DWORD   dwRootAreaId,
+				LPCWSTR rootBranch,
+				WCHAR   delimiter,
+				DWORD   dwWindow,
+				DWORD   dwStandingTime,
+				DWORD   dwChatterWindow,
+				DWORD   dwChatterCount );
+	~AlarmKpis() {}
+
+	// AeHierarchyListener
+	virtual HRESULT AreaAdded( DWORD dwParentId, DWORD dwAreaId, LPCWSTR name );
+	virtual HRESULT SourceAdded( DWORD dwAreaId, DWORD dwSourceId );
+	virtual HRESULT ConditionAdded( DWORD dwSourceId, DWORD dwConditionId );
+
+	// Operations
+	void    StateChanged( DWORD dwConditionId, DWORD dwSubConditionId, bool fActive );
+	void    RestoreActive( DWORD dwConditionId, DWORD dwSubConditionId );
+	DWORD   Collect( std::vector<KpiValue>& values );
+
+	HRESULT GetItemId( DWORD dwItem, std::wstring& itemId ) const;
+	HRESULT SetItemHandle( DWORD dwItem, void* deviceItem );
+
+	// Attributes
+	DWORD   ItemCount() const;
+	DWORD   AreaCount() const;
+	bool    HasCondition( DWORD dwConditionId ) const;
+
+	// Implementation
+protected:
+	// Timers of a condition, the kind is in the lowest bit of the timer ID
+	enum TimerKind
+	{
+		TimerStanding   = 0,
+		TimerChattering = 1
+	};
+
+	struct Area
+	{
+		DWORD        dwParent;                   // index, NO_AREA for the root area
+		std::wstring path;                       // item ID path below the root branch
+		LONG         kpis[KPI_COUNT];
+	};
+
+	struct Condition
+	{
+		DWORD        dwId;
+		DWORD        dwSourceId;
+		DWORD        dwSubConditionId;           // active sub-condition
+		bool         fActive;
+		bool         fStanding;
+		bool         fChattering;
+		DWORD        dwStandingTag;
+		DWORD        dwChatterTag;
+		LONG         lWindowAlarms;
+		DWORD        dwAlarms;                   // all alarms, for the chatter ring
+		ULONGLONG    recent[KPI_MAX_CHATTER_COUNT];
+		std::vector<DWORD> areas;                // indexes of the areas incl. parent areas
+	};
+
+	struct Alarm
+	{
+		ULONGLONG    time;
+		DWORD        dwCondition;                // index
+	};
+
+	void    ResolveAreas( Condition& condition );
+	void    AddToAreas( const Condition& condition, int kpi, LONG lDelta );
+	void    Advance( ULONGLONG now );
+	void    RankBadActors( DWORD* ranked, DWORD& dwRanked ) const;
+
+	DWORD                                        m_dwRootAreaId;
+	std::wstring                                 m_rootBranch;
+	WCHAR                                        m_delimiter;
+	DWORD                                        m_dwWindow;
+	DWORD                                        m_dwStandingTime;
+	DWORD                                        m_dwChatterWindow;
+	DWORD                                        m_dwChatterCount;
+
+	std::vector<Area>                            m_areas;
+	std::vector<Condition>                       m_conditions;
+	std::unordered_map<DWORD, DWORD>             m_areaIndexes;       // ID -> index
+	std::unordered_map<DWORD, DWORD>             m_conditionIndexes;
+	std::unordered_map<DWORD, std::vector<DWORD>> m_sourceAreas;      // source ID -> area indexes
+	std::unordered_map<DWORD, std::vector<DWORD>> m_sourceConditions; // source ID -> condition indexes
+
+	std::deque<Alarm>                            m_window;            // alarms in time order
+	TimerWheel                                   m_timers;
+	std::vector<TimerEntry>                      m_expired;
+
+	std::vector<void*>                           m_items;             // item handles, see GetItemId
+	std::vector<LONG>                            m_published;         // values returned by Collect
+	mutable SRWLOCK                              m_lock;
+
+private:
+	AlarmKpis( const AlarmKpis& );
+	AlarmKpis& operator=( const AlarmKpis& );
+};
+
+#endif // !defined(ALARMKPIS_H)
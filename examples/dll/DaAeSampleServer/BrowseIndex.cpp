@@ -0,0 +1,1269 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Address space index used for custom mode browsing.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "BrowseIndex.h"
+#include "WildcardFilter.h"
+#include <algorithm>
+#include <intrin.h>
+
+using namespace IClassicBaseNodeManager;
+
+//-----------------------------------------------------------------------------
+// HELPERS
+//-----------------------------------------------------------------------------
+
+// Returns a copy of the string allocated with new[]. The generic server
+// takes ownership of the strings returned by the browse methods.
+static LPWSTR AllocString( const WCHAR* str, size_t len )
+{
+	LPWSTR copy = new WCHAR[len + 1];
+	wmemcpy( copy, str, len );
+	copy[len] = L'\0';
+	return copy;
+}
+
+static LPWSTR AllocString( const std::wstring& str )
+{
+	return AllocString( str.c_str(), str.length() );
+}
+
+// Data types are indexed without VT_BYREF, so a filter for VT_R8 also finds
+// items defined as VT_R8 | VT_BYREF.
+static VARTYPE CanonicalType( VARTYPE dataType )
+{
+	return (VARTYPE)(dataType & ~VT_BYREF);
+}
+
+// Key of Node::subtreeCounts
+static DWORD SubtreeKey( VARTYPE dataType, DaAccessRights accessRights )
+{
+	return ((DWORD)accessRights << 16) | dataType;
+}
+
+// Clears all bits in selection which are not set in bitmap.
+static void Intersect( std::vector<DWORD>& selection, const std::vector<DWORD>& bitmap )
+{
+	for (size_t i = 0; i < selection.size(); ++i) {
+		selection[i] &= (i < bitmap.size()) ? bitmap[i] : 0;
+	}
+}
+
+// Orders pointers to names by the names.
+static bool LessName( const std::wstring* left, const std::wstring* right )
+{
+	return *left < *right;
+}
+
+// Returns true if name starts with prefix.
+static bool StartsWith( const std::wstring& name, const std::wstring& prefix )
+{
+	return name.compare( 0, prefix.length(), prefix ) == 0;
+}
+
+//-----------------------------------------------------------------------------
+// CLASS BrowseIndex
+//-----------------------------------------------------------------------------
+
+BrowseIndex::BrowseIndex( WCHAR delimiter )
+{
+	m_delimiter      = delimiter;
+	m_dwItemCount    = 0;
+	m_dwLazyBranches = 0;
+	InitializeSRWLock( &m_lock );
+	InitializeCriticalSection( &m_csRefreshQueue );
+}
+
+BrowseIndex::~BrowseIndex()
+{
+	std::map<std::wstring, Node*>::iterator it;
+	for (it = m_root.branches.begin(); it != m_root.branches.end(); ++it) {
+		DeleteNode( it->second );
+	}
+	DeleteCriticalSection( &m_csRefreshQueue );
+}
+
+void BrowseIndex::DeleteNode( Node* node )
+{
+	std::map<std::wstring, Node*>::iterator it;
+	for (it = node->branches.begin(); it != node->branches.end(); ++it) {
+		DeleteNode( it->second );
+	}
+	delete node;
+}
+
+//-----------------------------------------------------------------------------
+// AddItem
+// -------
+//    Adds the item to the index. All branches of the fully qualified item ID
+//    are created if they do not yet exist.
+//-----------------------------------------------------------------------------
+HRESULT BrowseIndex::AddItem(
+	LPCWSTR        itemId,
+	VARTYPE        dataType,
+	DaAccessRights accessRights )
+{
+	if (itemId == NULL || *itemId == L'\0') {
+		return E_INVALIDARG;
+	}
+
+	AcquireSRWLockExclusive( &m_lock );
+
+	HRESULT hr = S_OK;
+	try {
+		LPCWSTR name = wcsrchr( itemId, m_delimiter );
+		Node*   node = CreateBranches( itemId, name ? name - itemId : 0 );
+		AddLeaf( node, name ? name + 1 : itemId, dataType, accessRights );
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// RemoveItem
+// ----------
+//    Removes the item from the index. Branches which become empty are
+//    removed as well.
+//-----------------------------------------------------------------------------
+HRESULT BrowseIndex::RemoveItem( LPCWSTR itemId )
+{
+	if (itemId == NULL) {
+		return E_INVALIDARG;
+	}
+
+	AcquireSRWLockExclusive( &m_lock );
+
+	HRESULT hr    = S_OK;
+	LPCWSTR name  = wcsrchr( itemId, m_delimiter );
+	Node*   node  = &m_root;
+
+	if (name != NULL) {
+		std::wstring branch( itemId, name - itemId );
+		node = FindBranch( branch.c_str() );
+		name++;
+	}
+	else {
+		name = itemId;
+	}
+
+	std::map<std::wstring, DWORD>::iterator it;
+	if (node == NULL || (it = node->leaves.find( name )) == node->leaves.end()) {
+		hr = E_INVALIDARG;
+	}
+	else {
+		RemoveLeaf( node, it );
+		while (node != &m_root && node->provider == NULL &&
+			   node->leaves.empty() && node->branches.empty()) {
+			Node* parent = node->parent;
+			parent->branches.erase( node->name );
+			delete node;
+			node = parent;
+		}
+	}
+
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// AddLazyBranch
+// -------------
+//    Defines a branch whose children are loaded from the provider the first
+//    time the branch is expanded. Child branches returned by the provider
+//    are loaded the same way. Loaded branches are reloaded in the
+//    background once dwTimeToLive milliseconds have passed.
+//-----------------------------------------------------------------------------
+HRESULT BrowseIndex::AddLazyBranch(
+	LPCWSTR         branchPath,
+	BrowseProvider* provider,
+	DWORD           dwTimeToLive )
+{
+	if (branchPath == NULL || *branchPath == L'\0' || provider == NULL) {
+		return E_INVALIDARG;
+	}
+
+	AcquireSRWLockExclusive( &m_lock );
+
+	HRESULT hr = S_OK;
+	try {
+		Node* node = CreateBranches( branchPath, wcslen( branchPath ) );
+		if (node->provider == NULL) {
+			m_dwLazyBranches++;
+		}
+		node->provider     = provider;
+		node->dwTimeToLive = dwTimeToLive;
+		node->fLoaded      = false;
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// FindItem
+// --------
+//    Returns the data type and access rights of an item. Lazy branches on
+//    the path of the item are loaded if required. Returns E_INVALIDARG if
+//    the item is unknown.
+//-----------------------------------------------------------------------------
+HRESULT BrowseIndex::FindItem(
+	LPCWSTR         itemId,
+	VARTYPE*        dataType,
+	DaAccessRights* accessRights )
+{
+	if (itemId == NULL || dataType == NULL || accessRights == NULL) {
+		return E_INVALIDARG;
+	}
+
+	HRESULT      hr   = S_OK;
+	LPCWSTR      name = wcsrchr( itemId, m_delimiter );
+	std::wstring branch;
+
+	try {
+		if (name != NULL) {
+			branch.assign( itemId, name - itemId );
+			name++;
+		}
+		else {
+			name = itemId;
+		}
+	}
+	catch (...) {
+		return E_OUTOFMEMORY;
+	}
+
+	hr = LoadPath( branch.c_str() );
+	if (FAILED( hr )) {
+		return hr;
+	}
+
+	AcquireSRWLockShared( &m_lock );
+
+	const Node* node = FindBranch( branch.c_str() );
+	std::map<std::wstring, DWORD>::const_iterator it;
+
+	if (node == NULL || (it = node->leaves.find( name )) == node->leaves.end()) {
+		hr = E_INVALIDARG;
+	}
+	else {
+		*dataType     = node->slots[it->second].dataType;
+		*accessRights = node->slots[it->second].accessRights;
+	}
+
+	ReleaseSRWLockShared( &m_lock );
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// RefreshBranches
+// ---------------
+//    Reloads up to dwMaxBranches expired branches which have been accessed
+//    since they expired. Called periodically from a background thread.
+//-----------------------------------------------------------------------------
+void BrowseIndex::RefreshBranches( DWORD dwMaxBranches )
+{
+	for (DWORD i = 0; i < dwMaxBranches; ++i) {
+		std::wstring path;
+
+		EnterCriticalSection( &m_csRefreshQueue );
+		bool fEmpty = m_refreshQueue.empty();
+		if (!fEmpty) {
+			path.swap( m_refreshQueue.back() );
+			m_refreshQueue.pop_back();
+		}
+		LeaveCriticalSection( &m_csRefreshQueue );
+
+		if (fEmpty) {
+			break;
+		}
+
+		AcquireSRWLockShared( &m_lock );
+		const Node*     node     = FindBranch( path.c_str() );
+		BrowseProvider* provider = node ? node->provider : NULL;
+		ReleaseSRWLockShared( &m_lock );
+
+		if (provider != NULL && FAILED( LoadBranch( path, provider ) )) {
+			// Keep the cached children; the next access queues a new attempt
+			AcquireSRWLockShared( &m_lock );
+			node = FindBranch( path.c_str() );
+			if (node != NULL) {
+				InterlockedExchange( &node->refreshPending, 0 );
+			}
+			ReleaseSRWLockShared( &m_lock );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// LoadPath
+// --------
+//    Loads all lazy branches on the specified branch path, including the
+//    branch itself, which have not yet been loaded. Expired branches are
+//    queued for a refresh by RefreshBranches. Must be called without the
+//    lock held.
+//-----------------------------------------------------------------------------
+HRESULT BrowseIndex::LoadPath( LPCWSTR path )
+{
+	if (m_dwLazyBranches == 0) {
+		return S_OK;
+	}
+
+	try {
+		std::wstring branch;
+		LPCWSTR      segment = path ? path : L"";
+
+		for (;;) {
+			BrowseProvider* provider = NULL;
+			bool            fExpired = false;
+
+			AcquireSRWLockShared( &m_lock );
+			const Node* node = FindBranch( branch.c_str() );
+			if (node != NULL && node->provider != NULL) {
+				if (!node->fLoaded) {
+					provider = node->provider;
+				}
+				else if (GetTickCount64() >= node->expires) {
+					fExpired = (InterlockedExchange( &node->refreshPending, 1 ) == 0);
+				}
+			}
+			ReleaseSRWLockShared( &m_lock );
+
+			if (node == NULL) {
+				return S_OK;                         // unknown branch, reported by the caller
+			}
+			if (provider != NULL) {
+				HRESULT hr = LoadBranch( branch, provider );
+				if (FAILED( hr )) {
+					return hr;
+				}
+			}
+			else if (fExpired) {
+				EnterCriticalSection( &m_csRefreshQueue );
+				try {
+					m_refreshQueue.push_back( branch );
+				}
+				catch (...) {
+				}
+				LeaveCriticalSection( &m_csRefreshQueue );
+			}
+
+			if (*segment == L'\0') {
+				return S_OK;
+			}
+			LPCWSTR delim = wcschr( segment, m_delimiter );
+			size_t  len   = delim ? delim - segment : wcslen( segment );
+			if (!branch.empty()) {
+				branch += m_delimiter;
+			}
+			branch.append( segment, len );
+			segment += delim ? len + 1 : len;
+		}
+	}
+	catch (...) {
+		return E_OUTOFMEMORY;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// LoadBranch
+// ----------
+//    Queries the children of a lazy branch from its provider and replaces
+//    the cached children. The provider is called without the lock held.
+//-----------------------------------------------------------------------------
+HRESULT BrowseIndex::LoadBranch( const std::wstring& path, BrowseProvider* provider )
+{
+	std::vector<BrowseEntry> entries;
+
+	HRESULT hr = provider->BrowseBranch( path.c_str(), entries );
+	if (FAILED( hr )) {
+		return hr;
+	}
+
+	AcquireSRWLockExclusive( &m_lock );
+
+	try {
+		Node* node = FindBranch( path.c_str() );
+		if (node != NULL && node->provider == provider) {
+			Merge( node, entries );
+			node->fLoaded = true;
+			node->expires = GetTickCount64() + node->dwTimeToLive;
+			InterlockedExchange( &node->refreshPending, 0 );
+		}
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Merge
+// -----
+//    Replaces the children of a lazy branch with the entries returned by
+//    its provider. Unchanged child branches keep their loaded children,
+//    new child branches are loaded when they are expanded. The caller must
+//    hold the lock exclusively.
+//-----------------------------------------------------------------------------
+void BrowseIndex::Merge( Node* node, const std::vector<BrowseEntry>& entries )
+{
+	std::map<std::wstring, const BrowseEntry*> leaves;
+	std::map<std::wstring, const BrowseEntry*> branches;
+
+	for (size_t i = 0; i < entries.size(); ++i) {
+		if (entries[i].fBranch) {
+			branches[entries[i].name] = &entries[i];
+		}
+		else {
+			leaves[entries[i].name] = &entries[i];
+		}
+	}
+
+	// Remove the children which no longer exist
+	std::map<std::wstring, DWORD>::iterator leaf = node->leaves.begin();
+	while (leaf != node->leaves.end()) {
+		if (leaves.find( leaf->first ) == leaves.end()) {
+			RemoveLeaf( node, leaf++ );
+		}
+		else {
+			++leaf;
+		}
+	}
+	std::map<std::wstring, Node*>::iterator branch = node->branches.begin();
+	while (branch != node->branches.end()) {
+		if (branches.find( branch->first ) == branches.end()) {
+			RemoveBranch( node, branch++ );
+		}
+		else {
+			++branch;
+		}
+	}
+
+	// Add new and update existing children
+	std::map<std::wstring, const BrowseEntry*>::const_iterator it;
+	for (it = leaves.begin(); it != leaves.end(); ++it) {
+		AddLeaf( node, it->first, it->second->dataType, it->second->accessRights );
+	}
+	for (it = branches.begin(); it != branches.end(); ++it) {
+		if (node->branches.find( it->first ) == node->branches.end()) {
+			Node* child         = new Node;
+			child->parent       = node;
+			child->name         = it->first;
+			child->provider     = node->provider;
+			child->dwTimeToLive = node->dwTimeToLive;
+			try {
+				node->branches.insert( std::make_pair( it->first, child ) );
+			}
+			catch (...) {
+				delete child;
+				throw;
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// CreateBranches
+// --------------
+//    Returns the node of the branch path[0..length), all branches on the
+//    path are created if they do not yet exist. The caller must hold the
+//    lock exclusively.
+//-----------------------------------------------------------------------------
+BrowseIndex::Node* BrowseIndex::CreateBranches( LPCWSTR path, size_t length )
+{
+	Node*   node    = &m_root;
+	LPCWSTR segment = path;
+	LPCWSTR end     = path + length;
+
+	while (segment < end) {
+		LPCWSTR delim = std::find( segment, end, m_delimiter );
+		std::wstring name( segment, delim - segment );
+		std::map<std::wstring, Node*>::iterator it = node->branches.find( name );
+		if (it == node->branches.end()) {
+			Node* child   = new Node;
+			child->parent = node;
+			child->name   = name;
+			try {
+				it = node->branches.insert( std::make_pair( name, child ) ).first;
+			}
+			catch (...) {
+				delete child;
+				throw;
+			}
+		}
+		node    = it->second;
+		segment = (delim < end) ? delim + 1 : end;
+	}
+	return node;
+}
+
+// Adds or redefines an item of the branch. The caller must hold the lock
+// exclusively.
+void BrowseIndex::AddLeaf(
+	Node*               node,
+	const std::wstring& name,
+	VARTYPE             dataType,
+	DaAccessRights      accessRights )
+{
+	DWORD slot;
+	std::map<std::wstring, DWORD>::iterator it = node->leaves.find( name );
+	if (it != node->leaves.end()) {
+		slot = it->second;                       // redefinition of an existing item
+		IndexLeaf( node, slot, -1 );
+	}
+	else {
+		if (node->freeSlots.empty()) {
+			// Keep room for all slots so RemoveLeaf can always free one
+			node->freeSlots.reserve( node->slots.size() + 1 );
+			node->slots.push_back( ItemInfo() );
+			node->freeSlots.push_back( (DWORD)node->slots.size() - 1 );
+		}
+		slot = node->freeSlots.back();
+		it   = node->leaves.insert( std::make_pair( name, slot ) ).first;
+		node->freeSlots.pop_back();
+		m_dwItemCount++;
+	}
+
+	ItemInfo& leaf    = node->slots[slot];
+	leaf.name         = &it->first;
+	leaf.dataType     = CanonicalType( dataType );
+	leaf.accessRights = accessRights;
+	IndexLeaf( node, slot, 1 );
+}
+
+// Removes an item of the branch. The caller must hold the lock exclusively.
+void BrowseIndex::RemoveLeaf( Node* node, std::map<std::wstring, DWORD>::iterator leaf )
+{
+	DWORD slot = leaf->second;
+	IndexLeaf( node, slot, -1 );
+	node->slots[slot].name = NULL;
+	node->leaves.erase( leaf );
+	node->freeSlots.push_back( slot );           // capacity reserved by AddLeaf
+	m_dwItemCount--;
+}
+
+// Removes a child branch with all its children. The caller must hold the
+// lock exclusively.
+void BrowseIndex::RemoveBranch( Node* node, std::map<std::wstring, Node*>::iterator branch )
+{
+	Node* child = branch->second;
+
+	std::map<DWORD, DWORD>::const_iterator it;
+	for (it = child->subtreeCounts.begin(); it != child->subtreeCounts.end(); ++it) {
+		for (Node* n = node; n != NULL; n = n->parent) {
+			std::map<DWORD, DWORD>::iterator count = n->subtreeCounts.find( it->first );
+			if (count != n->subtreeCounts.end() && (count->second -= it->second) == 0) {
+				n->subtreeCounts.erase( count );
+			}
+		}
+		m_dwItemCount -= it->second;
+	}
+
+	node->branches.erase( branch );
+	DeleteNode( child );
+}
+
+//-----------------------------------------------------------------------------
+// FindBranch
+// ----------
+//    Returns the node of the specified branch path or NULL if the path does
+//    not represent a branch. A NULL or empty path is the root. The caller
+//    must hold the lock.
+//-----------------------------------------------------------------------------
+BrowseIndex::Node* BrowseIndex::FindBranch( LPCWSTR path ) const
+{
+	Node* node = const_cast<Node*>( &m_root );
+
+	if (path == NULL || *path == L'\0') {
+		return node;
+	}
+
+	LPCWSTR segment = path;
+	for (;;) {
+		LPCWSTR delim = wcschr( segment, m_delimiter );
+		std::wstring name = delim ? std::wstring( segment, delim - segment ) : std::wstring( segment );
+
+		std::map<std::wstring, Node*>::const_iterator it = node->branches.find( name );
+		if (it == node->branches.end()) {
+			return NULL;
+		}
+		node = it->second;
+		if (delim == NULL) {
+			return node;
+		}
+		segment = delim + 1;
+	}
+}
+
+// Builds the fully qualified path of a branch node. The caller must hold the lock.
+void BrowseIndex::BuildPath( const Node* node, std::wstring& path ) const
+{
+	if (node == NULL || node->parent == NULL) {
+		path.clear();
+		return;
+	}
+	BuildPath( node->parent, path );
+	if (!path.empty()) {
+		path += m_delimiter;
+	}
+	path += node->name;
+}
+
+void BrowseIndex::Bitmap::Set( DWORD bit )
+{
+	if ((bit >> 5) >= words.size()) {
+		words.resize( (bit >> 5) + 1, 0 );
+	}
+	words[bit >> 5] |= (1UL << (bit & 31));
+}
+
+void BrowseIndex::Bitmap::Clear( DWORD bit )
+{
+	if ((bit >> 5) < words.size()) {
+		words[bit >> 5] &= ~(1UL << (bit & 31));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// IndexLeaf
+// ---------
+//    Adds (delta = 1) or removes (delta = -1) the item in the specified slot
+//    to or from the bitmap indexes of its branch and the subtree counts of
+//    the branch and all its parents.
+//-----------------------------------------------------------------------------
+void BrowseIndex::IndexLeaf( Node* node, DWORD slot, int delta )
+{
+	const ItemInfo& leaf = node->slots[slot];
+	DWORD           key  = SubtreeKey( leaf.dataType, leaf.accessRights );
+
+	if (delta > 0) {
+		node->typeIndex[leaf.dataType].Set( slot );
+		if (leaf.accessRights & Readable) {
+			node->readableIndex.Set( slot );
+		}
+		if (leaf.accessRights & Writable) {
+			node->writableIndex.Set( slot );
+		}
+		for (Node* n = node; n != NULL; n = n->parent) {
+			n->subtreeCounts[key]++;
+		}
+	}
+	else {
+		std::map<VARTYPE, Bitmap>::iterator it = node->typeIndex.find( leaf.dataType );
+		if (it != node->typeIndex.end()) {
+			it->second.Clear( slot );
+		}
+		node->readableIndex.Clear( slot );
+		node->writableIndex.Clear( slot );
+		for (Node* n = node; n != NULL; n = n->parent) {
+			std::map<DWORD, DWORD>::iterator count = n->subtreeCounts.find( key );
+			if (count != n->subtreeCounts.end() && --count->second == 0) {
+				n->subtreeCounts.erase( count );
+			}
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// SelectLeaves
+// ------------
+//    Intersects the bitmap indexes of the branch for the specified filters.
+//    On return bit n of selection is set if the item in slot n passes the
+//    filters. Returns false if no item of the branch can pass.
+//-----------------------------------------------------------------------------
+bool BrowseIndex::SelectLeaves(
+	const Node*         node,
+	VARTYPE             dataTypeFilter,
+	DaAccessRights      accessRightsFilter,
+	std::vector<DWORD>& selection )
+{
+	selection.assign( (node->slots.size() + 31) / 32, 0xFFFFFFFF );
+
+	if (dataTypeFilter != VT_EMPTY) {
+		std::map<VARTYPE, Bitmap>::const_iterator it = node->typeIndex.find( CanonicalType( dataTypeFilter ) );
+		if (it == node->typeIndex.end()) {
+			return false;
+		}
+		Intersect( selection, it->second.words );
+	}
+	if (accessRightsFilter & Readable) {
+		Intersect( selection, node->readableIndex.words );
+	}
+	if (accessRightsFilter & Writable) {
+		Intersect( selection, node->writableIndex.words );
+	}
+	return true;
+}
+
+// Returns true if an item at or below node has the requested data type and
+// access rights.
+bool BrowseIndex::SubtreeMatches(
+	const Node*    node,
+	VARTYPE        dataTypeFilter,
+	DaAccessRights accessRightsFilter )
+{
+	VARTYPE dataType = CanonicalType( dataTypeFilter );
+
+	std::map<DWORD, DWORD>::const_iterator it;
+	for (it = node->subtreeCounts.begin(); it != node->subtreeCounts.end(); ++it) {
+		VARTYPE        itemType   = (VARTYPE)(it->first & 0xFFFF);
+		DaAccessRights itemRights = (DaAccessRights)(it->first >> 16);
+		if ((dataTypeFilter == VT_EMPTY || itemType == dataType) &&
+			(itemRights & accessRightsFilter) == accessRightsFilter) {
+			return true;
+		}
+	}
+	return false;
+}
+
+//-----------------------------------------------------------------------------
+// ChangePosition
+// --------------
+//    Implements the Up, Down and To moves of OnBrowseChangePosition. The
+//    new position is returned as a string allocated with new[].
+//-----------------------------------------------------------------------------
+HRESULT BrowseIndex::ChangePosition(
+	DaBrowseDirection browseDirection,
+	LPCWSTR           currentPosition,
+	LPCWSTR           position,
+	LPWSTR          * newPosition )
+{
+	if (newPosition == NULL) {
+		return E_INVALIDARG;
+	}
+
+	// Load the children of the branch to move from
+	HRESULT hr = LoadPath( browseDirection == To ? position : currentPosition );
+	if (FAILED( hr )) {
+		return hr;
+	}
+
+	AcquireSRWLockShared( &m_lock );
+
+	const Node*  node = NULL;
+
+	switch (browseDirection) {
+		case Up:
+			node = FindBranch( currentPosition );
+			if (node == NULL || node == &m_root) {
+				hr = E_FAIL;                     // already at the root
+			}
+			else {
+				node = node->parent;
+			}
+			break;
+
+		case Down:
+			node = FindBranch( currentPosition );
+			if (node != NULL && position != NULL) {
+				std::map<std::wstring, Node*>::const_iterator it = node->branches.find( position );
+				node = (it != node->branches.end()) ? it->second : NULL;
+			}
+			if (node == NULL || position == NULL || *position == L'\0') {
+				hr = E_INVALIDARG;               // not a branch
+			}
+			break;
+
+		case To:
+			node = FindBranch( position );
+			if (node == NULL) {
+				hr = E_INVALIDARG;               // not a branch
+			}
+			break;
+
+		default:
+			hr = E_INVALIDARG;
+			break;
+	}
+
+	if (SUCCEEDED( hr )) {
+		try {
+			std::wstring path;
+			BuildPath( node, path );
+			*newPosition = AllocString( path );
+		}
+		catch (...) {
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	ReleaseSRWLockShared( &m_lock );
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// BrowseItemIds
+// -------------
+//    Returns the branches, leaves or (flat) fully qualified item IDs at and
+//    below the specified position which pass the filters. The array and
+//    the strings are allocated with new[].
+//
+//    The matching names are counted first and then copied directly into
+//    an array of the exact size, so no intermediate copy of the result is
+//    held during the call.
+//-----------------------------------------------------------------------------
+HRESULT BrowseIndex::BrowseItemIds(
+	LPCWSTR        position,
+	DaBrowseType   browseFilterType,
+	LPCWSTR        filterCriteria,
+	VARTYPE        dataTypeFilter,
+	DaAccessRights accessRightsFilter,
+	int          * noItems,
+	LPWSTR      ** itemIds )
+{
+	return BrowseItemIdsPage( position, browseFilterType, filterCriteria, dataTypeFilter,
+							  accessRightsFilter, NULL, 0, noItems, itemIds, NULL );
+}
+
+//-----------------------------------------------------------------------------
+// BrowseItemIdsPage
+// -----------------
+//    Paged variant of BrowseItemIds. At most maxCount names (0 = no limit)
+//    are returned per call. If more names are available a continuation
+//    point is returned in nextContinuationPoint, which must be passed with
+//    otherwise unchanged arguments to get the next page. It is NULL after
+//    the last page.
+//
+//    The continuation point is the last returned name (the fully qualified
+//    item ID for flat browsing). No state is kept between the calls; the
+//    next page starts behind this name in browse order, so items added or
+//    removed between two pages do not invalidate the browse.
+//-----------------------------------------------------------------------------
+HRESULT BrowseIndex::BrowseItemIdsPage(
+	LPCWSTR        position,
+	DaBrowseType   browseFilterType,
+	LPCWSTR        filterCriteria,
+	VARTYPE        dataTypeFilter,
+	DaAccessRights accessRightsFilter,
+	LPCWSTR        continuationPoint,
+	DWORD          maxCount,
+	int          * noItems,
+	LPWSTR      ** itemIds,
+	LPWSTR       * nextContinuationPoint )
+{
+	if (noItems == NULL || itemIds == NULL) {
+		return E_INVALIDARG;
+	}
+	*noItems = 0;
+	*itemIds = NULL;
+	if (nextContinuationPoint) {
+		*nextContinuationPoint = NULL;
+	}
+	if (browseFilterType != Branch && browseFilterType != Leaf && browseFilterType != Flat) {
+		return E_INVALIDARG;
+	}
+
+	HRESULT hr = LoadPath( position );
+	if (FAILED( hr )) {
+		return hr;
+	}
+
+	AcquireSRWLockShared( &m_lock );
+
+	const Node* node = FindBranch( position );
+
+	if (node == NULL) {
+		ReleaseSRWLockShared( &m_lock );
+		return E_INVALIDARG;
+	}
+
+	Output out;
+	out.itemIds = NULL;
+	out.count   = 0;
+	out.limit   = (maxCount > 0) ? maxCount + 1 : 0xFFFFFFFF;
+
+	try {
+		// The filter expression is compiled once for all names of this call.
+		// Only the sorted range of names starting with its literal prefix
+		// has to be checked.
+		WildcardFilter filter( filterCriteria );
+		std::wstring   cursor( continuationPoint ? continuationPoint : L"" );
+
+		// First pass: count the names of this page plus one to detect more pages
+		hr = Traverse( node, browseFilterType, filter, dataTypeFilter, accessRightsFilter, cursor, out );
+
+		if (SUCCEEDED( hr ) && out.count > 0) {
+			DWORD count = (maxCount > 0 && out.count > maxCount) ? maxCount : out.count;
+			bool  fMore = (out.count > count);
+
+			// Second pass: copy the names into the result array
+			out.itemIds = new LPWSTR[count];
+			out.count   = 0;
+			out.limit   = count;
+			Traverse( node, browseFilterType, filter, dataTypeFilter, accessRightsFilter, cursor, out );
+
+			if (fMore && nextContinuationPoint) {
+				*nextContinuationPoint = AllocString( out.itemIds[count - 1], wcslen( out.itemIds[count - 1] ) );
+			}
+			*noItems = (int)out.count;
+			*itemIds = out.itemIds;
+		}
+	}
+	catch (...) {
+		if (out.itemIds) {
+			for (DWORD i = 0; i < out.count; ++i) {
+				delete [] out.itemIds[i];
+			}
+			delete [] out.itemIds;
+		}
+		hr = E_OUTOFMEMORY;
+	}
+
+	ReleaseSRWLockShared( &m_lock );
+	return hr;
+}
+
+// Adds a name to the output. Returns false if the output is full.
+bool BrowseIndex::Output::Add( const std::wstring& itemId )
+{
+	if (count >= limit) {
+		return false;
+	}
+	if (itemIds) {
+		itemIds[count] = AllocString( itemId );
+	}
+	count++;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Traverse
+// --------
+//    Passes the names behind the cursor which pass the filters in browse
+//    order to the output until it is full. Branches and leaves are sorted
+//    by name. Flat browsing returns the items of a branch before the items
+//    of its child branches. The caller must hold the lock.
+//-----------------------------------------------------------------------------
+HRESULT BrowseIndex::Traverse(
+	const Node*           node,
+	DaBrowseType          browseFilterType,
+	const WildcardFilter& filter,
+	VARTYPE               dataTypeFilter,
+	DaAccessRights        accessRightsFilter,
+	const std::wstring&   cursor,
+	Output&               out ) const
+{
+	const std::wstring& prefix = filter.LiteralPrefix();
+	const std::wstring* after  = cursor.empty() ? NULL : &cursor;
+	std::wstring        path;
+
+	switch (browseFilterType) {
+		case Branch:
+			{
+				std::map<std::wstring, Node*>::const_iterator it = node->branches.lower_bound( prefix );
+				if (after && it != node->branches.end() && it->first <= *after) {
+					it = node->branches.upper_bound( *after );
+				}
+				for (; it != node->branches.end() && StartsWith( it->first, prefix ); ++it) {
+					if (filter.Matches( it->first ) && !out.Add( it->first )) {
+						break;
+					}
+				}
+			}
+			break;
+
+		case Leaf:
+			CollectLeaves( node, path, prefix, after, filter, dataTypeFilter, accessRightsFilter, out );
+			break;
+
+		default:                                 // Flat
+			{
+				// The cursor is a fully qualified item ID below the position
+				std::vector<std::wstring> resume;
+				BuildPath( node, path );
+				if (after) {
+					size_t start = 0;
+					if (!path.empty()) {
+						if (cursor.length() <= path.length() || !StartsWith( cursor, path ) ||
+							cursor[path.length()] != m_delimiter) {
+							return E_INVALIDARG;
+						}
+						start = path.length() + 1;
+					}
+					for (;;) {
+						size_t delim = cursor.find( m_delimiter, start );
+						resume.push_back( cursor.substr( start, delim - start ) );
+						if (delim == std::wstring::npos) {
+							break;
+						}
+						start = delim + 1;
+					}
+				}
+				CollectFlat( node, path, filter, dataTypeFilter, accessRightsFilter,
+							 resume.empty() ? NULL : &resume, 0, out );
+			}
+			break;
+	}
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// CollectLeaves
+// -------------
+//    Passes path + name for every item of the branch whose name starts with
+//    prefix, is behind after (if not NULL) and which passes the filters.
+//    With a data type or access rights filter only the items selected by
+//    the bitmap indexes are visited, otherwise the sorted range of names
+//    starting with prefix. The names are passed in sorted order in both
+//    cases. Returns false if the output is full.
+//-----------------------------------------------------------------------------
+bool BrowseIndex::CollectLeaves(
+	const Node*           node,
+	std::wstring&         path,
+	const std::wstring&   prefix,
+	const std::wstring*   after,
+	const WildcardFilter& filter,
+	VARTYPE               dataTypeFilter,
+	DaAccessRights        accessRightsFilter,
+	Output&               out ) const
+{
+	size_t pathLen = path.length();
+	bool   fContinue = true;
+
+	if (dataTypeFilter == VT_EMPTY && accessRightsFilter == NotKnown) {
+		std::map<std::wstring, DWORD>::const_iterator leaf = node->leaves.lower_bound( prefix );
+		if (after && leaf != node->leaves.end() && leaf->first <= *after) {
+			leaf = node->leaves.upper_bound( *after );
+		}
+		for (; fContinue && leaf != node->leaves.end() && StartsWith( leaf->first, prefix ); ++leaf) {
+			path.resize( pathLen );
+			path += leaf->first;
+			if (filter.Matches( path )) {
+				fContinue = out.Add( path );
+			}
+		}
+		path.resize( pathLen );
+		return fContinue;
+	}
+
+	std::vector<DWORD> selection;
+	if (!SelectLeaves( node, dataTypeFilter, accessRightsFilter, selection )) {
+		return true;
+	}
+
+	// Slots are in definition order, the selected names are sorted before
+	// they are passed to the output
+	std::vector<const std::wstring*> names;
+	for (size_t word = 0; word < selection.size(); ++word) {
+		DWORD bits = selection[word];
+		while (bits != 0) {
+			unsigned long bit;
+			_BitScanForward( &bit, bits );
+			bits &= bits - 1;
+
+			const std::wstring* name = node->slots[word * 32 + bit].name;
+			if (StartsWith( *name, prefix ) && (after == NULL || *name > *after)) {
+				names.push_back( name );
+			}
+		}
+	}
+	std::sort( names.begin(), names.end(), LessName );
+
+	for (size_t i = 0; fContinue && i < names.size(); ++i) {
+		path.resize( pathLen );
+		path += *names[i];
+		if (filter.Matches( path )) {
+			fContinue = out.Add( path );
+		}
+	}
+	path.resize( pathLen );
+	return fContinue;
+}
+
+//-----------------------------------------------------------------------------
+// CollectFlat
+// -----------
+//    Recursively passes the fully qualified IDs of all items at and below
+//    node to the output. Subtrees and ranges of names which cannot start
+//    with the literal prefix of the filter are skipped without being
+//    visited. If resume is not NULL, resume[level...] are the path segments
+//    of the cursor below node and only the items behind it are passed.
+//    Returns false if the output is full.
+//-----------------------------------------------------------------------------
+bool BrowseIndex::CollectFlat(
+	const Node*                      node,
+	std::wstring&                    path,
+	const WildcardFilter&            filter,
+	VARTYPE                          dataTypeFilter,
+	DaAccessRights                   accessRightsFilter,
+	const std::vector<std::wstring>* resume,
+	size_t                           level,
+	Output&                          out ) const
+{
+	if ((dataTypeFilter != VT_EMPTY || accessRightsFilter != NotKnown) &&
+		!SubtreeMatches( node, dataTypeFilter, accessRightsFilter )) {
+		return true;
+	}
+
+	size_t len = path.length();
+	if (len > 0) {
+		path += m_delimiter;
+	}
+	size_t prefixLen = path.length();
+
+	// Part of the literal prefix which must be matched by the names below node
+	const std::wstring& prefix = filter.LiteralPrefix();
+	std::wstring        rest;
+
+	if (prefixLen >= prefix.length()) {
+		if (!StartsWith( path, prefix )) {
+			path.resize( len );
+			return true;
+		}
+	}
+	else {
+		if (prefix.compare( 0, prefixLen, path ) != 0) {
+			path.resize( len );
+			return true;
+		}
+		rest = prefix.substr( prefixLen );
+	}
+
+	// Position of the cursor in this branch
+	const std::wstring* afterLeaf   = NULL;
+	const std::wstring* afterBranch = NULL;
+	bool                fContinue   = true;
+
+	if (resume && level < resume->size()) {
+		if (level + 1 == resume->size()) {
+			afterLeaf = &(*resume)[level];       // cursor is an item of this branch
+		}
+		else {
+			// Cursor is below a child branch, the items of this branch
+			// have already been passed
+			afterBranch = &(*resume)[level];
+			std::map<std::wstring, Node*>::const_iterator child = node->branches.find( *afterBranch );
+			if (child != node->branches.end()) {
+				path.resize( prefixLen );
+				path += child->first;
+				fContinue = CollectFlat( child->second, path, filter, dataTypeFilter, accessRightsFilter,
+										 resume, level + 1, out );
+			}
+		}
+	}
+
+	if (fContinue && afterBranch == NULL) {
+		fContinue = CollectLeaves( node, path, rest, afterLeaf, filter, dataTypeFilter, accessRightsFilter, out );
+	}
+
+	std::map<std::wstring, Node*>::const_iterator branch;
+	size_t delim = rest.find( m_delimiter );
+
+	if (!fContinue) {
+		// output is full
+	}
+	else if (delim != std::wstring::npos) {
+		// The prefix continues below a single child branch
+		branch = node->branches.find( rest.substr( 0, delim ) );
+		if (branch != node->branches.end() && (afterBranch == NULL || branch->first > *afterBranch)) {
+			path.resize( prefixLen );
+			path += branch->first;
+			fContinue = CollectFlat( branch->second, path, filter, dataTypeFilter, accessRightsFilter,
+									 NULL, 0, out );
+		}
+	}
+	else {
+		branch = node->branches.lower_bound( rest );
+		if (afterBranch && branch != node->branches.end() && branch->first <= *afterBranch) {
+			branch = node->branches.upper_bound( *afterBranch );
+		}
+		for (; fContinue && branch != node->branches.end() && StartsWith( branch->first, rest ); ++branch) {
+			path.resize( prefixLen );
+			path += branch->first;
+			fContinue = CollectFlat( branch->second, path, filter, dataTypeFilter, accessRightsFilter,
+									 NULL, 0, out );
+		}
+	}
+
+	path.resize( len );
+	return fContinue;
+}
+
+//-----------------------------------------------------------------------------
+// GetFullItemId
+// -------------
+//    Builds the fully qualified ID of a branch or leaf at the specified
+//    position. If itemName is NULL or empty the position itself is returned.
+//-----------------------------------------------------------------------------
+HRESULT BrowseIndex::GetFullItemId(
+	LPCWSTR  position,
+	LPCWSTR  itemName,
+	LPWSTR * fullItemId )
+{
+	if (fullItemId == NULL) {
+		return E_INVALIDARG;
+	}
+	*fullItemId = NULL;
+
+	HRESULT hr = LoadPath( position );
+	if (FAILED( hr )) {
+		return hr;
+	}
+
+	AcquireSRWLockShared( &m_lock );
+
+	const Node* node = FindBranch( position );
+
+	if (node == NULL) {
+		hr = E_INVALIDARG;
+	}
+	else if (itemName != NULL && *itemName != L'\0' &&
+			 node->leaves.find( itemName ) == node->leaves.end() &&
+			 node->branches.find( itemName ) == node->branches.end()) {
+		hr = E_INVALIDARG;                       // unknown branch or leaf
+	}
+	else {
+		try {
+			std::wstring fullId;
+			BuildPath( node, fullId );
+			if (itemName != NULL && *itemName != L'\0') {
+				if (!fullId.empty()) {
+					fullId += m_delimiter;
+				}
+				fullId += itemName;
+			}
+			*fullItemId = AllocString( fullId );
+		}
+		catch (...) {
+			hr = E_OUTOFMEMORY;
+		}
+	}
+
+	ReleaseSRWLockShared( &m_lock );
+	return hr;
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Address space index used for custom mode browsing.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(BROWSEINDEX_H)
+#define BROWSEINDEX_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <map>
+#include <string>
+#include <vector>
+#include "IClassicBaseNodeManager.h"
+
+class WildcardFilter;
+
+//-----------------------------------------------------------------------------
+// STRUCT BrowseEntry
+// ------------------
+//    Branch or item returned by a BrowseProvider.
+//-----------------------------------------------------------------------------
+struct BrowseEntry
+{
+	std::wstring                            name;
+	bool                                    fBranch;
+	VARTYPE                                 dataType;      // items only
+	IClassicBaseNodeManager::DaAccessRights accessRights;  // items only
+};
+
+//-----------------------------------------------------------------------------
+// CLASS BrowseProvider
+// --------------------
+//    Source of the branches and items of a lazily browsed part of the
+//    address space, typically a device which returns its tag list only on
+//    request. BrowseBranch returns the direct children of the specified
+//    branch. It is called without any lock of the BrowseIndex held and may
+//    block while the device is queried.
+//-----------------------------------------------------------------------------
+class BrowseProvider
+{
+public:
+	virtual ~BrowseProvider() {}
+
+	virtual HRESULT BrowseBranch( LPCWSTR branchPath, std::vector<BrowseEntry>& entries ) = 0;
+};
+
+//-----------------------------------------------------------------------------
+// CLASS BrowseIndex
+// -----------------
+//    Trie of the fully qualified item IDs of the address space. Every edge
+//    is a complete path segment between two branch delimiters, so a node
+//    represents exactly one branch and the leaves stored at a node are the
+//    items directly below that branch.
+//
+//    Position changes and the lookup of the browse position passed by the
+//    generic server walk one child per path segment and are therefore
+//    O(depth) regardless of the size of the address space.
+//
+//    The index is used by the custom mode browse methods
+//    OnBrowseChangePosition, OnBrowseItemIds and OnBrowseGetFullItemId.
+//    Every branch keeps bitmap indexes of its items per canonical data type
+//    and per access right. Browse calls with a data type or access rights
+//    filter intersect these bitmaps instead of checking every item, and
+//    flat browsing skips subtrees which contain no item with the requested
+//    data type and access rights.
+//
+//    Branches added with AddLazyBranch are loaded from a BrowseProvider the
+//    first time they are expanded. The result is cached for the specified
+//    time to live; an expired branch is still served from the cache while
+//    it is queued for a refresh, which is done by RefreshBranches in the
+//    background. Flat browsing only returns the branches loaded so far.
+//
+//    BrowseItemIdsPage returns the browse result in pages of a limited size
+//    with a continuation point, so the memory needed per call is bounded by
+//    the page size instead of the size of the address space.
+//    It is exported as OnBrowseItemIdsPage.
+//
+//    All methods are thread safe; browse calls of different clients run
+//    concurrently and are only serialized against modifications.
+//-----------------------------------------------------------------------------
+class BrowseIndex
+{
+public:
+	explicit BrowseIndex( WCHAR delimiter = L'.' );
+	~BrowseIndex();
+
+	// Operations
+	HRESULT AddItem(
+				LPCWSTR                                 itemId,
+				VARTYPE                                 dataType,
+				IClassicBaseNodeManager::DaAccessRights accessRights );
+
+	HRESULT RemoveItem( LPCWSTR itemId );
+
+	HRESULT AddLazyBranch(
+				LPCWSTR                                 branchPath,
+				BrowseProvider                        * provider,
+				DWORD                                   dwTimeToLive );
+
+	HRESULT FindItem(
+				LPCWSTR                                 itemId,
+				VARTYPE                               * dataType,
+				IClassicBaseNodeManager::DaAccessRights * accessRights );
+
+	void    RefreshBranches( DWORD dwMaxBranches );
+
+	HRESULT ChangePosition(
+				IClassicBaseNodeManager::DaBrowseDirection browseDirection,
+				LPCWSTR                                    currentPosition,
+				LPCWSTR                                    position,
+				LPWSTR                                   * newPosition );
+
+	HRESULT BrowseItemIds(
+				LPCWSTR                                 position,
+				IClassicBaseNodeManager::DaBrowseType   browseFilterType,
+				LPCWSTR                                 filterCriteria,
+				VARTYPE                                 dataTypeFilter,
+				IClassicBaseNodeManager::DaAccessRights accessRightsFilter,
+				int                                   * noItems,
+				LPWSTR                               ** itemIds );
+
+	HRESULT BrowseItemIdsPage(
+				LPCWSTR                                 position,
+				IClassicBaseNodeManager::DaBrowseType   browseFilterType,
+				LPCWSTR                                 filterCriteria,
+				VARTYPE                                 dataTypeFilter,
+				IClassicBaseNodeManager::DaAccessRights accessRightsFilter,
+				LPCWSTR                                 continuationPoint,
+				DWORD                                   maxCount,
+				int                                   * noItems,
+				LPWSTR                               ** itemIds,
+				LPWSTR                                * nextContinuationPoint );
+
+	HRESULT GetFullItemId(
+				LPCWSTR                                 position,
+				LPCWSTR                                 itemName,
+				LPWSTR                                * fullItemId );
+
+	// Attributes
+	WCHAR   Delimiter() const { return m_delimiter; }
+	DWORD   ItemCount() const { return m_dwItemCount; }
+
+	// Implementation
+protected:
+	struct ItemInfo
+	{
+		const std::wstring*                     name;          // key in Node::leaves, NULL if slot is free
+		VARTYPE                                 dataType;      // canonical data type
+		IClassicBaseNodeManager::DaAccessRights accessRights;
+	};
+
+	// Set of leaf slots of one branch, bit n stands for Node::slots[n]
+	struct Bitmap
+	{
+		std::vector<DWORD>  words;
+
+		void Set( DWORD bit );
+		void Clear( DWORD bit );
+	};
+
+	struct Node
+	{
+		Node() : parent( NULL ), provider( NULL ), dwTimeToLive( 0 ), expires( 0 ),
+				 fLoaded( false ), refreshPending( 0 ) {}
+
+		Node*                             parent;
+		std::wstring                      name;
+		std::map<std::wstring, Node*>     branches;      // sorted child branches
+		std::map<std::wstring, DWORD>     leaves;        // sorted items of this branch, value is the slot
+		std::vector<ItemInfo>             slots;         // items by slot number
+		std::vector<DWORD>                freeSlots;
+
+		// Bitmap indexes over the slots of this branch
+		std::map<VARTYPE, Bitmap>         typeIndex;
+		Bitmap                            readableIndex;
+		Bitmap                            writableIndex;
+
+		// Number of items at and below this branch per data type and access
+		// rights, used to skip subtrees during flat browsing
+		std::map<DWORD, DWORD>            subtreeCounts;
+
+		// Lazily loaded branches
+		BrowseProvider*                   provider;      // NULL for branches defined with AddItem
+		DWORD                             dwTimeToLive;
+		ULONGLONG                         expires;       // GetTickCount64() value
+		bool                              fLoaded;
+		mutable volatile LONG             refreshPending;
+	};
+
+	Node*   FindBranch( LPCWSTR path ) const;
+	Node*   CreateBranches( LPCWSTR path, size_t length );
+	void    AddLeaf(
+				Node*                                   node,
+				const std::wstring&                     name,
+				VARTYPE                                 dataType,
+				IClassicBaseNodeManager::DaAccessRights accessRights );
+	void    RemoveLeaf( Node* node, std::map<std::wstring, DWORD>::iterator leaf );
+	void    RemoveBranch( Node* node, std::map<std::wstring, Node*>::iterator branch );
+	HRESULT LoadPath( LPCWSTR path );
+	HRESULT LoadBranch( const std::wstring& path, BrowseProvider* provider );
+	void    Merge( Node* node, const std::vector<BrowseEntry>& entries );
+	void    BuildPath( const Node* node, std::wstring& path ) const;
+
+	// Receiver of the names found by a browse traversal. Without an array
+	// the names are only counted.
+	struct Output
+	{
+		LPWSTR*  itemIds;
+		DWORD    count;
+		DWORD    limit;
+
+		bool Add( const std::wstring& itemId );
+	};
+
+	HRESULT Traverse(
+				const Node*                             node,
+				IClassicBaseNodeManager::DaBrowseType   browseFilterType,
+				const WildcardFilter&                   filter,
+				VARTYPE                                 dataTypeFilter,
+				IClassicBaseNodeManager::DaAccessRights accessRightsFilter,
+				const std::wstring&                     cursor,
+				Output&                                 out ) const;
+	bool    CollectLeaves(
+				const Node*                             node,
+				std::wstring&                           path,
+				const std::wstring&                     prefix,
+				const std::wstring*                     after,
+				const WildcardFilter&                   filter,
+				VARTYPE                                 dataTypeFilter,
+				IClassicBaseNodeManager::DaAccessRights accessRightsFilter,
+				Output&                                 out ) const;
+	bool    CollectFlat(
+				const Node*                             node,
+				std::wstring&                           path,
+				const WildcardFilter&                   filter,
+				VARTYPE                                 dataTypeFilter,
+				IClassicBaseNodeManager::DaAccessRights accessRightsFilter,
+				const std::vector<std::wstring>*        resume,
+				size_t                                  level,
+				Output&                                 out ) const;
+
+	static void IndexLeaf( Node* node, DWORD slot, int delta );
+	static bool SelectLeaves(
+				const Node*                             node,
+				VARTYPE                                 dataTypeFilter,
+				IClassicBaseNodeManager::DaAccessRights accessRightsFilter,
+				std::vector<DWORD>&                     selection );
+	static bool SubtreeMatches(
+				const Node*                             node,
+				VARTYPE                                 dataTypeFilter,
+				IClassicBaseNodeManager::DaAccessRights accessRightsFilter );
+	static void DeleteNode( Node* node );
+
+	WCHAR           m_delimiter;
+	Node            m_root;
+	DWORD           m_dwItemCount;
+	mutable SRWLOCK m_lock;
+
+	DWORD                       m_dwLazyBranches;
+	std::vector<std::wstring>   m_refreshQueue;      // paths of expired branches
+	CRITICAL_SECTION            m_csRefreshQueue;
+
+private:
+	BrowseIndex( const BrowseIndex& );
+	BrowseIndex& operator=( const BrowseIndex& );
+};
+
+#endif // !defined(BROWSEINDEX_H)
@@ -34,9 +34,29 @@
 #include <comdef.h>										// For _variant_t and _bstr_t
 #include <crtdbg.h>										// For _ASSERTE
 #include <process.h>
-#include <math.h>                               // only for calculation of data simulation values
+#include <math.h>                               // only for calculation of data simulation values and limits
 #include "IClassicBaseNodeManager.h"
 #include "ClassicNodeManager.h"
+#include "BrowseIndex.h"
+#include "SimulatedDevice.h"
+#include "ItemResolver.h"
+#include "NegativeCache.h"
+#include "IdleItemTracker.h"
+#include "SubscriptionManager.h"
+#include "Prefetcher.h"
+#include "PropertyStore.h"
+#include "ConditionEngine.h"
+#include "ItemTranslationTable.h"
+#include "ConditionStateCollector.h"
+#include "ConditionSnapshot.h"
+#include "EventSuppressor.h"
+#include "EventAttributePool.h"
+#include "AeHierarchyLoader.h"
+#include "AlarmKpis.h"
+#include "AckPipeline.h"
+#include "EventJournal.h"
+#include <map>
+#include <vector>
 
 using namespace IClassicBaseNodeManager;
 
@@ -65,6 +85,7 @@ using namespace IClassicBaseNodeManager;
 // Simple Event Category IDs
 #define CATID_DEVFAILURE				0x100
 #define CATID_SYSMESSAGE				0x101
+#define CATID_SUPPRESSION				0x102
 
 // Tracking Event Category IDs   
 #define CATID_SYSCONFIG					0x200
@@ -83,7 +104,11 @@ using namespace IClassicBaseNodeManager;
 #define ATTRID_SYSCONFIG_PREVVALUE		0x403
 #define ATTRID_SYSCONFIG_NEWVALUE		0x404
 #define ATTRID_ADVCONTROL_PREVVALUE		0x405
-#define ATTRID_ADVCONTROL_NEWVALUE		0x406                                     
+#define ATTRID_ADVCONTROL_NEWVALUE		0x406
+#define ATTRID_DEVFAILURE_REPEATCOUNT	0x407
+#define ATTRID_SUPPRESSION_CATEGORY		0x408
+#define ATTRID_SUPPRESSION_DROPPED		0x409
+#define ATTRID_SUPPRESSION_REPEATED		0x40A
 
 //-----------------------------------------------------------------------------
 // Condition Definition IDs            
@@ -161,13 +186,19 @@ using namespace IClassicBaseNodeManager;
 #define PROPID_CASING_HEIGHT  5651
 #define PROPID_CASING_MANUFACTURER  5652
 
+// Device-backed properties of the data words of the simulated device
+#define PROPID_DEVICE_SERIAL_NUMBER  5660
+#define PROPID_DEVICE_FIRMWARE  5661
+#define PROPID_DEVICE_CALIBRATION_DATE  5662
+
 //-----------------------------------------------------------------------------
 // FORWARD DECLARATIONS
 //-----------------------------------------------------------------------------
 unsigned __stdcall RefreshThread( LPVOID pAttr );
 unsigned __stdcall ConfigThread(LPVOID pAttr);
 HRESULT KillThreads(void);
-void __stdcall ToggleTank1Cond(  );
+static void PollDeviceItems();
+static void RemoveIdleItems();
 
 //-----------------------------------------------------------------------------
 // DATA                                                                  SAMPLE
@@ -177,7 +208,9 @@ void* gDeviceItem_NumberItems = NULL;
 void* gDeviceItem_SimRamp = NULL;
 void* gDeviceItem_SimSine = NULL;
 void* gDeviceItem_SimRandom = NULL;
+void* gDeviceItem_SimTank1Level = NULL;
 void* gDeviceItem_RequestShutdownCommand = NULL;
+void* gDeviceItem_ReplayEventsCommand = NULL;
 void* gItemHandle_SpecialEU = NULL;
 void* gItemHandle_SpecialEU2 = NULL;
 void* gItemHandle_SpecialProperties = NULL;
@@ -191,7 +224,154 @@ HANDLE               m_hTerminateThreadsEvent;
 
 ServerState  gServerState = ServerState::NoConfig;
 
-DWORD gNumberItems = 0;
+// Items in the server's cache, changed concurrently by OnRequestItems and
+// RemoveIdleItems
+volatile LONG gNumberItems = 0;
+
+// Index of all defined items used for the custom mode browsing
+BrowseIndex gBrowseIndex( BRANCH_DELIMITER );
+
+// Custom properties of the items (see OnQueryProperties / OnGetPropertyValue)
+PropertyStore gPropertyStore( DEVICE_PROPERTY_ERROR_TTL );
+
+// Limits of the multi-state conditions checked each update cycle
+ConditionEngine gConditionEngine;
+
+// DA items of the condition attributes returned by OnTranslateToItemId
+ItemTranslationTable gItemTranslations;
+
+// Condition state changes of the current update cycle, processed at once
+ConditionStateCollector gConditionStates( CONDITION_BATCH_SIZE );
+
+// Conditions not in their normal state, saved to CONDITION_SNAPSHOT_FILE
+ConditionSnapshot gConditionSnapshot;
+
+// Alarm rate, standing and chattering alarms per area, exposed below KPI_BRANCH
+AlarmKpis gAlarmKpis( AREAID_ROOT, KPI_BRANCH, BRANCH_DELIMITER, KPI_WINDOW,
+					  KPI_STANDING_TIME, KPI_CHATTER_WINDOW, KPI_CHATTER_COUNT );
+
+// Rate limits of the simple and tracking events per source and category
+static const EventLimit gDefaultEventLimit = { EVENT_RATE_LIMIT, EVENT_BURST_LIMIT, EVENT_FOLD_TIME, false };
+EventSuppressor gEventSuppressor( gDefaultEventLimit );
+
+// Reusable attribute values of the simple and tracking events
+EventAttributePool gEventAttributes( EVENT_INTERNED_STRINGS );
+
+// Journal of the processed simple and tracking events in EVENT_JOURNAL_DIR
+EventJournal gEventJournal( EVENT_JOURNAL_SEGMENT_SIZE, EVENT_JOURNAL_SEGMENTS );
+HRESULT      gEventJournalResult = S_OK;  // result of Open, reported by the ConfigThread
+
+// Minutes of events to replay, written with Commands.ReplayEvents
+volatile LONG gReplayMinutes = 0;
+
+// Controllers whose tag lists are browsed on demand, 20 ms per request
+SimulatedDevice gSimulatedDevice( DEVICE_BRANCH, BRANCH_DELIMITER, DEVICE_CONTROLLERS,
+								  DEVICE_DATA_BLOCKS, DEVICE_DATA_WORDS, 20 );
+
+//-----------------------------------------------------------------------------
+// DYNAMIC DEVICE ITEMS                                                  SAMPLE
+//-----------------------------------------------------------------------------
+// The data words of the simulated device are not defined at startup. Their
+// item IDs are resolved by pattern when a client accesses them and the
+// items are then added to the server's cache (see OnRequestItems).
+#define PATTERNID_DATAWORD				1
+#define DATAWORD_STRIDE					2       // offset step of the data words
+
+// Address of a dynamic item in the simulated device
+struct DeviceAddress
+{
+	DWORD    dwController;
+	DWORD    dwDataBlock;
+	DWORD    dwOffset;
+	VARTYPE  dataType;                           // canonical data type of the item
+};
+
+ItemResolver                    gItemResolver;
+std::map<void*, DeviceAddress>  gDeviceItems;    // dynamic items by device item handle
+std::map<ULONGLONG, void*>      gDeviceAddresses;// dynamic items by address, see AddressKey()
+SRWLOCK                         gDeviceItemsLock = SRWLOCK_INIT;
+
+// Item IDs which could neither be resolved nor found on the device. A
+// client with a misconfigured item list requests them again and again,
+// these requests are answered from the cache without a device access.
+NegativeCache                   gNegativeCache( NEGATIVE_CACHE_SIZE, NEGATIVE_CACHE_TTL );
+
+// Items added by OnRequestItems are removed from the server's cache again
+// when no client used them for DYNAMIC_ITEM_IDLE_TIME or if they exceed
+// DYNAMIC_ITEM_BUDGET. The memory of an item is estimated from its ID and
+// the overhead of the cache entry.
+#define DYNAMIC_ITEM_OVERHEAD			256
+
+IdleItemTracker                 gIdleItems( DYNAMIC_ITEM_IDLE_TIME, DYNAMIC_ITEM_BUDGET );
+
+// Dynamic items in the group of at least one client. Only these items are
+// polled from the device by the RefreshThread.
+SubscriptionManager             gSubscriptions;
+
+// Clients add the data words of a block in ascending order, one request per
+// item. The following data words are added to the cache in advance.
+#define PREFETCH_MAX_STREAMS			64
+
+Prefetcher                      gPrefetcher( DEVICE_PREFETCH_MIN, DEVICE_PREFETCH_MAX, PREFETCH_MAX_STREAMS );
+
+//-----------------------------------------------------------------------------
+// CLASS DevicePropertyProvider                                          SAMPLE
+//-----------------------------------------------------------------------------
+// The data words have the identification of their controller as properties.
+// The values are read from the controller when first requested and cached
+// for the following times in milliseconds.
+#define DEVICE_SERIAL_NUMBER_TTL		3600000
+#define DEVICE_FIRMWARE_TTL				600000
+#define DEVICE_CALIBRATION_DATE_TTL		60000
+
+class DevicePropertyProvider : public PropertyProvider
+{
+public:
+	// All data words of a controller share the values
+	virtual bool GetPropertySource( void* deviceItem, ULONGLONG* source )
+	{
+		bool fFound = false;
+
+		AcquireSRWLockShared( &gDeviceItemsLock );
+		std::map<void*, DeviceAddress>::const_iterator it = gDeviceItems.find( deviceItem );
+		if (it != gDeviceItems.end()) {
+			*source = it->second.dwController;
+			fFound  = true;
+		}
+		ReleaseSRWLockShared( &gDeviceItemsLock );
+		return fFound;
+	}
+
+	virtual HRESULT ReadProperty( ULONGLONG source, int propertyId, LPVARIANT value )
+	{
+		ControllerInfo info;
+
+		HRESULT hr = gSimulatedDevice.ReadControllerInfo( (DWORD)source, &info );
+		if (FAILED( hr )) {
+			return hr;
+		}
+		switch (propertyId) {
+			case PROPID_DEVICE_SERIAL_NUMBER:
+				V_VT( value )   = VT_BSTR;
+				V_BSTR( value ) = SysAllocString( info.serialNumber );
+				break;
+			case PROPID_DEVICE_FIRMWARE:
+				V_VT( value )   = VT_BSTR;
+				V_BSTR( value ) = SysAllocString( info.firmwareVersion );
+				break;
+			case PROPID_DEVICE_CALIBRATION_DATE:
+				V_VT( value )   = VT_DATE;
+				V_DATE( value ) = info.calibrationDate;
+				return S_OK;
+			default:
+				return E_INVALIDARG;
+		}
+		return (V_BSTR( value ) != NULL) ? S_OK : E_OUTOFMEMORY;
+	}
+};
+
+DevicePropertyProvider          gDevicePropertyProvider;
+PropertySet*                    gDeviceProperties = NULL;
 
 //-----------------------------------------------------------------------------
 // CLASS DataSimulation                                                 SAMPLE
@@ -206,6 +386,7 @@ public:
 		m_lRamp           = 0;
 		m_dblSine         = 0.0;
 		m_lRandom         = 0;
+		m_lTank1Level     = 70;
 	}
 
 	~DataSimulation() {}
@@ -214,6 +395,7 @@ public:
 	long     RampValue() { return m_lRamp; }
 	double   SineValue() { return m_dblSine; }
 	long     RandomValue() { return m_lRandom; }
+	long     Tank1LevelValue() { return m_lTank1Level; }
 
 	// Operations
 	void CalculateNewData()
@@ -225,6 +407,7 @@ public:
 			m_lRamp     = (++m_lRamp > 100) ? 0 : m_lRamp;
 			m_dblSine   = sin( (m_lCount%40) * 0.1570796327 );
 			m_lRandom   = rand();
+			m_lTank1Level = 75 + m_lRandom % 11;     // chatters around the overflow limit
 		}
 	}
 
@@ -236,89 +419,408 @@ protected:
 	long     m_lRamp;
 	double   m_dblSine;
 	long     m_lRandom;
+	long     m_lTank1Level;
 };
 
 
 DataSimulation gDataSimulation;
 
 //-----------------------------------------------------------------------------
-// ToggleTank1Cond														 SAMPLE
-// ---------------
-//    Each call of this function changes the active state of the
-//    condition specified by ID CONDID_TANK_1_OVERFLOW.
-//    This function also sets the required attribute valus and uses
-//    an own message which is used instead of the default message.
+// PublishConditionState												 SAMPLE
+// ---------------------
+//    Adds a condition state change to the changes of the current update
+//    cycle, to the snapshot restored after a restart and to the alarm
+//    KPIs.
+//-----------------------------------------------------------------------------
+static HRESULT PublishConditionState( AeConditionState& cs )
+{
+	gConditionSnapshot.Update( cs );
+	gAlarmKpis.StateChanged( cs.CondID(), cs.SubCondID(), cs.ActiveState() != FALSE );
+	return gConditionStates.Add( cs );
+}
+
+//-----------------------------------------------------------------------------
+// PublishItemValue														 SAMPLE
+// ----------------
+//    Writes a new value of an item into the cache of the generic server
+//    and passes it to the conditions bound to the item, which are checked
+//    by the next call of EvaluateLimitConditions. Values with a quality
+//    other than good leave the conditions at the last good value.
+//-----------------------------------------------------------------------------
+static HRESULT PublishItemValue( void* deviceItem, LPVARIANT newValue, short quality, FILETIME timeStamp )
+{
+	HRESULT hr = SetItemValue( deviceItem, newValue, quality, timeStamp );
+	if ((quality & OPC_QUALITY_MASK) == OPC_QUALITY_GOOD && gConditionEngine.IsBound( deviceItem )) {
+		VARIANT varVal;
+		VariantInit( &varVal );
+		if (SUCCEEDED( VariantChangeType( &varVal, newValue, 0, VT_R8 ) )) {
+			gConditionEngine.SetValue( deviceItem, V_R8( &varVal ) );
+		}
+		VariantClear( &varVal );
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// EvaluateLimitConditions												 SAMPLE
+// -----------------------
+//    Checks the values published since the last cycle for the items bound
+//    to multi-state conditions like CONDID_WATER_LEVEL against their
+//    limits. The conditions whose active sub condition changed are added
+//    to the changes of this cycle. The current value is reported in the
+//    attribute ATTRID_LEVEL_CV.
+//-----------------------------------------------------------------------------
+static void EvaluateLimitConditions()
+{
+	std::vector<LimitTransition> transitions;
+	gConditionEngine.Evaluate( transitions );
+
+	for (size_t i = 0; i < transitions.size(); ++i) {
+		_variant_t       attrs[1];
+		AeConditionState cs;
+
+		cs.CondID()        = transitions[i].dwConditionId;
+		cs.SubCondID()     = transitions[i].dwSubConditionId;
+		cs.ActiveState()   = transitions[i].fActive;
+		cs.Quality()       = OPC_QUALITY_GOOD;
+		attrs[0]           = (long)transitions[i].value;     // Current Value
+		cs.AttrCount()     = 1;
+		cs.AttrValuesPtr() = attrs;
+		PublishConditionState( cs );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// PublishAlarmKpis														 SAMPLE
+// ----------------
+//    Writes the alarm KPIs which changed since the last update cycle into
+//    the cache.
+//-----------------------------------------------------------------------------
+static void PublishAlarmKpis( FILETIME timeStamp )
+{
+	std::vector<KpiValue> values;
+	gAlarmKpis.Collect( values );
+
+	for (size_t i = 0; i < values.size(); ++i) {
+		VARIANT varVal;
+		V_VT( &varVal ) = VT_I4;
+		V_I4( &varVal ) = values[i].lValue;
+		PublishItemValue( values[i].deviceItem, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), timeStamp );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// DefineEventAttribute													 SAMPLE
+// --------------------
+//    Adds an attribute to an event category of the generic server and to
+//    the pooled attribute arrays of the category.
+//-----------------------------------------------------------------------------
+static HRESULT DefineEventAttribute( int categoryId, int eventAttribute, LPWSTR attributeDescription, VARTYPE dataType )
+{
+	HRESULT hr = AddEventAttribute( categoryId, eventAttribute, attributeDescription, dataType );
+	if (SUCCEEDED( hr )) {
+		hr = gEventAttributes.DefineAttribute( categoryId, eventAttribute );
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// BindLimitCondition													 SAMPLE
+// ------------------
+//    Binds a multi-state condition to the DA item whose value is checked
+//    against the limits and registers the item as the source of the
+//    current value attribute, so clients can go from the alarm to the
+//    process value with TranslateToItemIDs.
 //-----------------------------------------------------------------------------
-void __stdcall ToggleTank1Cond()
+static HRESULT BindLimitCondition( DWORD dwConditionId, void* deviceItem, LPCWSTR itemId, const LimitDefinition& definition )
+{
+	CLSID clsid;
+	HRESULT hr = CLSIDFromString( OnGetDaServerDefinition()->ClsidServer, &clsid );
+	if (SUCCEEDED( hr )) {
+		hr = gConditionEngine.AddLimitCondition( dwConditionId, deviceItem, definition );
+	}
+	if (SUCCEEDED( hr )) {
+		hr = gItemTranslations.AddLimitCondition( dwConditionId, definition, ATTRID_LEVEL_CV, itemId, NULL, clsid );
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// DefineArea / DefineSource / DefineExistingSource / DefineCondition	 SAMPLE
+// ------------------------------------------------------------------
+//    Add an element of the AE hierarchy to the generic server and to the
+//    alarm KPIs, which are maintained per area.
+//-----------------------------------------------------------------------------
+static HRESULT DefineArea( int parentAreaId, int areaId, LPWSTR areaName )
+{
+	HRESULT hr = AddArea( parentAreaId, areaId, areaName );
+	if (SUCCEEDED( hr )) {
+		hr = gAlarmKpis.AreaAdded( parentAreaId, areaId, areaName );
+	}
+	return hr;
+}
+
+static HRESULT DefineSource( int areaId, int sourceId, LPWSTR sourceName, bool multiSource )
+{
+	HRESULT hr = AddSource( areaId, sourceId, sourceName, multiSource );
+	if (SUCCEEDED( hr )) {
+		hr = gAlarmKpis.SourceAdded( areaId, sourceId );
+	}
+	return hr;
+}
+
+static HRESULT DefineExistingSource( int areaId, int sourceId )
 {
-	static      BOOL fActive = FALSE;
-	_variant_t  devfailattrs[1];
+	HRESULT hr = AddExistingSource( areaId, sourceId );
+	if (SUCCEEDED( hr )) {
+		hr = gAlarmKpis.SourceAdded( areaId, sourceId );
+	}
+	return hr;
+}
+
+static HRESULT DefineCondition( int sourceId, int conditionDefinitionId, int conditionId )
+{
+	HRESULT hr = AddCondition( sourceId, conditionDefinitionId, conditionId );
+	if (SUCCEEDED( hr )) {
+		hr = gAlarmKpis.ConditionAdded( sourceId, conditionId );
+	}
+	return hr;
+}
 
-	AeConditionState cs; 
+//-----------------------------------------------------------------------------
+// PublishSimpleEvent / PublishTrackingEvent							 SAMPLE
+// -----------------------------------------
+//    Pass the events through the suppression stage before they are
+//    processed by the generic server. Events folded into a duplicate or
+//    exceeding the rate limit of their source are not processed and
+//    S_FALSE is returned.
+//
+//    For categories with a repeat count attribute the number of
+//    occurrences the event represents is appended to the attribute values
+//    in a pooled array of the category. The processed events are recorded
+//    in the journal with these attribute values.
+//-----------------------------------------------------------------------------
+static HRESULT PublishEvent(
+	bool       fTracking,
+	int        categoryId,
+	int        sourceId,
+	LPWSTR     message,
+	int        severity,
+	LPWSTR     actorId,
+	int        attributeCount,
+	LPVARIANT  attributeValues,
+	LPFILETIME timeStamp )
+{
+	bool  fRepeatCount;
+	DWORD dwCount = gEventSuppressor.Admit( sourceId, categoryId, message, severity, &fRepeatCount );
+	if (dwCount == 0) {
+		return S_FALSE;                          // suppressed
+	}
 
-	cs.CondID() = CONDID_TANK_1_OVERFLOW;
-	cs.SubCondID() = 0;
-	cs.ActiveState() = false;
-	cs.Quality() = OPC_QUALITY_GOOD;
-	cs.AttrCount() = 1;
-	cs.AttrValuesPtr() = devfailattrs;
+	LPVARIANT attrs = NULL;
+	if (fRepeatCount) {
+		DWORD dwAttrCount;
+		attrs = gEventAttributes.Acquire( categoryId, &dwAttrCount );
+		if (attrs == NULL) {
+			return E_OUTOFMEMORY;
+		}
+		if (dwAttrCount <= (DWORD)attributeCount) {
+			gEventAttributes.Release( categoryId, attrs );
+			return E_INVALIDARG;
+		}
+		for (int i = 0; i < attributeCount; ++i) {
+			attrs[i] = attributeValues[i];       // shallow copy, the values remain owned by the caller
+		}
+		V_VT( &attrs[attributeCount] ) = VT_I4;
+		V_I4( &attrs[attributeCount] ) = (long)dwCount;
+		attributeValues = attrs;
+		attributeCount++;
+	}
 
-	if (fActive) {
-		fActive = FALSE;
-		cs.Message() = L"Normal State";           // Own message
-		devfailattrs[0] = (long)80;               // Current Value
+	HRESULT hr;
+	if (fTracking) {
+		hr = ProcessTrackingEvent( categoryId, sourceId, message, severity, actorId, attributeCount, attributeValues, timeStamp );
 	}
 	else {
-		fActive = TRUE;
-		cs.Message() = L"Overflow";               // Own message
-		devfailattrs[0] = (long)123;              // Current Value
+		hr = ProcessSimpleEvent( categoryId, sourceId, message, severity, attributeCount, attributeValues, timeStamp );
+	}
+	if (SUCCEEDED( hr )) {
+		gEventJournal.Append( fTracking, categoryId, sourceId, message, severity, actorId,
+							  attributeCount, attributeValues, timeStamp );
 	}
-	cs.ActiveState() = fActive;                  // Set current active state
-	// Process the new state
-    ProcessConditionStateChanges( 1, &cs );
+	gEventAttributes.Release( categoryId, attrs );
+	return hr;
 }
 
+static HRESULT PublishSimpleEvent( int categoryId, int sourceId, LPWSTR message, int severity,
+								   int attributeCount, LPVARIANT attributeValues, LPFILETIME timeStamp )
+{
+	return PublishEvent( false, categoryId, sourceId, message, severity, NULL, attributeCount, attributeValues, timeStamp );
+}
 
+static HRESULT PublishTrackingEvent( int categoryId, int sourceId, LPWSTR message, int severity, LPWSTR actorId,
+									 int attributeCount, LPVARIANT attributeValues, LPFILETIME timeStamp )
+{
+	return PublishEvent( true, categoryId, sourceId, message, severity, actorId, attributeCount, attributeValues, timeStamp );
+}
 
 //-----------------------------------------------------------------------------
-// ToggleRampCond														 SAMPLE
-// --------------
-//    Each call of this function changes the active sub condition
-//    of the condition specified by ID CONDID_WATER_LEVEL.
-//    This function also sets the required attribute values.
-//    If the ID of the active sub condition is SUBCONDDEFID_HI_RAMP then
-//    an own acknowledge resuest flag is used instead of the default flag.
+// PublishSuppressionSummaries											 SAMPLE
+// ---------------------------
+//    Reports the events which were not processed with a CATID_SUPPRESSION
+//    event of the source once its suppression ended. The summaries are
+//    processed without passing the suppression stage, so they are neither
+//    suppressed themselves nor counted for their source, and are recorded
+//    in the journal.
 //-----------------------------------------------------------------------------
-static void ToggleRampCond()
+static void PublishSuppressionSummaries()
 {
-	static long lVal = 50;
-	_variant_t  devfailattrs[1];
+	std::vector<SuppressionSummary> summaries;
+	gEventSuppressor.Collect( summaries );
+
+	for (size_t i = 0; i < summaries.size(); ++i) {
+		const SuppressionSummary& summary = summaries[i];
+		WCHAR       message[256];
+		_variant_t  attrs[3];
+		FILETIME    TimeStamp;
+		int         length = 0;
+
+		// The text describes the events which were not forwarded
+		if (summary.dwDropped > 0) {
+			length = swprintf_s( message, 256, L"%u events suppressed, last '%.80s'",
+								 summary.dwDropped, summary.droppedMessage.c_str() );
+		}
+		if (summary.dwRepeated > 0) {
+			swprintf_s( message + length, 256 - length, L"%s%u repetitions of '%.80s'",
+						(length > 0) ? L"; " : L"", summary.dwRepeated, summary.repeatedMessage.c_str() );
+		}
+		attrs[0] = (long)summary.categoryId;     // Category
+		attrs[1] = (long)summary.dwDropped;      // Suppressed Events
+		attrs[2] = (long)summary.dwRepeated;     // Repeated Events
+		CoFileTimeNow( &TimeStamp );
+		HRESULT hr = ProcessSimpleEvent( CATID_SUPPRESSION, summary.sourceId, message, summary.dwSeverity, 3, attrs, &TimeStamp );
+		if (SUCCEEDED( hr )) {
+			gEventJournal.Append( false, CATID_SUPPRESSION, summary.sourceId, message, summary.dwSeverity, NULL,
+								  3, attrs, &TimeStamp );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// DeviceAckTarget														 SAMPLE
+// ---------------
+//    Writes the acknowledgements of the conditions to the controllers of
+//    the simulated device. The conditions are distributed over the
+//    controllers by their ID. Acknowledgements which could not be written
+//    are reported with a system message.
+//-----------------------------------------------------------------------------
+class DeviceAckTarget : public AckTarget
+{
+public:
+	virtual DWORD GetDevice( DWORD dwConditionId )
+	{
+		return 1 + dwConditionId % DEVICE_CONTROLLERS;
+	}
+
+	virtual HRESULT WriteAcks( DWORD dwDevice, DWORD dwCount, const AckRequest* acks, HRESULT* results )
+	{
+		std::vector<DWORD> conditionIds;
+		try {
+			conditionIds.resize( dwCount );
+		}
+		catch (...) {
+			return E_OUTOFMEMORY;
+		}
+		for (DWORD i = 0; i < dwCount; ++i) {
+			conditionIds[i] = acks[i].dwConditionId;
+		}
+		return gSimulatedDevice.WriteAcknowledgements( dwDevice, dwCount, &conditionIds[0], results );
+	}
+
+	virtual void OnAckFailed( const AckRequest& ack, HRESULT hrError )
+	{
+		WCHAR    message[128];
+		FILETIME TimeStamp;
+
+		swprintf_s( message, 128, L"Acknowledgement of condition %u failed (0x%08X)",
+					ack.dwConditionId, (unsigned)hrError );
+		CoFileTimeNow( &TimeStamp );
+		PublishSimpleEvent( CATID_SYSMESSAGE, SRCID_SYSTEM, message, 800, 0, NULL, &TimeStamp );
+	}
+};
+
+DeviceAckTarget gDeviceAckTarget;
+
+// Acknowledgements written to the device by a thread of its own
+AckPipeline gAckPipeline( &gDeviceAckTarget, ACK_BATCH_SIZE, ACK_MAX_ATTEMPTS, ACK_RETRY_DELAY );
+
 
-	AeConditionState cs; 
+//-----------------------------------------------------------------------------
+// ReplayEvents															 SAMPLE
+// ------------
+//    Processes the events of the last minutes requested with
+//    Commands.ReplayEvents again with their original time stamps, e.g. for
+//    clients which reconnected or for a sequence of events analysis. The
+//    journal only holds the events which were processed, with their
+//    repeat counts, so suppressed events are not replayed.
+//
+//    The message of a replayed event starts with REPLAY_MESSAGE_PREFIX,
+//    so clients can tell it from the original. The replayed events bypass
+//    the suppression stage and are not recorded again.
+//-----------------------------------------------------------------------------
+#define REPLAY_MESSAGE_PREFIX   L"[Replay] "
 
-	cs.CondID() = CONDID_WATER_LEVEL;
-	cs.SubCondID() = 0;
-	cs.ActiveState() = true;
-	cs.Quality() = OPC_QUALITY_GOOD;
-	cs.AttrCount() = 1;
-	cs.AttrValuesPtr() = devfailattrs;
+class ClientReplay : public JournalReader
+{
+public:
+	virtual bool OnEvent( const JournalEvent& ev )
+	{
+		FILETIME TimeStamp = ev.timeStamp;
+		try {
+			m_message  = REPLAY_MESSAGE_PREFIX;
+			m_message += ev.message;
+		}
+		catch (...) {
+			return false;                        // not enough memory, stop the replay
+		}
+		if (ev.fTracking) {
+			ProcessTrackingEvent( ev.categoryId, ev.sourceId, (LPWSTR)m_message.c_str(), ev.dwSeverity,
+								  (LPWSTR)ev.actorId, ev.dwAttrCount, ev.attributes, &TimeStamp );
+		}
+		else {
+			ProcessSimpleEvent( ev.categoryId, ev.sourceId, (LPWSTR)m_message.c_str(), ev.dwSeverity,
+								ev.dwAttrCount, ev.attributes, &TimeStamp );
+		}
+		return true;
+	}
+
+protected:
+	std::wstring m_message;                      // reused for all events
+};
 
-	switch (lVal) {
-		case 10: lVal = 20;  cs.SubCondID() = SUBCONDDEFID_LO_RAMP;       
-			break;
-		case 20: lVal = 50;  cs.ActiveState() = FALSE;                    
-			break;
-		case 50: lVal = 80;  cs.SubCondID() = SUBCONDDEFID_HI_RAMP;
-			{ BOOL f = TRUE; cs.AckRequiredPtr() = &f; } 
-			break;
-		case 80: lVal = 90;  cs.SubCondID() = SUBCONDDEFID_HI_HI_RAMP;    
-			break;
-		case 90: lVal = 10;  cs.SubCondID() = SUBCONDDEFID_LO_LO_RAMP;    
-			break;
+static void ReplayEvents()
+{
+	LONG lMinutes = InterlockedExchange( &gReplayMinutes, 0 );
+	if (lMinutes <= 0) {
+		return;
 	}
-	devfailattrs[0] = (long)lVal;                // Set required attribute
 
-    ProcessConditionStateChanges( 1, &cs );
+	FILETIME       to;
+	ULARGE_INTEGER from;
+	CoFileTimeNow( &to );
+	from.LowPart   = to.dwLowDateTime;
+	from.HighPart  = to.dwHighDateTime;
+	ULONGLONG period = (ULONGLONG)lMinutes * 60 * 10000000;  // 100 ns units
+	from.QuadPart = (from.QuadPart > period) ? from.QuadPart - period : 0;
+
+	FILETIME fromTime;
+	fromTime.dwLowDateTime  = from.LowPart;
+	fromTime.dwHighDateTime = from.HighPart;
+
+	ClientReplay replay;
+	gEventJournal.Replay( fromTime, to, JOURNAL_ALL_SOURCES, &replay );
 }
 
 
@@ -361,7 +863,7 @@ public:
 			devfailattrs[0]   = (long)55;          // Current Value
 		}
 
-        ProcessConditionStateChanges( 1, &cs );
+		PublishConditionState( cs );
 	}
 
 protected:
@@ -390,7 +892,6 @@ unsigned __stdcall RefreshThread( LPVOID pAttr )
 	VARIANT     Value;
 
 	DWORD          dwCount = 0;                  // Counter for simulation
-	_variant_t     devfailattrs[2];
 	Heating1Condition  condHeating1;
 
 	// Keep this thread running until the Terminate Event is received
@@ -401,7 +902,7 @@ unsigned __stdcall RefreshThread( LPVOID pAttr )
 			V_I4(&Value) = gNumberItems;
 			V_VT(&Value) = VT_I4;
 
-			SetItemValue(gDeviceItem_NumberItems, &Value, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
+			PublishItemValue(gDeviceItem_NumberItems, &Value, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
 		}
 
 		if (gServerState == ServerState::Running) {
@@ -438,33 +939,69 @@ unsigned __stdcall RefreshThread( LPVOID pAttr )
 
 		++dwCount;
 
-		if ((dwCount % 2) == 0) ToggleTank1Cond();// every 2s
-		if ((dwCount % 3) == 0) ToggleRampCond(); // every 3s
 		if ((dwCount % 5) == 0) {                 // every 5s
 			condHeating1.ToggleCondition();  
 		}
 		if ((dwCount % 120) == 0) {               // every 2 min.
-			devfailattrs[0] = (long)WSAENETDOWN;                        // Error Code
-			devfailattrs[1] = L"3Com EtherLink XL NIC (3C900B-COMBO)";  // Device Name
-			ProcessSimpleEvent( CATID_DEVFAILURE, SRCID_NETADAPT, L"No response", 800, 2, devfailattrs, &TimeStamp );
+			LPVARIANT devfailattrs = gEventAttributes.Acquire( CATID_DEVFAILURE, NULL );
+			if (devfailattrs != NULL) {
+				V_VT( &devfailattrs[0] )   = VT_I4;
+				V_I4( &devfailattrs[0] )   = WSAENETDOWN;                                                   // Error Code
+				V_VT( &devfailattrs[1] )   = VT_BSTR;
+				V_BSTR( &devfailattrs[1] ) = gEventAttributes.Intern( L"3Com EtherLink XL NIC (3C900B-COMBO)" );  // Device Name
+				PublishSimpleEvent( CATID_DEVFAILURE, SRCID_NETADAPT, L"No response", 800, 2, devfailattrs, &TimeStamp );
+				gEventAttributes.Release( CATID_DEVFAILURE, devfailattrs );
+			}
 		}
 
 		// update server cache for this item
 		V_I4( &Value ) = gDataSimulation.RampValue();
 		V_VT( &Value ) = VT_I4;                 
 
-			SetItemValue(gDeviceItem_SimRamp, &Value, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
+			PublishItemValue(gDeviceItem_SimRamp, &Value, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
 
 		V_R8( &Value ) = gDataSimulation.SineValue();
 		V_VT( &Value ) = VT_R8;                 
 
-			SetItemValue(gDeviceItem_SimSine, &Value, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
+			PublishItemValue(gDeviceItem_SimSine, &Value, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
 
 		V_I4( &Value ) = gDataSimulation.RandomValue();
 		V_VT( &Value ) = VT_I4;                 
 
-			SetItemValue(gDeviceItem_SimRandom, &Value, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
+			PublishItemValue(gDeviceItem_SimRandom, &Value, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
+
+		V_I4( &Value ) = gDataSimulation.Tank1LevelValue();
+		V_VT( &Value ) = VT_I4;                 
+
+			PublishItemValue(gDeviceItem_SimTank1Level, &Value, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
+
+		// check the limits of the multi-state conditions
+		EvaluateLimitConditions();
 
+		// process the condition state changes of this cycle and save them
+		gConditionStates.Flush();
+		gConditionSnapshot.Save();
+		PublishAlarmKpis( TimeStamp );
+
+		// report the events suppressed during a flood once it ended
+		PublishSuppressionSummaries();
+
+		// replay the journal if requested and write it to disk
+		ReplayEvents();
+		gEventJournal.Flush();
+
+		// acquire the values of the device items used by clients
+		PollDeviceItems();
+
+		// reload expired branches of the device address space
+		gBrowseIndex.RefreshBranches( 4 );
+
+		// read expired device properties
+		gPropertyStore.RefreshProperties( 4 );
+
+		if ((dwCount % 10) == 0) {                // every 10s
+			RemoveIdleItems();
+		}
 		}
 
 		if (WaitForSingleObject( m_hTerminateThreadsEvent,
@@ -508,6 +1045,9 @@ HRESULT KillThreads(void)
 		CloseHandle(m_hUpdateThread);
 		m_hUpdateThread = NULL;
 	}
+	gAckPipeline.Stop();
+	gEventJournal.Close();
+	gConditionSnapshot.Save();
 
 	CloseHandle(m_hTerminateThreadsEvent);
 	m_hTerminateThreadsEvent = NULL;
@@ -646,6 +1186,504 @@ static void CreateSampleVariant(
 }
 
 
+//-----------------------------------------------------------------------------
+// CreateServerItem / CreateAnalogServerItem							 SAMPLE
+// -----------------------------------------
+//    Adds an item to the generic server cache and registers it in the
+//    browse index used if SAMPLE_BROWSE_MODE is DaBrowseMode::Custom.
+//-----------------------------------------------------------------------------
+static HRESULT CreateServerItem(
+	LPWSTR         itemId,
+	DaAccessRights accessRights,
+	LPVARIANT      initValue,
+	void**         deviceItem )
+{
+	HRESULT hr = AddItem( itemId, accessRights, initValue, deviceItem );
+	if (SUCCEEDED( hr )) {
+		hr = gBrowseIndex.AddItem( itemId, V_VT( initValue ), accessRights );
+	}
+	return hr;
+}
+
+static HRESULT CreateAnalogServerItem(
+	LPWSTR         itemId,
+	DaAccessRights accessRights,
+	LPVARIANT      initValue,
+	double         minValue,
+	double         maxValue,
+	void**         deviceItem )
+{
+	HRESULT hr = AddAnalogItem( itemId, accessRights, initValue, minValue, maxValue, deviceItem );
+	if (SUCCEEDED( hr )) {
+		hr = gBrowseIndex.AddItem( itemId, V_VT( initValue ), accessRights );
+	}
+	return hr;
+}
+
+
+//-----------------------------------------------------------------------------
+// CreateDeviceItems / RefreshDeviceItems								 SAMPLE
+// ---------------------------------------
+//    Access to the dynamic items of the simulated device. The data words
+//    are read as VT_I2 and converted to the data type requested by the
+//    client when the item was created.
+//-----------------------------------------------------------------------------
+static HRESULT ConvertDeviceValue( SHORT value, VARTYPE dataType, LPVARIANT pvVal )
+{
+	V_VT( pvVal ) = VT_I2;
+	V_I2( pvVal ) = value;
+	return VariantChangeType( pvVal, pvVal, 0, dataType );
+}
+
+static DWORD EstimateItemSize( LPCWSTR itemId )
+{
+	return DYNAMIC_ITEM_OVERHEAD + (DWORD)((wcslen( itemId ) + 1) * sizeof( WCHAR ));
+}
+
+static ULONGLONG AddressKey( const DeviceAddress& address )
+{
+	return ((ULONGLONG)address.dwController << 48) | ((ULONGLONG)address.dwDataBlock << 32) | address.dwOffset;
+}
+
+// Data word resolved by pattern which is added to the cache
+struct PendingDeviceItem
+{
+	std::wstring   itemId;
+	DeviceAddress  address;
+	DaAccessRights accessRights;
+	bool           fRequested;                   // false if prefetched
+};
+
+static void SetPendingDeviceItem( LPCWSTR itemId, const ResolvedItem& resolved, PendingDeviceItem& item )
+{
+	item.itemId               = itemId;
+	item.address.dwController = resolved.fields[0];
+	item.address.dwDataBlock  = resolved.fields[1];
+	item.address.dwOffset     = resolved.fields[2];
+	item.address.dataType     = resolved.dataType;
+	item.accessRights         = resolved.accessRights;
+	item.fRequested           = true;
+}
+
+typedef std::map<ULONGLONG, size_t> PendingAddressMap;   // index in the pending list by AddressKey()
+
+// Appends the item to the pending list unless its address is already in
+// the list. A requested item replaces a prefetched item of the same
+// address, so the data type requested by the client is used.
+static void AddPendingItem( const PendingDeviceItem& item, std::vector<PendingDeviceItem>& pending,
+							PendingAddressMap& pendingAddresses )
+{
+	PendingAddressMap::iterator it = pendingAddresses.find( AddressKey( item.address ) );
+	if (it == pendingAddresses.end()) {
+		pending.push_back( item );
+		try {
+			pendingAddresses.insert( std::make_pair( AddressKey( item.address ), pending.size() - 1 ) );
+		}
+		catch (...) {
+			pending.pop_back();
+			throw;
+		}
+	}
+	else if (item.fRequested && !pending[it->second].fRequested) {
+		pending[it->second] = item;
+	}
+}
+
+// Appends the data words following the requested address which are
+// selected by the Prefetcher and neither in the cache nor in the pending
+// list.
+static void AddPrefetchItems( DeviceAddress address, std::vector<PendingDeviceItem>& pending,
+							  PendingAddressMap& pendingAddresses )
+{
+	DWORD dwCount   = gPrefetcher.OnRequest( AddressKey( address ) >> 32, address.dwOffset, DATAWORD_STRIDE );
+	DWORD fields[3] = { address.dwController, address.dwDataBlock, 0 };
+
+	for (DWORD i = 1; i <= dwCount; i++) {
+		std::wstring      itemId;
+		ResolvedItem      resolved;
+		PendingDeviceItem item;
+
+		address.dwOffset += DATAWORD_STRIDE;
+		fields[2]         = address.dwOffset;
+		if (FAILED( gItemResolver.FormatItemId( PATTERNID_DATAWORD, 3, fields, itemId ) )) {
+			break;                               // end of the data block
+		}
+
+		AcquireSRWLockShared( &gDeviceItemsLock );
+		bool fExists = (gDeviceAddresses.find( AddressKey( address ) ) != gDeviceAddresses.end());
+		ReleaseSRWLockShared( &gDeviceItemsLock );
+		if (fExists || pendingAddresses.find( AddressKey( address ) ) != pendingAddresses.end() ||
+			gNegativeCache.Contains( itemId.c_str() ) ||
+			gItemResolver.Resolve( itemId.c_str(), VT_EMPTY, &resolved ) != S_OK) {
+			continue;
+		}
+
+		SetPendingDeviceItem( itemId.c_str(), resolved, item );
+		item.fRequested = false;
+		AddPendingItem( item, pending, pendingAddresses );
+	}
+}
+
+// Adds the item to the cache unless an item with this address exists or is
+// being added by another thread; S_FALSE is returned in this case.
+static HRESULT AddDeviceItem( PendingDeviceItem& item, SHORT value, const FILETIME& TimeStamp )
+{
+	VARIANT   varVal;
+	void*     deviceItem;
+	ULONGLONG key = AddressKey( item.address );
+	HRESULT   hr  = S_OK;
+
+	AcquireSRWLockExclusive( &gDeviceItemsLock );
+	try {
+		if (!gDeviceAddresses.insert( std::make_pair( key, (void*)NULL ) ).second) {
+			hr = S_FALSE;
+		}
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+	ReleaseSRWLockExclusive( &gDeviceItemsLock );
+	if (hr != S_OK) {
+		return hr;
+	}
+
+	VariantInit( &varVal );
+	hr = ConvertDeviceValue( value, item.address.dataType, &varVal );
+	if (SUCCEEDED( hr )) {
+		hr = AddItem( &item.itemId[0], item.accessRights, &varVal, &deviceItem );
+	}
+
+	AcquireSRWLockExclusive( &gDeviceItemsLock );
+	if (SUCCEEDED( hr )) {
+		try {
+			gDeviceItems[deviceItem] = item.address;
+			gDeviceAddresses[key]    = deviceItem;
+		}
+		catch (...) {
+			hr = E_OUTOFMEMORY;
+		}
+	}
+	else {
+		gDeviceAddresses.erase( key );
+	}
+	ReleaseSRWLockExclusive( &gDeviceItemsLock );
+
+	if (SUCCEEDED( hr )) {
+		PublishItemValue( deviceItem, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp );
+		gSubscriptions.Register( deviceItem );
+		gIdleItems.Register( deviceItem, EstimateItemSize( item.itemId.c_str() ) );
+		if (gDeviceProperties != NULL) {
+			gPropertyStore.Assign( deviceItem, gDeviceProperties );
+		}
+		InterlockedIncrement( &gNumberItems );
+	}
+	VariantClear( &varVal );
+	return hr;
+}
+
+// Adds the resolved data words with one device request per data block
+// for the initial values. Items rejected by the device are remembered in
+// the negative cache. Returns the number of requested items which are in
+// the cache now.
+static DWORD CreateDeviceItems( std::vector<PendingDeviceItem>& items )
+{
+	typedef std::pair<DWORD, DWORD> BlockId;
+
+	DWORD dwAdded = 0;
+
+	try {
+		std::map<BlockId, std::vector<size_t>> blocks;
+		for (size_t i = 0; i < items.size(); i++) {
+			BlockId id( items[i].address.dwController, items[i].address.dwDataBlock );
+			blocks[id].push_back( i );
+		}
+
+		FILETIME TimeStamp;
+		CoFileTimeNow( &TimeStamp );
+
+		std::map<BlockId, std::vector<size_t>>::const_iterator block;
+		for (block = blocks.begin(); block != blocks.end(); ++block) {
+			const std::vector<size_t>& indexes = block->second;
+			std::vector<DWORD> offsets( indexes.size() );
+			std::vector<SHORT> values( indexes.size() );
+
+			for (size_t i = 0; i < indexes.size(); i++) {
+				offsets[i] = items[indexes[i]].address.dwOffset;
+			}
+			HRESULT hr = gSimulatedDevice.ReadDataWords( block->first.first, block->first.second,
+														 (DWORD)indexes.size(), &offsets[0], &values[0] );
+			for (size_t i = 0; i < indexes.size(); i++) {
+				PendingDeviceItem& item = items[indexes[i]];
+				if (FAILED( hr )) {
+					gNegativeCache.Add( item.itemId.c_str() );
+				}
+				else if (SUCCEEDED( AddDeviceItem( item, values[i], TimeStamp ) ) && item.fRequested) {
+					dwAdded++;
+				}
+			}
+		}
+	}
+	catch (...) {
+		// not enough memory, the remaining items are requested again
+	}
+	return dwAdded;
+}
+
+// Updates the cache values of the dynamic items in the list with one
+// device request per data block. Other items are ignored.
+static void RefreshDeviceItems( int numItems, void** deviceItems )
+{
+	typedef std::pair<DWORD, DWORD>                     BlockId;
+	typedef std::vector<std::pair<void*, DeviceAddress>> BlockItems;
+
+	try {
+		std::map<BlockId, BlockItems> blocks;
+
+		AcquireSRWLockShared( &gDeviceItemsLock );
+		for (int i = 0; i < numItems; i++) {
+			std::map<void*, DeviceAddress>::const_iterator it = gDeviceItems.find( deviceItems[i] );
+			if (it != gDeviceItems.end()) {
+				BlockId id( it->second.dwController, it->second.dwDataBlock );
+				blocks[id].push_back( *it );
+			}
+		}
+		ReleaseSRWLockShared( &gDeviceItemsLock );
+
+		FILETIME TimeStamp;
+		CoFileTimeNow( &TimeStamp );
+
+		std::map<BlockId, BlockItems>::const_iterator block;
+		for (block = blocks.begin(); block != blocks.end(); ++block) {
+			const BlockItems&  items = block->second;
+			std::vector<DWORD> offsets( items.size() );
+			std::vector<SHORT> values( items.size() );
+
+			for (size_t i = 0; i < items.size(); i++) {
+				offsets[i] = items[i].second.dwOffset;
+			}
+			HRESULT hr = gSimulatedDevice.ReadDataWords( block->first.first, block->first.second,
+														 (DWORD)items.size(), &offsets[0], &values[0] );
+			for (size_t i = 0; i < items.size(); i++) {
+				VARIANT varVal;
+				VariantInit( &varVal );
+				if (SUCCEEDED( hr ) && SUCCEEDED( ConvertDeviceValue( values[i], items[i].second.dataType, &varVal ) )) {
+					PublishItemValue( items[i].first, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp );
+				}
+				else {
+					PublishItemValue( items[i].first, &varVal, OPC_QUALITY_BAD, TimeStamp );
+				}
+				VariantClear( &varVal );
+			}
+		}
+	}
+	catch (...) {
+		// not enough memory, the cache keeps the last values
+	}
+}
+
+//-----------------------------------------------------------------------------
+// PollDeviceItems														 SAMPLE
+// ---------------
+//    Updates the cache values of the subscribed dynamic items. Items not
+//    used by any client are not read from the device.
+//-----------------------------------------------------------------------------
+static void PollDeviceItems()
+{
+	std::vector<void*> deviceItems;
+
+	gSubscriptions.GetSubscribedItems( deviceItems );
+	if (!deviceItems.empty()) {
+		RefreshDeviceItems( (int)deviceItems.size(), &deviceItems[0] );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// RemoveIdleItems														 SAMPLE
+// ---------------
+//    Removes the dynamic items no longer used by any client from the
+//    server's cache. They are added again by OnRequestItems when a client
+//    accesses them later.
+//-----------------------------------------------------------------------------
+static void RemoveIdleItems()
+{
+	int    numItems    = 0;
+	void** deviceItems = NULL;
+
+	// OnAddItem / OnRemoveItem may have been missed while the items were
+	// added, the list of the generic server is authoritative
+	GetActiveItems( &numItems, &deviceItems );
+	if (numItems >= 0) {
+		gSubscriptions.SetActiveItems( numItems, deviceItems );
+		gIdleItems.SetActiveItems( numItems, deviceItems );
+	}
+	if (deviceItems != NULL) {
+		delete deviceItems;
+	}
+
+	std::vector<void*> idleItems;
+	try {
+		gIdleItems.SelectIdleItems( idleItems );
+	}
+	catch (...) {
+	}
+
+	for (size_t i = 0; i < idleItems.size(); i++) {
+		HRESULT hrRemove = RemoveItem( idleItems[i] );
+		gSubscriptions.Unregister( idleItems[i] );
+		gPropertyStore.Remove( idleItems[i] );
+
+		// Data words are counted once they are erased, the other items of
+		// browsed branches are not in gDeviceItems
+		bool fRemoved;
+		AcquireSRWLockExclusive( &gDeviceItemsLock );
+		std::map<void*, DeviceAddress>::iterator it = gDeviceItems.find( idleItems[i] );
+		if (it != gDeviceItems.end()) {
+			gDeviceAddresses.erase( AddressKey( it->second ) );
+			gDeviceItems.erase( it );
+			fRemoved = true;
+		}
+		else {
+			fRemoved = SUCCEEDED( hrRemove );
+		}
+		ReleaseSRWLockExclusive( &gDeviceItemsLock );
+		if (fRemoved) {
+			InterlockedDecrement( &gNumberItems );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// GetPluginFilePath													 SAMPLE
+// -----------------
+//    Returns the path of a file in the directory of the plug-in.
+//-----------------------------------------------------------------------------
+static HRESULT GetPluginFilePath( LPCWSTR fileName, LPWSTR path, DWORD dwSize )
+{
+	HMODULE hModule;
+
+	if (!GetModuleHandleEx( GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+							(LPCWSTR)&GetPluginFilePath, &hModule ) ||
+		GetModuleFileName( hModule, path, dwSize ) == 0) {
+		return HRESULT_FROM_WIN32( GetLastError() );
+	}
+
+	LPWSTR name = wcsrchr( path, L'\\' );
+	name = (name != NULL) ? name + 1 : path;
+	if (wcscpy_s( name, dwSize - (name - path), fileName ) != 0) {
+		return E_FAIL;
+	}
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// PublishSystemMessage													 SAMPLE
+// --------------------
+//    Reports an error the server continues with as event of the system
+//    source.
+//-----------------------------------------------------------------------------
+static void PublishSystemMessage( LPCWSTR text, HRESULT hrError )
+{
+	WCHAR    message[256];
+	FILETIME TimeStamp;
+
+	swprintf_s( message, 256, L"%.200s (0x%08X)", text, (unsigned)hrError );
+	CoFileTimeNow( &TimeStamp );
+	PublishSimpleEvent( CATID_SYSMESSAGE, SRCID_SYSTEM, message, 800, 0, NULL, &TimeStamp );
+}
+
+
+//-----------------------------------------------------------------------------
+// LoadAeHierarchy														 SAMPLE
+// ---------------
+//    Registers the areas, sources and conditions defined in the file
+//    AE_HIERARCHY_FILE in the directory of the plug-in. The file is
+//    optional; sites with many sources define their AE space there instead
+//    of adding each element in the ConfigThread. See AeHierarchyLoader.h
+//    for the format.
+//
+//    Errors are reported with a system message naming the line of the
+//    file; the server starts with the elements registered until then.
+//-----------------------------------------------------------------------------
+static void LoadAeHierarchy()
+{
+	WCHAR   path[MAX_PATH];
+	HRESULT hr = GetPluginFilePath( AE_HIERARCHY_FILE, path, MAX_PATH );
+	if (FAILED( hr )) {
+		PublishSystemMessage( L"AE hierarchy file not loaded", hr );
+		return;
+	}
+
+	AeHierarchyLoader loader( AREAID_ROOT );
+	hr = loader.LoadFile( path );
+	if (hr == HRESULT_FROM_WIN32( ERROR_FILE_NOT_FOUND )) {
+		return;                                  // no further definitions
+	}
+	if (SUCCEEDED( hr )) {
+		hr = loader.Register( &gAlarmKpis );
+	}
+	if (FAILED( hr )) {
+		WCHAR text[128];
+		if (loader.ErrorLine() > 0) {
+			swprintf_s( text, 128, L"AE hierarchy file not loaded, error in line %u", loader.ErrorLine() );
+		}
+		else {
+			swprintf_s( text, 128, L"AE hierarchy file not loaded" );
+		}
+		PublishSystemMessage( text, hr );
+	}
+}
+
+
+// Conditions of the snapshot no longer defined are not restored
+static bool IsDefinedCondition( DWORD dwConditionId )
+{
+	return gAlarmKpis.HasCondition( dwConditionId );
+}
+
+//-----------------------------------------------------------------------------
+// RestoreConditionStates												 SAMPLE
+// ----------------------
+//    Restores the conditions which were active or not acknowledged when
+//    the server stopped from CONDITION_SNAPSHOT_FILE in the directory of
+//    the plug-in. All states are processed at once before the update
+//    cycles start; the acknowledgements are confirmed by the AckPipeline.
+//    The limit conditions continue from the restored state.
+//
+//    Restoring is best effort: conditions no longer defined are skipped
+//    and an error is returned for the caller to report, the server starts
+//    anyway.
+//-----------------------------------------------------------------------------
+static HRESULT RestoreConditionStates()
+{
+	WCHAR   path[MAX_PATH];
+	HRESULT hr = GetPluginFilePath( CONDITION_SNAPSHOT_FILE, path, MAX_PATH );
+	if (FAILED( hr )) {
+		return hr;
+	}
+
+	hr = gConditionSnapshot.Load( path );
+	if (hr == HRESULT_FROM_WIN32( ERROR_FILE_NOT_FOUND ) || hr == HRESULT_FROM_WIN32( ERROR_INVALID_DATA )) {
+		return S_OK;                             // first start or damaged, nothing to restore
+	}
+
+	std::vector<RestoredCondition> restored;
+	if (SUCCEEDED( hr )) {
+		hr = gConditionSnapshot.Restore( gConditionStates, IsDefinedCondition, restored );
+	}
+	for (size_t i = 0; i < restored.size(); ++i) {
+		gConditionEngine.RestoreState( restored[i].dwConditionId, restored[i].dwSubConditionId, restored[i].fActive );
+		if (restored[i].fActive) {
+			gAlarmKpis.RestoreActive( restored[i].dwConditionId, restored[i].dwSubConditionId );
+		}
+		if (restored[i].fAcknowledged) {
+			gAckPipeline.Confirm( restored[i].dwConditionId, L"Restored after restart" );
+		}
+	}
+	return hr;
+}
+
+
 //-----------------------------------------------------------------------------
 // Config Thread														 SAMPLE
 // -------------
@@ -673,11 +1711,13 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 		// 5) Define the Process Areas (is optional)
 		// 6) Define the Event Sources
 		// 7) Define the Event Conditions
+		// 8) Load further Areas, Sources and Conditions from a file (is optional)
 
 		// 1) Define the Event Categories
 		/////////////////////////////////
 		CHECK_RESULT( AddSimpleEventCategory(   CATID_DEVFAILURE, L"Device Failure" ) )
 		CHECK_RESULT( AddSimpleEventCategory(   CATID_SYSMESSAGE, L"System Message" ) )
+		CHECK_RESULT( AddSimpleEventCategory(   CATID_SUPPRESSION, L"Event Suppression" ) )
 
 		CHECK_RESULT( AddTrackingEventCategory( CATID_SYSCONFIG,  L"System Configuration" ) )
 		CHECK_RESULT( AddTrackingEventCategory( CATID_ADVCONTROL, L"Advanced Control" ) )
@@ -687,13 +1727,21 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 
 		// 2) Add the Attributes to the Event Categories
 		////////////////////////////////////////////////
-		CHECK_RESULT( AddEventAttribute( CATID_LEVEL,      ATTRID_LEVEL_CV,               L"Current Value",   VT_I4 ) )
-		CHECK_RESULT( AddEventAttribute( CATID_DEVFAILURE, ATTRID_DEVFAILURE_ERRORCODE,   L"Error Code",      VT_I4 ) )
-		CHECK_RESULT( AddEventAttribute( CATID_DEVFAILURE, ATTRID_DEVFAILURE_DEVICENAME,  L"Device Name",     VT_BSTR ) )
-		CHECK_RESULT( AddEventAttribute( CATID_SYSCONFIG,  ATTRID_SYSCONFIG_PREVVALUE,    L"Prev Value",      VT_I4 ) )
-		CHECK_RESULT( AddEventAttribute( CATID_SYSCONFIG,  ATTRID_SYSCONFIG_NEWVALUE,     L"New Value",       VT_I4 ) )
-		CHECK_RESULT( AddEventAttribute( CATID_ADVCONTROL, ATTRID_ADVCONTROL_PREVVALUE,   L"Prev Value",      VT_I4 ) )
-		CHECK_RESULT( AddEventAttribute( CATID_ADVCONTROL, ATTRID_ADVCONTROL_NEWVALUE,    L"New Value",       VT_I4 ) )
+		CHECK_RESULT( DefineEventAttribute( CATID_LEVEL,      ATTRID_LEVEL_CV,               L"Current Value",   VT_I4 ) )
+		CHECK_RESULT( DefineEventAttribute( CATID_DEVFAILURE, ATTRID_DEVFAILURE_ERRORCODE,   L"Error Code",      VT_I4 ) )
+		CHECK_RESULT( DefineEventAttribute( CATID_DEVFAILURE, ATTRID_DEVFAILURE_DEVICENAME,  L"Device Name",     VT_BSTR ) )
+		CHECK_RESULT( DefineEventAttribute( CATID_DEVFAILURE, ATTRID_DEVFAILURE_REPEATCOUNT, L"Repeat Count",    VT_I4 ) )
+		CHECK_RESULT( DefineEventAttribute( CATID_SUPPRESSION, ATTRID_SUPPRESSION_CATEGORY,  L"Category",        VT_I4 ) )
+		CHECK_RESULT( DefineEventAttribute( CATID_SUPPRESSION, ATTRID_SUPPRESSION_DROPPED,   L"Suppressed Events", VT_I4 ) )
+		CHECK_RESULT( DefineEventAttribute( CATID_SUPPRESSION, ATTRID_SUPPRESSION_REPEATED,  L"Repeated Events", VT_I4 ) )
+		CHECK_RESULT( DefineEventAttribute( CATID_SYSCONFIG,  ATTRID_SYSCONFIG_PREVVALUE,    L"Prev Value",      VT_I4 ) )
+		CHECK_RESULT( DefineEventAttribute( CATID_SYSCONFIG,  ATTRID_SYSCONFIG_NEWVALUE,     L"New Value",       VT_I4 ) )
+		CHECK_RESULT( DefineEventAttribute( CATID_ADVCONTROL, ATTRID_ADVCONTROL_PREVVALUE,   L"Prev Value",      VT_I4 ) )
+		CHECK_RESULT( DefineEventAttribute( CATID_ADVCONTROL, ATTRID_ADVCONTROL_NEWVALUE,    L"New Value",       VT_I4 ) )
+
+		// Device failures are folded and report how often they occurred
+		EventLimit devFailureLimit = { EVENT_RATE_LIMIT, EVENT_BURST_LIMIT, EVENT_FOLD_TIME, true };
+		CHECK_RESULT( gEventSuppressor.SetLimit( CATID_DEVFAILURE, devFailureLimit ) )
 
 		// 3) Specify the Condition Definitions
 		///////////////////////////////////////
@@ -725,33 +1773,37 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 
 		// 5) Define the Process Areas
 		//////////////////////////////
-		CHECK_RESULT( AddArea( AREAID_ROOT,  AREAID_NORTH, L"PlantNorth" ) )
-		CHECK_RESULT( AddArea( AREAID_NORTH, AREAID_NORTH_DEV1, L"Device1" ) )
-		CHECK_RESULT( AddArea( AREAID_ROOT,  AREAID_SOUTH, L"PlantSouth" ) )
-		CHECK_RESULT( AddArea( AREAID_SOUTH, AREAID_SOUTH_DEV1, L"Device1" ) )
+		CHECK_RESULT( DefineArea( AREAID_ROOT,  AREAID_NORTH, L"PlantNorth" ) )
+		CHECK_RESULT( DefineArea( AREAID_NORTH, AREAID_NORTH_DEV1, L"Device1" ) )
+		CHECK_RESULT( DefineArea( AREAID_ROOT,  AREAID_SOUTH, L"PlantSouth" ) )
+		CHECK_RESULT( DefineArea( AREAID_SOUTH, AREAID_SOUTH_DEV1, L"Device1" ) )
 
 		// 6) Define the Event Sources
 		//////////////////////////////
-		CHECK_RESULT( AddSource( AREAID_ROOT, SRCID_NETADAPT, L"Network Adapter", false ) )
-		CHECK_RESULT( AddSource( AREAID_ROOT, SRCID_SERPORT, L"Serial Port", false ) )
-		CHECK_RESULT( AddSource( AREAID_ROOT, SRCID_SYSTEM, L"System", false ) )
-		CHECK_RESULT( AddSource( AREAID_NORTH_DEV1, SRCID_VALVE, L"Valve", false ) )
-		CHECK_RESULT( AddSource( AREAID_SOUTH_DEV1, SRCID_MOTOR, L"Motor", false ) )
-		CHECK_RESULT( AddSource( AREAID_ROOT, SRCID_TANK_1, L"Level Sensor Tank 1", false ) )
-		CHECK_RESULT( AddSource( AREAID_ROOT, SRCID_TANK_2, L"Level Sensor Tank 2", false ) )
-		CHECK_RESULT( AddSource( AREAID_ROOT, SRCID_HEATING_1, L"Heating 1", false ) )
-		CHECK_RESULT( AddSource( AREAID_ROOT, SRCID_HEATING_2, L"Heating 2", false ) )
-		CHECK_RESULT( AddSource( AREAID_ROOT, SRCID_MULTISRC, L"Multiple Used Source", true ) )
-		CHECK_RESULT( AddExistingSource( AREAID_NORTH_DEV1, SRCID_MULTISRC ) )
-		CHECK_RESULT( AddExistingSource( AREAID_SOUTH_DEV1, SRCID_MULTISRC ) )
+		CHECK_RESULT( DefineSource( AREAID_ROOT, SRCID_NETADAPT, L"Network Adapter", false ) )
+		CHECK_RESULT( DefineSource( AREAID_ROOT, SRCID_SERPORT, L"Serial Port", false ) )
+		CHECK_RESULT( DefineSource( AREAID_ROOT, SRCID_SYSTEM, L"System", false ) )
+		CHECK_RESULT( DefineSource( AREAID_NORTH_DEV1, SRCID_VALVE, L"Valve", false ) )
+		CHECK_RESULT( DefineSource( AREAID_SOUTH_DEV1, SRCID_MOTOR, L"Motor", false ) )
+		CHECK_RESULT( DefineSource( AREAID_ROOT, SRCID_TANK_1, L"Level Sensor Tank 1", false ) )
+		CHECK_RESULT( DefineSource( AREAID_ROOT, SRCID_TANK_2, L"Level Sensor Tank 2", false ) )
+		CHECK_RESULT( DefineSource( AREAID_ROOT, SRCID_HEATING_1, L"Heating 1", false ) )
+		CHECK_RESULT( DefineSource( AREAID_ROOT, SRCID_HEATING_2, L"Heating 2", false ) )
+		CHECK_RESULT( DefineSource( AREAID_ROOT, SRCID_MULTISRC, L"Multiple Used Source", true ) )
+		CHECK_RESULT( DefineExistingSource( AREAID_NORTH_DEV1, SRCID_MULTISRC ) )
+		CHECK_RESULT( DefineExistingSource( AREAID_SOUTH_DEV1, SRCID_MULTISRC ) )
 
 		// 7) Define the Event Conditions
 		/////////////////////////////////
-		CHECK_RESULT( AddCondition( SRCID_MULTISRC,  CONDDEFID_HILEVEL_TANK,    CONDID_TANK_1_OVERFLOW ) )
-		CHECK_RESULT( AddCondition( SRCID_TANK_2,    CONDDEFID_HILEVEL_TANK,    CONDID_TANK_2_OVERFLOW ) )
-		CHECK_RESULT( AddCondition( SRCID_HEATING_1, CONDDEFID_HILEVEL_HEATING, CONDID_HEATING_1_EXTEMP ) )
-		CHECK_RESULT( AddCondition( SRCID_HEATING_2, CONDDEFID_HILEVEL_HEATING, CONDID_HEATING_2_EXTEMP ) )
-		CHECK_RESULT( AddCondition( SRCID_TANK_1,    CONDDEFID_PVLEVEL_RAMP,    CONDID_WATER_LEVEL ) )
+		CHECK_RESULT( DefineCondition( SRCID_MULTISRC,  CONDDEFID_HILEVEL_TANK,    CONDID_TANK_1_OVERFLOW ) )
+		CHECK_RESULT( DefineCondition( SRCID_TANK_2,    CONDDEFID_HILEVEL_TANK,    CONDID_TANK_2_OVERFLOW ) )
+		CHECK_RESULT( DefineCondition( SRCID_HEATING_1, CONDDEFID_HILEVEL_HEATING, CONDID_HEATING_1_EXTEMP ) )
+		CHECK_RESULT( DefineCondition( SRCID_HEATING_2, CONDDEFID_HILEVEL_HEATING, CONDID_HEATING_2_EXTEMP ) )
+		CHECK_RESULT( DefineCondition( SRCID_TANK_1,    CONDDEFID_PVLEVEL_RAMP,    CONDID_WATER_LEVEL ) )
+
+		// 8) Load further Areas, Sources and Conditions
+		////////////////////////////////////////////////
+		LoadAeHierarchy();                         // optional, errors are reported
 	}
 	catch( HRESULT hresEx ) {
 		hr = hresEx;
@@ -816,12 +1868,12 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 		V_I4(&varVal) = 0;
 		// Create a new item and add it to the Server Address Space
 
-		CHECK_RESULT(AddItem(
+		CHECK_RESULT(CreateServerItem(
 			L"SimulatedData.NumberItems",       // ItemID
 			Readable,							// DaAccessRights
 			&varVal,									// Data Type and Initial Value
 			&gDeviceItem_NumberItems))					// It's an item with simulated data               
-		gNumberItems++;
+		InterlockedIncrement(&gNumberItems);
 
 		// SimulatedData.Ramp
 		// ---------------------------------------------------------------------
@@ -829,12 +1881,21 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 		V_I4(&varVal) = 0;
 		// Create a new item and add it to the Server Address Space
 
-		CHECK_RESULT(AddItem(
+		CHECK_RESULT(CreateServerItem(
 			L"SimulatedData.Ramp",						// ItemID
 			Readable,									// DaAccessRights
 			&varVal,									// Data Type and Initial Value
 			&gDeviceItem_SimRamp))						// It's an item with simulated data               
-		gNumberItems++;
+		InterlockedIncrement(&gNumberItems);
+
+		// The ramp is checked against the limits of the sub conditions
+		// of CONDID_WATER_LEVEL (see AddSubConditionDefinition above)
+		LimitDefinition waterLevel = {
+			{ 15, 25, 75, 85 },
+			{ SUBCONDDEFID_LO_LO_RAMP, SUBCONDDEFID_LO_RAMP, SUBCONDDEFID_HI_RAMP, SUBCONDDEFID_HI_HI_RAMP },
+			0, 0, 0										// no deadband, no delays
+		};
+		CHECK_RESULT( BindLimitCondition( CONDID_WATER_LEVEL, gDeviceItem_SimRamp, L"SimulatedData.Ramp", waterLevel ) )
 
 		// SimulatedData.Sine
 		// ---------------------------------------------------------------------
@@ -842,12 +1903,12 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 		V_R8(&varVal) = 0.0;
 		// Create a new item and add it to the Server Address Space
 
-		CHECK_RESULT(AddItem(
+		CHECK_RESULT(CreateServerItem(
 			L"SimulatedData.Sine",						// ItemID
 			Readable,									// DaAccessRights
 			&varVal,									// Data Type and Initial Value
 			&gDeviceItem_SimSine))						// It's an item with simulated data               
-		gNumberItems++;
+		InterlockedIncrement(&gNumberItems);
 
 		// SimulatedData.Random
 		// ---------------------------------------------------------------------
@@ -855,12 +1916,35 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 		V_I4(&varVal) = 0;
 		// Create a new item and add it to the Server Address Space
 
-		CHECK_RESULT(AddItem(
+		CHECK_RESULT(CreateServerItem(
 			L"SimulatedData.Random",					// ItemID
 			Readable,									// DaAccessRights
 			&varVal,			  						// Data Type and Initial Value
 			&gDeviceItem_SimRandom))					// It's an item with simulated data               
-		gNumberItems++;
+		InterlockedIncrement(&gNumberItems);
+
+		// SimulatedData.Tank1Level
+		// ---------------------------------------------------------------------
+		V_VT(&varVal) = VT_I4;							// canonical data type
+		V_I4(&varVal) = 70;
+		// Create a new item and add it to the Server Address Space
+
+		CHECK_RESULT(CreateServerItem(
+			L"SimulatedData.Tank1Level",				// ItemID
+			Readable,									// DaAccessRights
+			&varVal,									// Data Type and Initial Value
+			&gDeviceItem_SimTank1Level))				// It's an item with simulated data               
+		InterlockedIncrement(&gNumberItems);
+
+		// The level chatters around the limit of CONDID_TANK_1_OVERFLOW
+		// (level > 80). The overflow is reported when it lasted 3 seconds
+		// and ends when the level stayed at 77 or below for 5 seconds.
+		LimitDefinition tank1Overflow = {
+			{ -HUGE_VAL, -HUGE_VAL, 80, HUGE_VAL },
+			{ 0, 0, 0, 0 },								// single state condition
+			3, 3000, 5000								// deadband, on-delay, off-delay
+		};
+		CHECK_RESULT( BindLimitCondition( CONDID_TANK_1_OVERFLOW, gDeviceItem_SimTank1Level, L"SimulatedData.Tank1Level", tank1Overflow ) )
 
 		// Commands.RequestShutdown
 		// ---------------------------------------------------------------------
@@ -868,12 +1952,44 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 		V_BSTR(&varVal) = SysAllocString(L"");
 		// Create a new item and add it to the Server Address Space
 
-		CHECK_RESULT(AddItem(
+		CHECK_RESULT(CreateServerItem(
 			L"Commands.RequestShutdown",				// ItemID
 			ReadWritable,								// DaAccessRights
 			&varVal,									// Data Type and Initial Value
 			&gDeviceItem_RequestShutdownCommand))		// It's an item with simulated data               
-		gNumberItems++;
+		InterlockedIncrement(&gNumberItems);
+
+		// Commands.ReplayEvents
+		// ---------------------------------------------------------------------
+		// Minutes of journaled events to process again
+		V_VT(&varVal) = VT_I4;							// canonical data type
+		V_I4(&varVal) = 0;
+
+		CHECK_RESULT(CreateServerItem(
+			L"Commands.ReplayEvents",					// ItemID
+			ReadWritable,								// DaAccessRights
+			&varVal,									// Data Type and Initial Value
+			&gDeviceItem_ReplayEventsCommand))
+		InterlockedIncrement(&gNumberItems);
+
+		// AlarmKpis
+		// ---------------------------------------------------------------------
+		// Alarm KPIs of all areas and the bad actors, e.g.
+		// AlarmKpis.PlantNorth.AlarmRate (see AlarmKpis.h)
+		for (DWORD i = 0; i < gAlarmKpis.ItemCount(); ++i) {
+			std::wstring itemId;
+			CHECK_RESULT(gAlarmKpis.GetItemId(i, itemId))
+
+			V_VT(&varVal) = VT_I4;						// canonical data type
+			V_I4(&varVal) = 0;
+			CHECK_RESULT(CreateServerItem(
+				(LPWSTR)itemId.c_str(),					// ItemID
+				Readable,								// DaAccessRights
+				&varVal,								// Data Type and Initial Value
+				&deviceItem))
+			CHECK_RESULT(gAlarmKpis.SetItemHandle(i, deviceItem))
+			InterlockedIncrement(&gNumberItems);
+		}
 
 
 
@@ -895,19 +2011,19 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 					bstrItemID  += arItemTypes[z].pwszItemID;
 					// Create a new item and add it to the Server Address Space
 
-					CHECK_RESULT(AddItem(
+					CHECK_RESULT(CreateServerItem(
 						bstrItemID,                   // ItemID
 						arIOTypes[i].dwAccessRights,  // DaAccessRights
 						&varVal,                      // Data Type and Initial Value
 						&deviceItem));
 					CreateSampleVariant( arItemTypes[z].vt, &varVal );
 					CoFileTimeNow( &TimeStamp );
-					SetItemValue(deviceItem, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
+					PublishItemValue(deviceItem, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
 					VariantClear( &varVal);
 					z++;
 
 				}
-				gNumberItems++;
+				InterlockedIncrement(&gNumberItems);
 				i++;
 			}
 
@@ -930,18 +2046,18 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 					bstrItemID  += L"[]";
 					// Create a new item and add it to the Server Address Space
 
-					CHECK_RESULT( AddItem(
+					CHECK_RESULT( CreateServerItem(
 						bstrItemID,                   // ItemID
 						arIOTypes[i].dwAccessRights,  // DaAccessRights
 						&varVal,                      // Data Type and Initial Value
 						&deviceItem));
 						CreateSampleVariant( arItemTypes[z].vt | VT_ARRAY, &varVal );
 					CoFileTimeNow( &TimeStamp );
-					SetItemValue(deviceItem, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
+					PublishItemValue(deviceItem, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
 					VariantClear( &varVal);
 					z++;
 				}
-				gNumberItems++;
+				InterlockedIncrement(&gNumberItems);
 				i++;
 			}
 
@@ -955,7 +2071,7 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 		V_UI1( &varVal )  = 89;
 		// Create a new item and add it to the Server Address Space
 
-		CHECK_RESULT( AddAnalogItem(
+		CHECK_RESULT( CreateAnalogServerItem(
 			ITEMID_SPECIAL_EU,            // ItemID
 			ReadWritable,				   // DaAccessRights
 			&varVal,                      // Data Type and Initial Value
@@ -965,9 +2081,9 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 
 			CreateSampleVariant( VT_UI1, &varVal );
 		CoFileTimeNow( &TimeStamp );
-		SetItemValue(gItemHandle_SpecialEU, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
+		PublishItemValue(gItemHandle_SpecialEU, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
 		VariantClear( &varVal);
-		gNumberItems++;
+		InterlockedIncrement(&gNumberItems);
 
 		// SpecialItems.WithAnalogEUInfo2
 		// ---------------------------------------------------------------------
@@ -975,7 +2091,7 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 		V_UI1( &varVal )  = 21;
 		// Create a new item and add it to the Server Address Space
 
-		CHECK_RESULT( AddAnalogItem(
+		CHECK_RESULT( CreateAnalogServerItem(
 			ITEMID_SPECIAL_EU2,            // ItemID
 			ReadWritable,					// DaAccessRights
 			&varVal,						// Data Type and Initial Value
@@ -984,7 +2100,7 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 			&gItemHandle_SpecialEU2));
 		CreateSampleVariant(VT_UI1, &varVal);
 		CoFileTimeNow( &TimeStamp );
-		SetItemValue(gItemHandle_SpecialEU2, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
+		PublishItemValue(gItemHandle_SpecialEU2, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
 		VariantClear( &varVal);
 
 		// Add Custom Property Definitions to the generic server
@@ -999,23 +2115,58 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 		V_VT( &varVal )   = VT_BSTR;             // canonical data type
 		V_BSTR( &varVal )  = L"CBM";
 		AddProperty(PROPID_CASING_MANUFACTURER, L"Casing Manufacturer", &varVal);
-		gNumberItems++;
+		InterlockedIncrement(&gNumberItems);
 
 		// SpecialItems.WithVendorSpecificProperties
 		// ---------------------------------------------------------------------
 		V_VT( &varVal )   = VT_UI1;               // canonical data type
 		V_UI1(&varVal) = 111;
 		// Create a new item and add it to the Server Address Space
-		CHECK_RESULT( AddItem(
+		CHECK_RESULT( CreateServerItem(
 			ITEMID_SPECIAL_PROPERTIES,		// ItemID
 			ReadWritable,					// DaAccessRights
 			&varVal,						// Data Type and Initial Value
 			&gItemHandle_SpecialProperties));
 		CreateSampleVariant(VT_UI1, &varVal);
 		CoFileTimeNow( &TimeStamp );
-		SetItemValue(gItemHandle_SpecialProperties, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
+		PublishItemValue(gItemHandle_SpecialProperties, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
 		VariantClear( &varVal);
-		gNumberItems++;
+		InterlockedIncrement(&gNumberItems);
+
+		// Custom properties of the special items
+		// ---------------------------------------------------------------------
+		PropertySet* casingProperties = gPropertyStore.CreateSet();
+		CHECK_PTR(casingProperties);
+		_variant_t material(L"Aluminum"), height(25.45), manufacturer(L"CBM");
+		CHECK_RESULT(casingProperties->Add(PROPID_CASING_MATERIAL, &material));
+		CHECK_RESULT(casingProperties->Add(PROPID_CASING_HEIGHT, &height));
+		CHECK_RESULT(casingProperties->Add(PROPID_CASING_MANUFACTURER, &manufacturer));
+		CHECK_RESULT(gPropertyStore.Assign(gItemHandle_SpecialProperties, casingProperties));
+
+		// The EU limits of analog items are supplied by the generic server
+		PropertySet* euProperties = gPropertyStore.CreateSet();
+		CHECK_PTR(euProperties);
+		CHECK_RESULT(euProperties->Add(OPC_PROPERTY_HIGH_EU, NULL));
+		CHECK_RESULT(euProperties->Add(OPC_PROPERTY_LOW_EU, NULL));
+		CHECK_RESULT(gPropertyStore.Assign(gItemHandle_SpecialEU, euProperties));
+		CHECK_RESULT(gPropertyStore.Assign(gItemHandle_SpecialEU2, euProperties));
+
+		// Identification of the controller of the dynamic data words
+		V_VT( &varVal )   = VT_BSTR;             // canonical data type
+		V_BSTR( &varVal )  = L"";
+		AddProperty(PROPID_DEVICE_SERIAL_NUMBER, L"Controller Serial Number", &varVal);
+		AddProperty(PROPID_DEVICE_FIRMWARE, L"Controller Firmware Version", &varVal);
+		V_VT( &varVal )   = VT_DATE;             // canonical data type
+		V_DATE( &varVal )  = 0.0;
+		AddProperty(PROPID_DEVICE_CALIBRATION_DATE, L"Controller Calibration Date", &varVal);
+		V_VT( &varVal )   = VT_EMPTY;
+
+		PropertySet* deviceProperties = gPropertyStore.CreateSet();
+		CHECK_PTR(deviceProperties);
+		CHECK_RESULT(deviceProperties->AddDeviceProperty(PROPID_DEVICE_SERIAL_NUMBER, &gDevicePropertyProvider, DEVICE_SERIAL_NUMBER_TTL));
+		CHECK_RESULT(deviceProperties->AddDeviceProperty(PROPID_DEVICE_FIRMWARE, &gDevicePropertyProvider, DEVICE_FIRMWARE_TTL));
+		CHECK_RESULT(deviceProperties->AddDeviceProperty(PROPID_DEVICE_CALIBRATION_DATE, &gDevicePropertyProvider, DEVICE_CALIBRATION_DATE_TTL));
+		gDeviceProperties = deviceProperties;
 
 
 		int maxLoops = 100;								// Can be increased for performance tests
@@ -1042,19 +2193,19 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 					bstrItemID += arItemTypes[z].pwszItemID;
 					// Create a new item and add it to the Server Address Space
 
-					CHECK_RESULT(AddItem(
+					CHECK_RESULT(CreateServerItem(
 						bstrItemID,						// ItemID
 						arIOTypes[i].dwAccessRights,	// DaAccessRights
 						&varVal,						// Data Type and Initial Value
 						&deviceItem));
 					CreateSampleVariant(arItemTypes[z].vt, &varVal);
 					CoFileTimeNow(&TimeStamp);
-					SetItemValue(deviceItem, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
+					PublishItemValue(deviceItem, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
 					VariantClear(&varVal);
 					z++;
 
 				}
-				gNumberItems++;
+				InterlockedIncrement(&gNumberItems);
 				i++;
 			}
 			if (WaitForSingleObject(m_hTerminateThreadsEvent,
@@ -1091,18 +2242,18 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 					bstrItemID += L"[]";
 					// Create a new item and add it to the Server Address Space
 
-					CHECK_RESULT(AddItem(
+					CHECK_RESULT(CreateServerItem(
 						bstrItemID,						// ItemID
 						arIOTypes[i].dwAccessRights,	// DaAccessRights
 						&varVal,						// Data Type and Initial Value
 						&deviceItem));
 					CreateSampleVariant(arItemTypes[z].vt | VT_ARRAY, &varVal);
 					CoFileTimeNow(&TimeStamp);
-					SetItemValue(deviceItem, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
+					PublishItemValue(deviceItem, &varVal, (OPC_QUALITY_GOOD | OPC_LIMIT_OK), TimeStamp);
 					VariantClear(&varVal);
 					z++;
 				}
-				gNumberItems++;
+				InterlockedIncrement(&gNumberItems);
 				i++;
 			}
 			if (WaitForSingleObject(m_hTerminateThreadsEvent,
@@ -1111,6 +2262,27 @@ unsigned __stdcall ConfigThread(LPVOID pAttr)
 			}
 		}
 
+		// The tag lists of the simulated controllers are not registered;
+		// they are loaded from the device when they are browsed
+		CHECK_RESULT(gBrowseIndex.AddLazyBranch(DEVICE_BRANCH, &gSimulatedDevice, DEVICE_BROWSE_TTL));
+
+		// Item IDs of the data words, e.g. Devices.PLC1.DB2.DBW4
+		WCHAR wszPattern[128];
+		swprintf_s(wszPattern, 128, L"%s%cPLC{n:1-%u}%cDB{m:1-%u}%cDBW{offset:0-%u/%u}",
+			DEVICE_BRANCH, BRANCH_DELIMITER, DEVICE_CONTROLLERS, BRANCH_DELIMITER,
+			DEVICE_DATA_BLOCKS, BRANCH_DELIMITER, (DEVICE_DATA_WORDS - 1) * DATAWORD_STRIDE, DATAWORD_STRIDE);
+		CHECK_RESULT(gItemResolver.AddPattern(PATTERNID_DATAWORD, wszPattern, VT_I2, ReadWritable));
+
+		// The alarm picture of the last run is restored before the update
+		// cycles start; the server also runs without it
+		hr = RestoreConditionStates();
+		if (FAILED(hr)) {
+			PublishSystemMessage(L"Condition states not restored", hr);
+		}
+		if (FAILED(gEventJournalResult)) {
+			PublishSystemMessage(L"Event journal not available", gEventJournalResult);
+		}
+
 		gServerState = ServerState::Running;
 		SetServerState(gServerState);
 		_endthreadex(0);                           // The thread terminates.
@@ -1192,6 +2364,20 @@ DLLEXP HRESULT DLLCALL OnCreateServerItems()
 		return HRESULT_FROM_WIN32( GetLastError() );
 	}
 
+	// The server runs without the event journal if it cannot be opened; the
+	// error is reported by the ConfigThread once the system source exists
+	WCHAR journalPath[MAX_PATH];
+	gEventJournalResult = GetPluginFilePath( EVENT_JOURNAL_DIR, journalPath, MAX_PATH );
+	if (SUCCEEDED( gEventJournalResult )) {
+		gEventJournalResult = gEventJournal.Open( journalPath );
+	}
+
+	// The acknowledgement writer runs before the threads which use it
+	hr = gAckPipeline.Start();
+	if (FAILED( hr )) {
+		return hr;
+	}
+
 	m_hConfigThread = (HANDLE)_beginthreadex(
 		NULL,                // No thread security attributes
 		0,                   // Default stack size  
@@ -1369,8 +2555,8 @@ DLLEXP HRESULT DLLCALL OnGetDaServerParameters( int* updatePeriod, WCHAR* branch
 {
 	// Data Cache update rate in milliseconds
 	*updatePeriod = UPDATE_PERIOD;
-	*branchDelimiter = '.';
-	*browseMode = Generic;            // browse the generic server address space
+	*branchDelimiter = BRANCH_DELIMITER;
+	*browseMode = SAMPLE_BROWSE_MODE;  // Custom: browse calls are answered from the BrowseIndex
 	return S_OK;
 }
 
@@ -1395,8 +2581,8 @@ DLLEXP HRESULT DLLCALL OnGetDaOptimizationParameters(
 {
 	*useOnRequestItems = true;
 	*useOnRefreshItems = true;
-	*useOnAddItem = false;
-	*useOnRemoveItem = false;
+	*useOnAddItem = true;                        // Subscriptions of dynamic items, see PollDeviceItems()
+	*useOnRemoveItem = true;
 
 	return S_OK;
 }
@@ -1440,34 +2626,7 @@ DLLEXP HRESULT DLLCALL OnQueryProperties(
 	int** ids)
 
 {
-	if (itemHandle == gItemHandle_SpecialProperties)
-	{
-		// item has custom properties
-		*noProp = 3;
-		int *propIDs  = new int [*noProp];
-		propIDs[0] = PROPID_CASING_MATERIAL;
-		propIDs[1] = PROPID_CASING_HEIGHT;
-		propIDs[2] = PROPID_CASING_MANUFACTURER;
-		*ids = propIDs;
-		return S_OK;
-	}
-	else if (itemHandle == gItemHandle_SpecialEU || itemHandle == gItemHandle_SpecialEU2)
-	{
-		// item has custom properties
-		*noProp = 2;
-		int *propIDs  = new int [*noProp];
-		propIDs[0] = OPC_PROPERTY_HIGH_EU;
-		propIDs[1] = OPC_PROPERTY_LOW_EU;
-		*ids = propIDs;
-		return S_OK;
-	}
-	else
-	{
-		// item has no custom properties
-		*noProp = 0;
-		*ids = NULL;
-		return S_FALSE;
-	}
+	return gPropertyStore.QueryProperties(itemHandle, noProp, ids);
 }
 
 
@@ -1485,37 +2644,35 @@ DLLEXP HRESULT DLLCALL OnGetPropertyValue(
 	int propertyId,
 	LPVARIANT propertyValue )
 {
+	return gPropertyStore.GetPropertyValue(itemHandle, propertyId, propertyValue);
+}
 
-	if (itemHandle == gItemHandle_SpecialProperties)
-	{
-		// Item property is available
-		switch (propertyId)
-		{
-			case PROPID_CASING_HEIGHT:
-				V_VT( propertyValue ) = VT_R8;
-				V_R8( propertyValue )        = 25.45; 
-				break;
-			case PROPID_CASING_MATERIAL:
-				V_VT( propertyValue ) = VT_BSTR;
-				V_BSTR( propertyValue )      = SysAllocString( L"Aluminum" );
-				break;
-			case PROPID_CASING_MANUFACTURER:
-				V_VT( propertyValue ) = VT_BSTR;
-				V_BSTR( propertyValue )      = SysAllocString( L"CBM" );
-				break;
-			default:
-				propertyValue = NULL;
-				return S_FALSE;
-				break;
-		}
-		return S_OK;
-	}
-	else
-	{
-		// Item property is not available
-		propertyValue = NULL;
-		return S_FALSE; //E_INVALID_PID;
-	}
+
+/// <summary>
+/// Returns the values of the requested custom properties of several items
+/// in one call, e.g. the EU limits of all items browsed by a configuration
+/// tool. The generic server calls OnGetPropertyValue for each item and
+/// property; this method is exported for callers which read properties
+/// in bulk and returns the same values.
+/// </summary>
+/// <returns>HRESULT success/error code. S_FALSE if at least one value is not returned.</returns>
+/// <param name="numItems">Number of item handles</param>
+/// <param name="itemHandles">Item application handles</param>
+/// <param name="numProps">Number of property IDs</param>
+/// <param name="propertyIds">IDs of the properties</param>
+/// <param name="propertyValues">Array of numItems * numProps values, the value
+///                              of property p of item i is at index i * numProps + p</param>
+/// <param name="errors">Array of numItems * numProps results, S_FALSE if the
+///                      item has no such custom property</param>
+DLLEXP HRESULT DLLCALL OnGetPropertyValues(
+	int numItems,
+	void** itemHandles,
+	int numProps,
+	int* propertyIds,
+	LPVARIANT propertyValues,
+	HRESULT* errors)
+{
+	return gPropertyStore.GetPropertyValues(numItems, itemHandles, numProps, propertyIds, propertyValues, errors);
 }
 
 
@@ -1582,8 +2739,15 @@ DLLEXP HRESULT DLLCALL OnBrowseChangePosition(
 	LPCWSTR position, 
 	LPWSTR * actualPosition)
 {
-	// not supported in this default implementation
-	return E_INVALIDARG;
+	// The generic server keeps ownership of the previous position string
+	LPCWSTR currentPosition = (actualPosition != NULL) ? *actualPosition : NULL;
+	LPWSTR  newPosition     = NULL;
+
+	HRESULT hr = gBrowseIndex.ChangePosition( browseDirection, currentPosition, position, &newPosition );
+	if (SUCCEEDED( hr )) {
+		*actualPosition = newPosition;
+	}
+	return hr;
 }
 
 
@@ -1679,10 +2843,47 @@ DLLEXP HRESULT DLLCALL OnBrowseItemIds(
 									   int * noItems, 
 									   LPWSTR ** itemIDs )
 {
-	// not supported in this default implementation
-	*noItems = 0;
-	*itemIDs = NULL;
-	return E_INVALIDARG;
+	return gBrowseIndex.BrowseItemIds( actualPosition, browseFilterType, filterCriteria,
+									   dataTypeFilter, accessRightsFilter, noItems, itemIDs );
+}
+
+
+/// <summary>
+/// Paged variant of OnBrowseItemIds. Returns at most maxCount item IDs per
+/// call, so the memory needed by a browse of a large address space is
+/// bounded by the page size. The generic server calls OnBrowseItemIds and
+/// gets the complete result; this method is exported for callers which
+/// browse in pages.
+/// </summary>
+/// <returns>HRESULT success/error code.</returns>
+/// <param name="actualPosition">Position in the server address space</param>
+/// <param name="browseFilterType">Branch/Leaf/Flat filter, see OnBrowseItemIds</param>
+/// <param name="filterCriteria">name pattern match expression, e.g. "*"</param>
+/// <param name="dataTypeFilter">Filter based on the data type</param>
+/// <param name="accessRightsFilter">Filter based on the DaAccessRights bit mask</param>
+/// <param name="continuationPoint">NULL for the first page, otherwise the
+///                                 continuation point returned by the
+///                                 previous call with unchanged arguments</param>
+/// <param name="maxCount">Maximum number of item IDs returned, 0 = no limit</param>
+/// <param name="noItems">Number of items returned</param>
+/// <param name="itemIDs">Items meeting the browse criteria</param>
+/// <param name="nextContinuationPoint">Continuation point for the next page,
+///                                     NULL after the last page</param>
+DLLEXP HRESULT DLLCALL OnBrowseItemIdsPage(
+	LPWSTR actualPosition,
+	DaBrowseType browseFilterType,
+	LPWSTR filterCriteria,
+	VARTYPE dataTypeFilter,
+	DaAccessRights accessRightsFilter,
+	LPWSTR continuationPoint,
+	DWORD maxCount,
+	int * noItems,
+	LPWSTR ** itemIDs,
+	LPWSTR * nextContinuationPoint )
+{
+	return gBrowseIndex.BrowseItemIdsPage( actualPosition, browseFilterType, filterCriteria,
+										   dataTypeFilter, accessRightsFilter, continuationPoint,
+										   maxCount, noItems, itemIDs, nextContinuationPoint );
 }
 
 
@@ -1765,9 +2966,7 @@ DLLEXP HRESULT DLLCALL OnBrowseGetFullItemId(
 	LPWSTR itemName, 
 	LPWSTR * fullItemId)
 {
-	// not supported in this default implementation
-	*fullItemId = NULL;
-	return E_INVALIDARG;
+	return gBrowseIndex.GetFullItemId( actualPosition, itemName, fullItemId );
 }
 
 
@@ -1836,6 +3035,8 @@ DLLEXP HRESULT DLLCALL OnRefreshItems(
 
 	gDataSimulation.CalculateNewData();
 
+	RefreshDeviceItems( numItems, deviceItemHandles );
+
 	//if (numItems == 0)
 	//{
 	//	CoFileTimeNow( &TimeStamp );
@@ -1876,6 +3077,10 @@ DLLEXP HRESULT DLLCALL OnRefreshItems(
 DLLEXP HRESULT DLLCALL OnAddItem(
 	/* in */       void*	  deviceItem)
 {
+	// The first client starts polling the item from the device
+	if (gSubscriptions.AddClient(deviceItem)) {
+		gIdleItems.SetInUse(deviceItem, true);
+	}
 	return S_OK;
 }
 
@@ -1901,7 +3106,12 @@ DLLEXP HRESULT DLLCALL OnAddItem(
 DLLEXP HRESULT DLLCALL OnRemoveItem(
 	/* in */       void*	  deviceItem)
 {
-	//DeleteItem(deviceItem);
+	// No client uses the item any more, this stops polling unless the
+	// plug-in references it; the item is removed from the cache later if
+	// it is still not used
+	if (gSubscriptions.RemoveClient(deviceItem)) {
+		gIdleItems.SetInUse(deviceItem, false);
+	}
 	return S_OK;
 }
 
@@ -1937,11 +3147,44 @@ DLLEXP HRESULT DLLCALL OnWriteItems(
 
 	for (int i = 0; i < numItems; ++i)              // handle all items
 	{
+		errors[i] = S_OK;						// init to S_OK
 		if (itemHandles[i] == gDeviceItem_RequestShutdownCommand)
     	{
             FireShutdownRequest(V_BSTR(&itemVQTs[i].vDataValue));
         }
-		errors[i] = S_OK;						// init to S_OK
+		else if (itemHandles[i] == gDeviceItem_ReplayEventsCommand)
+		{
+			VARIANT varVal;                      // replayed by the RefreshThread
+			VariantInit( &varVal );
+			errors[i] = VariantChangeType( &varVal, &itemVQTs[i].vDataValue, 0, VT_I4 );
+			if (SUCCEEDED( errors[i] )) {
+				InterlockedExchange( &gReplayMinutes, V_I4( &varVal ) );
+			}
+		}
+		else
+		{
+			DeviceAddress address;
+			bool          fDeviceItem;
+
+			AcquireSRWLockShared( &gDeviceItemsLock );
+			std::map<void*, DeviceAddress>::const_iterator it = gDeviceItems.find( itemHandles[i] );
+			fDeviceItem = (it != gDeviceItems.end());
+			if (fDeviceItem) {
+				address = it->second;
+			}
+			ReleaseSRWLockShared( &gDeviceItemsLock );
+
+			if (fDeviceItem) {                   // write the data word to the device
+				VARIANT varVal;
+				VariantInit( &varVal );
+				errors[i] = VariantChangeType( &varVal, &itemVQTs[i].vDataValue, 0, VT_I2 );
+				if (SUCCEEDED( errors[i] )) {
+					errors[i] = gSimulatedDevice.WriteDataWords( address.dwController, address.dwDataBlock,
+																 1, &address.dwOffset, &V_I2( &varVal ) );
+				}
+				VariantClear( &varVal );
+			}
+		}
 	}
 
 	//
@@ -1953,7 +3196,15 @@ DLLEXP HRESULT DLLCALL OnWriteItems(
                                                    
 DLLEXP HRESULT DLLCALL  OnTranslateToItemId( int conditionId, int subConditionId, int attributeId, LPWSTR* itemId, LPWSTR* nodeName, CLSID* clsid  )
 {
-	return S_OK;
+	//
+	// ----- BEGIN SAMPLE IMPLEMENTATION -----
+	//
+	// The attributes of the conditions bound with BindLimitCondition are
+	// registered in gItemTranslations
+	return gItemTranslations.Translate( conditionId, subConditionId, attributeId, itemId, nodeName, clsid );
+	//
+	// ----- END SAMPLE IMPLEMENTATION -----
+	//
 }
 
 
@@ -1983,7 +3234,24 @@ DLLEXP HRESULT DLLCALL  OnTranslateToItemId( int conditionId, int subConditionId
 /// </remarks>                                                   
 DLLEXP HRESULT DLLCALL  OnAckNotification( int conditionId, int subConditionId )
 {
-	return S_OK;
+	//
+	// ----- BEGIN SAMPLE IMPLEMENTATION -----
+	//
+	// The acknowledgement is written to the device asynchronously, so the
+	// client does not wait for the device. Acknowledgements made at the
+	// device and confirmed by the AckPipeline are not written back.
+	if (gAckPipeline.IsConfirming()) {
+		gConditionSnapshot.Acknowledge( (DWORD)conditionId );
+		return S_OK;
+	}
+	HRESULT hr = gAckPipeline.Enqueue( (DWORD)conditionId, (DWORD)subConditionId );
+	if (SUCCEEDED( hr )) {
+		gConditionSnapshot.Acknowledge( (DWORD)conditionId );
+	}
+	return hr;
+	//
+	// ----- END SAMPLE IMPLEMENTATION -----
+	//
 }
 
 
@@ -2036,7 +3304,62 @@ DLLEXP void DLLCALL OnGetLogPath(char * logPath)
 /// <param name="dataTypes">Data Types requested by the client of the items which does not exist in the server's cache</param> 
 DLLEXP HRESULT DLLCALL OnRequestItems(int numItems, LPWSTR *fullItemIds, VARTYPE *dataTypes)
 {
-	// no valid item in this default implementation
-	return S_FALSE;
+	HRESULT hr = S_FALSE;
+	std::vector<PendingDeviceItem> pending;
+	PendingAddressMap              pendingAddresses;
+
+	// Items of the device address space are added to the server's cache
+	// when they are first accessed
+	for (int i = 0; i < numItems; i++) {
+		VARTYPE        dataType;
+		DaAccessRights accessRights;
+		VARIANT        varVal;
+		void*          deviceItem;
+		ResolvedItem   resolved;
+
+		// Unknown items requested before
+		if (gNegativeCache.Contains(fullItemIds[i])) {
+			continue;
+		}
+
+		// Data words are resolved by pattern without querying the device,
+		// their initial values are read together below with the data
+		// words the client will probably request next
+		if (gItemResolver.Resolve(fullItemIds[i], dataTypes[i], &resolved) == S_OK) {
+			try {
+				PendingDeviceItem item;
+				SetPendingDeviceItem(fullItemIds[i], resolved, item);
+				AddPendingItem(item, pending, pendingAddresses);
+				AddPrefetchItems(item.address, pending, pendingAddresses);
+			}
+			catch (...) {
+			}
+			continue;
+		}
+
+		// Other items of browsed device branches
+		if (FAILED(gBrowseIndex.FindItem(fullItemIds[i], &dataType, &accessRights))) {
+			gNegativeCache.Add(fullItemIds[i]);
+			continue;
+		}
+		VariantInit(&varVal);
+		try {
+			CreateSampleVariant(dataType, &varVal);
+			if (SUCCEEDED(AddItem(fullItemIds[i], accessRights, &varVal, &deviceItem))) {
+				gSubscriptions.Register(deviceItem);
+				gIdleItems.Register(deviceItem, EstimateItemSize(fullItemIds[i]));
+				InterlockedIncrement(&gNumberItems);
+				hr = S_OK;
+			}
+		}
+		catch (HRESULT) {
+		}
+		VariantClear(&varVal);
+	}
+
+	if (!pending.empty() && CreateDeviceItems(pending) > 0) {
+		hr = S_OK;
+	}
+	return hr;
 }
 //DOM-IGNORE-END
\ No newline at end of file
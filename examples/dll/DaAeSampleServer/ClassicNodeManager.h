@@ -40,6 +40,38 @@
  * Application Definitions (SAMPLE)
  */
 #define UPDATE_PERIOD         200            /* Data Cache update rate in milliseconds */
+#define BRANCH_DELIMITER      L'.'           /* Branch separator used in fully qualified item IDs */
+#define SAMPLE_BROWSE_MODE    Custom         /* Generic: browse the server cache, Custom: browse the BrowseIndex */
+#define DEVICE_BRANCH         L"Devices"     /* Branch with the address space browsed from the simulated device */
+#define DEVICE_BROWSE_TTL     60000          /* Time in milliseconds the browsed device tag lists are cached */
+#define DEVICE_PROPERTY_ERROR_TTL 5000       /* Time in milliseconds a failed read of a device property is cached */
+#define DEVICE_CONTROLLERS    4              /* Number of controllers of the simulated device */
+#define DEVICE_DATA_BLOCKS    16             /* Number of data blocks per controller */
+#define DEVICE_DATA_WORDS     64             /* Number of data words per data block */
+#define NEGATIVE_CACHE_SIZE   10000          /* Maximum number of unknown item IDs remembered by OnRequestItems */
+#define NEGATIVE_CACHE_TTL    300000         /* Time in milliseconds an unknown item ID is remembered */
+#define DYNAMIC_ITEM_IDLE_TIME 600000        /* Time in milliseconds after which unused dynamic items are removed */
+#define DYNAMIC_ITEM_BUDGET   4194304        /* Estimated memory in bytes all dynamic items may use */
+#define DEVICE_PREFETCH_MIN   8              /* Data words added in advance when a data block is first accessed */
+#define DEVICE_PREFETCH_MAX   64             /* Maximum number of data words added in advance per request */
+#define CONDITION_BATCH_SIZE  1000           /* Condition state changes processed with one call at most */
+#define CONDITION_SNAPSHOT_FILE L"ConditionSnapshot.dat" /* Conditions restored after a restart, next to the plug-in */
+#define EVENT_RATE_LIMIT      10             /* Simple and tracking events per second and source forwarded on average */
+#define EVENT_BURST_LIMIT     20             /* Events per source forwarded at once before the rate limit applies */
+#define EVENT_FOLD_TIME       10000          /* Time in milliseconds duplicates of an event are folded into it */
+#define EVENT_INTERNED_STRINGS 1024         /* Recurring strings of event attributes allocated once and shared */
+#define EVENT_JOURNAL_DIR     L"EventJournal" /* Directory next to the plug-in with the journal of the processed events */
+#define EVENT_JOURNAL_SEGMENT_SIZE 16777216 /* Size in bytes of a journal file */
+#define EVENT_JOURNAL_SEGMENTS 8            /* Journal files kept, the oldest is deleted when a new one is started */
+#define AE_HIERARCHY_FILE     L"AeHierarchy.txt" /* Optional file with further AE areas, sources and conditions */
+#define ACK_BATCH_SIZE        64             /* Acknowledgements written to a controller with one request at most */
+#define ACK_MAX_ATTEMPTS      5              /* Attempts to write an acknowledgement before it is reported as failed */
+#define ACK_RETRY_DELAY       1000           /* Delay in milliseconds before the first retry, doubled on each retry */
+#define KPI_BRANCH            L"AlarmKpis"   /* Branch with the alarm KPIs of the areas */
+#define KPI_WINDOW            600000         /* Time in milliseconds the alarm rate is counted over */
+#define KPI_STANDING_TIME     86400000       /* Time in milliseconds after which an active alarm is standing */
+#define KPI_CHATTER_WINDOW    60000          /* Time in milliseconds within which repeated alarms are chattering */
+#define KPI_CHATTER_COUNT     3              /* Alarms of a condition within KPI_CHATTER_WINDOW to be chattering */
 
 
 /*
@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Limit evaluation of multi-state conditions bound to DA items.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>                           // SSE2 limit comparison
+#endif
+#include <math.h>
+#include "ConditionEngine.h"
+
+// The delay timers are checked with a resolution of 100 ms, one revolution
+// of the wheel covers 102.4 seconds
+#define DELAY_TIMER_RESOLUTION    100
+#define DELAY_TIMER_SLOTS         1024
+
+// The levels of all conditions are computed in one pass if at least one
+// in DIRTY_FULL_PASS_RATIO conditions changed
+#define DIRTY_FULL_PASS_RATIO     4
+
+//-----------------------------------------------------------------------------
+// CLASS ConditionEngine
+//-----------------------------------------------------------------------------
+
+ConditionEngine::ConditionEngine()
+	: m_delayTimers( DELAY_TIMER_RESOLUTION, DELAY_TIMER_SLOTS )
+{
+	InitializeSRWLock( &m_lock );
+}
+
+// Returns true if the used limits are ascending and the deadband is smaller
+// than the gap between each pair of adjacent used limits, so leaving a
+// limit never skips the next one. The levels count the violated limits, so
+// LO_LO and HI_HI require LO and HI; otherwise a value beyond LO_LO would
+// be reported as LO.
+static bool IsValidDefinition( const LimitDefinition& definition )
+{
+	if (!(definition.deadband >= 0)) {
+		return false;
+	}
+	if ((definition.limits[LIMIT_LO_LO] != -HUGE_VAL && definition.limits[LIMIT_LO] == -HUGE_VAL) ||
+		(definition.limits[LIMIT_HI_HI] != HUGE_VAL && definition.limits[LIMIT_HI] == HUGE_VAL)) {
+		return false;
+	}
+
+	double previous = -HUGE_VAL;
+	for (int i = 0; i < LIMIT_COUNT; i++) {
+		double limit = definition.limits[i];
+		if (limit == -HUGE_VAL || limit == HUGE_VAL) {
+			continue;                            // not used
+		}
+		if (previous != -HUGE_VAL && !(limit - previous > definition.deadband)) {
+			return false;
+		}
+		previous = limit;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// AddLimitCondition
+// -----------------
+//    Binds a multi-state condition to the DA item whose value is checked
+//    against the limits. The condition is inactive until the first
+//    evaluation after a value was set. Returns E_INVALIDARG if the
+//    definition breaks the rules described at LimitDefinition.
+//-----------------------------------------------------------------------------
+HRESULT ConditionEngine::AddLimitCondition( DWORD dwConditionId, void* deviceItem, const LimitDefinition& definition )
+{
+	if (!IsValidDefinition( definition )) {
+		return E_INVALIDARG;
+	}
+
+	HRESULT hr = S_OK;
+
+	AcquireSRWLockExclusive( &m_lock );
+	size_t count = m_values.size();
+	try {
+		// The value is in the inactive range until it is set
+		double value = (definition.limits[LIMIT_LO] + definition.limits[LIMIT_HI]) / 2;
+		if (definition.limits[LIMIT_LO] == -HUGE_VAL || definition.limits[LIMIT_HI] == HUGE_VAL) {
+			value = (definition.limits[LIMIT_LO] == -HUGE_VAL) ? definition.limits[LIMIT_HI] : definition.limits[LIMIT_LO];
+		}
+
+		m_values.push_back( value );
+		m_loLo.push_back( definition.limits[LIMIT_LO_LO] );
+		m_lo.push_back( definition.limits[LIMIT_LO] );
+		m_hi.push_back( definition.limits[LIMIT_HI] );
+		m_hiHi.push_back( definition.limits[LIMIT_HI_HI] );
+		m_newLevels.push_back( LevelNormal );
+		m_levels.push_back( LevelNormal );
+		m_reportedLevels.push_back( LevelNormal );
+		m_timerTags.push_back( 0 );
+		m_limits.insert( m_limits.end(), definition.limits, definition.limits + LIMIT_COUNT );
+		m_deadbands.push_back( definition.deadband );
+		m_onDelays.push_back( definition.dwOnDelay );
+		m_offDelays.push_back( definition.dwOffDelay );
+		m_conditionIds.push_back( dwConditionId );
+		m_subConditionIds.insert( m_subConditionIds.end(), definition.subConditionIds,
+								  definition.subConditionIds + LIMIT_COUNT );
+		m_dirtyFlags.push_back( 0 );
+		m_dirty.reserve( count + 1 );            // SetValue never allocates
+		m_items[deviceItem].push_back( (DWORD)count );
+	}
+	catch (...) {
+		m_values.resize( count );
+		m_loLo.resize( count );
+		m_lo.resize( count );
+		m_hi.resize( count );
+		m_hiHi.resize( count );
+		m_newLevels.resize( count );
+		m_levels.resize( count );
+		m_reportedLevels.resize( count );
+		m_timerTags.resize( count );
+		m_limits.resize( count * LIMIT_COUNT );
+		m_deadbands.resize( count );
+		m_onDelays.resize( count );
+		m_offDelays.resize( count );
+		m_conditionIds.resize( count );
+		m_subConditionIds.resize( count * LIMIT_COUNT );
+		m_dirtyFlags.resize( count );
+		hr = E_OUTOFMEMORY;
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// SetValue
+// --------
+//    Stores the value of a DA item for the conditions bound to it. The
+//    conditions whose value changed are checked by the next evaluation.
+//-----------------------------------------------------------------------------
+void ConditionEngine::SetValue( void* deviceItem, double value )
+{
+	AcquireSRWLockExclusive( &m_lock );
+	std::unordered_map<void*, std::vector<DWORD>>::const_iterator it = m_items.find( deviceItem );
+	if (it != m_items.end()) {
+		for (size_t i = 0; i < it->second.size(); ++i) {
+			DWORD dwIndex = it->second[i];
+			if (m_values[dwIndex] != value) {
+				m_values[dwIndex] = value;
+				MarkDirty( dwIndex );
+			}
+		}
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+bool ConditionEngine::IsBound( void* deviceItem ) const
+{
+	AcquireSRWLockShared( &m_lock );
+	bool fBound = (m_items.find( deviceItem ) != m_items.end());
+	ReleaseSRWLockShared( &m_lock );
+	return fBound;
+}
+
+// The capacity of m_dirty is reserved for all conditions
+void ConditionEngine::MarkDirty( DWORD dwIndex )
+{
+	if (!m_dirtyFlags[dwIndex]) {
+		m_dirtyFlags[dwIndex] = 1;
+		m_dirty.push_back( dwIndex );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// RestoreState
+// ------------
+//    Sets the state of a condition which was reported before a restart,
+//    so the next evaluation reports the return to normal or to another
+//    sub-condition instead of keeping the restored state.
+//-----------------------------------------------------------------------------
+void ConditionEngine::RestoreState( DWORD dwConditionId, DWORD dwSubConditionId, bool fActive )
+{
+	// Single state conditions use the HI limit with sub-condition ID 0
+	static const int  limitOrder[LIMIT_COUNT]  = { LIMIT_HI, LIMIT_LO, LIMIT_HI_HI, LIMIT_LO_LO };
+	static const BYTE limitLevels[LIMIT_COUNT] = { LevelLoLo, LevelLo, LevelHi, LevelHiHi };
+
+	AcquireSRWLockExclusive( &m_lock );
+	for (size_t i = 0; i < m_conditionIds.size(); ++i) {
+		if (m_conditionIds[i] != dwConditionId) {
+			continue;
+		}
+
+		BYTE level = LevelNormal;
+		for (int k = 0; k < LIMIT_COUNT && fActive; ++k) {
+			int limit = limitOrder[k];
+			if (m_subConditionIds[i * LIMIT_COUNT + limit] == dwSubConditionId &&
+				fabs( m_limits[i * LIMIT_COUNT + limit] ) != HUGE_VAL) {
+				level = limitLevels[limit];
+				break;
+			}
+		}
+		m_levels[i]         = level;
+		m_reportedLevels[i] = level;
+		m_timerTags[i]++;                        // cancels a pending delay
+		ApplyDeadband( i );
+		MarkDirty( (DWORD)i );                   // the value may not match
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+//-----------------------------------------------------------------------------
+// ComputeLevels
+// -------------
+//    Calculates m_newLevels for the conditions in [first, last). A value
+//    which is not a number violates no limit.
+//-----------------------------------------------------------------------------
+void ConditionEngine::ComputeLevels( size_t first, size_t last )
+{
+	size_t i = first;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	for (; i + 2 <= last; i += 2) {
+		__m128d value = _mm_loadu_pd( &m_values[i] );
+		int loLo = _mm_movemask_pd( _mm_cmplt_pd( value, _mm_loadu_pd( &m_loLo[i] ) ) );
+		int lo   = _mm_movemask_pd( _mm_cmplt_pd( value, _mm_loadu_pd( &m_lo[i] ) ) );
+		int hi   = _mm_movemask_pd( _mm_cmpgt_pd( value, _mm_loadu_pd( &m_hi[i] ) ) );
+		int hiHi = _mm_movemask_pd( _mm_cmpgt_pd( value, _mm_loadu_pd( &m_hiHi[i] ) ) );
+
+		m_newLevels[i]     = (BYTE)(LevelNormal - (loLo & 1) - (lo & 1) + (hi & 1) + (hiHi & 1));
+		m_newLevels[i + 1] = (BYTE)(LevelNormal - (loLo >> 1) - (lo >> 1) + (hi >> 1) + (hiHi >> 1));
+	}
+#endif
+
+	for (; i < last; ++i) {
+		double value = m_values[i];
+		m_newLevels[i] = (BYTE)(LevelNormal - (value < m_loLo[i]) - (value < m_lo[i]) +
+											  (value > m_hi[i]) + (value > m_hiHi[i]));
+	}
+}
+
+//-----------------------------------------------------------------------------
+// ApplyDeadband
+// -------------
+//    Moves the limits the condition currently violates back by the
+//    deadband, so the value must cross limit +/- deadband to leave them.
+//-----------------------------------------------------------------------------
+void ConditionEngine::ApplyDeadband( size_t index )
+{
+	const double* limits   = &m_limits[index * LIMIT_COUNT];
+	double        deadband = m_deadbands[index];
+	BYTE          level    = m_levels[index];
+
+	m_loLo[index] = limits[LIMIT_LO_LO] + ((level <= LevelLoLo) ? deadband : 0);
+	m_lo[index]   = limits[LIMIT_LO]    + ((level <= LevelLo)   ? deadband : 0);
+	m_hi[index]   = limits[LIMIT_HI]    - ((level >= LevelHi)   ? deadband : 0);
+	m_hiHi[index] = limits[LIMIT_HI_HI] - ((level >= LevelHiHi) ? deadband : 0);
+}
+
+void ConditionEngine::AddTransition( size_t index, std::vector<LimitTransition>& transitions )
+{
+	BYTE level = m_levels[index];
+
+	LimitTransition transition;
+	transition.dwConditionId = m_conditionIds[index];
+	transition.fActive       = (level != LevelNormal);
+	transition.value         = m_values[index];
+	switch (level) {
+		case LevelLoLo: transition.dwSubConditionId = m_subConditionIds[index * LIMIT_COUNT + LIMIT_LO_LO]; break;
+		case LevelLo:   transition.dwSubConditionId = m_subConditionIds[index * LIMIT_COUNT + LIMIT_LO];    break;
+		case LevelHi:   transition.dwSubConditionId = m_subConditionIds[index * LIMIT_COUNT + LIMIT_HI];    break;
+		case LevelHiHi: transition.dwSubConditionId = m_subConditionIds[index * LIMIT_COUNT + LIMIT_HI_HI]; break;
+		default:        transition.dwSubConditionId = 0;                                                    break;
+	}
+	transitions.push_back( transition );
+	m_reportedLevels[index] = level;
+}
+
+//-----------------------------------------------------------------------------
+// Evaluate
+// --------
+//    Checks the conditions whose value changed since the last evaluation
+//    against their limits and appends the conditions whose state changed
+//    to transitions: immediately if no delay applies, otherwise when the
+//    delay expired without a further change. Returns the number of
+//    appended transitions.
+//
+//    If many conditions changed their levels are computed in one pass
+//    over all conditions, otherwise one by one.
+//-----------------------------------------------------------------------------
+DWORD ConditionEngine::Evaluate( std::vector<LimitTransition>& transitions )
+{
+	ULONGLONG now     = GetTickCount64();
+	size_t    initial = transitions.size();
+
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		size_t count = m_values.size();
+		if (m_dirty.size() * DIRTY_FULL_PASS_RATIO >= count) {
+			ComputeLevels( 0, count );
+		}
+		else {
+			for (size_t d = 0; d < m_dirty.size(); ++d) {
+				ComputeLevels( m_dirty[d], m_dirty[d] + 1 );
+			}
+		}
+
+		for (size_t d = 0; d < m_dirty.size(); ++d) {
+			UpdateLevel( m_dirty[d], now, transitions );
+		}
+
+		m_expired.clear();
+		m_delayTimers.Advance( now, m_expired );
+		for (size_t e = 0; e < m_expired.size(); ++e) {
+			size_t i = m_expired[e].dwId;
+			if (m_expired[e].dwTag == m_timerTags[i] && m_levels[i] != m_reportedLevels[i]) {
+				AddTransition( i, transitions );
+			}
+		}
+	}
+	catch (...) {
+		// not enough memory, the remaining transitions are lost
+	}
+	for (size_t d = 0; d < m_dirty.size(); ++d) {
+		m_dirtyFlags[m_dirty[d]] = 0;
+	}
+	m_dirty.clear();
+	ReleaseSRWLockExclusive( &m_lock );
+	return (DWORD)(transitions.size() - initial);
+}
+
+// Takes the level computed for a condition and reports or schedules the
+// change of its state
+void ConditionEngine::UpdateLevel( size_t index, ULONGLONG now, std::vector<LimitTransition>& transitions )
+{
+	BYTE level = m_newLevels[index];
+	if (level == m_levels[index]) {
+		return;
+	}
+	m_levels[index] = level;
+	ApplyDeadband( index );
+
+	m_timerTags[index]++;                        // cancels a pending delay
+	if (level == m_reportedLevels[index]) {
+		return;                                  // changed back within the delay
+	}
+
+	DWORD dwDelay = (level == LevelNormal) ? m_offDelays[index] : m_onDelays[index];
+	if (dwDelay == 0 || FAILED( m_delayTimers.Schedule( (DWORD)index, m_timerTags[index], now + dwDelay ) )) {
+		AddTransition( index, transitions );
+	}
+}
+
+DWORD ConditionEngine::ConditionCount() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwCount = (DWORD)m_values.size();
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
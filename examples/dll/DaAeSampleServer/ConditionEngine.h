@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Limit evaluation of multi-state conditions bound to DA items.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(CONDITIONENGINE_H)
+#define CONDITIONENGINE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <unordered_map>
+#include <vector>
+#include "TimerWheel.h"
+
+// Limits of a LimitDefinition
+#define LIMIT_LO_LO           0
+#define LIMIT_LO              1
+#define LIMIT_HI              2
+#define LIMIT_HI_HI           3
+#define LIMIT_COUNT           4
+
+//-----------------------------------------------------------------------------
+// STRUCT LimitDefinition / LimitTransition
+// ----------------------------------------
+//    A multi-state condition with the sub-conditions LO_LO, LO, HI and
+//    HI_HI. A sub-condition is active if the value is below (LO_LO, LO) or
+//    above (HI, HI_HI) its limit; the more severe one wins. A limit which
+//    is not used is set to -HUGE_VAL (low limits) or HUGE_VAL (high
+//    limits). LO_LO may only be used together with LO and HI_HI only
+//    together with HI. A single state condition only uses the HI limit
+//    with the sub-condition ID 0.
+//
+//    An active limit is left only when the value moved back by more than
+//    deadband. The used limits must be ascending and the deadband smaller
+//    than the gap between adjacent used limits.
+//
+//    A new active state is reported when it persisted for dwOnDelay
+//    milliseconds, the return to the inactive state when it persisted for
+//    dwOffDelay milliseconds.
+//-----------------------------------------------------------------------------
+struct LimitDefinition
+{
+	double   limits[LIMIT_COUNT];
+	DWORD    subConditionIds[LIMIT_COUNT];   // sub-condition definition IDs
+	double   deadband;
+	DWORD    dwOnDelay;
+	DWORD    dwOffDelay;
+};
+
+struct LimitTransition
+{
+	DWORD    dwConditionId;
+	DWORD    dwSubConditionId;               // 0 if the condition became inactive
+	bool     fActive;
+	double   value;                          // value which caused the transition
+};
+
+//-----------------------------------------------------------------------------
+// CLASS ConditionEngine
+// ---------------------
+//    Evaluates the limits of the conditions whose value changed once per
+//    scan and reports only the conditions whose active sub-condition
+//    changed.
+//
+//    The values and limits are kept as structure of arrays, one array per
+//    field indexed by condition. If many values changed, all conditions
+//    are evaluated in one pass over contiguous memory without branches;
+//    on x86/x64 two conditions are compared at a time with SSE2.
+//
+//    The limits used by this pass already include the deadband of the
+//    active limits. They are only recalculated for the conditions whose
+//    level changed.
+//
+//    Level changes of conditions with an on-delay or off-delay are
+//    scheduled on a timer wheel shared by all conditions and reported by
+//    the first evaluation after the delay if the level did not change
+//    again in the meantime.
+//
+//    SetValue stores the current value of a DA item for all conditions
+//    bound to it. RestoreState sets the state a condition had before a
+//    restart. The methods are thread safe.
+//-----------------------------------------------------------------------------
+class ConditionEngine
+{
+public:
+	ConditionEngine();
+	~ConditionEngine() {}
+
+	// Operations
+	HRESULT AddLimitCondition( DWORD dwConditionId, void* deviceItem, const LimitDefinition& definition );
+	void    SetValue( void* deviceItem, double value );
+	bool    IsBound( void* deviceItem ) const;
+	void    RestoreState( DWORD dwConditionId, DWORD dwSubConditionId, bool fActive );
+	DWORD   Evaluate( std::vector<LimitTransition>& transitions );
+
+	// Attributes
+	DWORD   ConditionCount() const;
+
+	// Implementation
+protected:
+	// Levels of a condition, the inactive state is in the middle so the
+	// level is 2 - number of violated low limits + number of violated
+	// high limits
+	enum Level
+	{
+		LevelLoLo   = 0,
+		LevelLo     = 1,
+		LevelNormal = 2,
+		LevelHi     = 3,
+		LevelHiHi   = 4
+	};
+
+	void    ComputeLevels( size_t first, size_t last );
+	void    ApplyDeadband( size_t index );
+	void    AddTransition( size_t index, std::vector<LimitTransition>& transitions );
+	void    UpdateLevel( size_t index, ULONGLONG now, std::vector<LimitTransition>& transitions );
+	void    MarkDirty( DWORD dwIndex );
+
+	// One element per condition, evaluated each scan
+	std::vector<double>   m_values;
+	std::vector<double>   m_loLo;                // limits including the deadband
+	std::vector<double>   m_lo;
+	std::vector<double>   m_hi;
+	std::vector<double>   m_hiHi;
+	std::vector<BYTE>     m_newLevels;           // level of the current evaluation
+
+	// One element per condition, used on level changes only
+	std::vector<BYTE>     m_levels;              // level without delay
+	std::vector<BYTE>     m_reportedLevels;      // level reported last
+	std::vector<DWORD>    m_timerTags;           // tag of the valid delay timer
+	std::vector<double>   m_limits;              // LIMIT_COUNT per condition
+	std::vector<double>   m_deadbands;
+	std::vector<DWORD>    m_onDelays;
+	std::vector<DWORD>    m_offDelays;
+	std::vector<DWORD>    m_conditionIds;
+	std::vector<DWORD>    m_subConditionIds;     // LIMIT_COUNT per condition
+	std::vector<BYTE>     m_dirtyFlags;          // value changed since the last scan
+
+	std::vector<DWORD>    m_dirty;               // conditions to evaluate
+
+	TimerWheel            m_delayTimers;
+	std::vector<TimerEntry> m_expired;
+	std::unordered_map<void*, std::vector<DWORD>> m_items;    // conditions bound to an item
+	mutable SRWLOCK       m_lock;
+
+private:
+	ConditionEngine( const ConditionEngine& );
+	ConditionEngine& operator=( const ConditionEngine& );
+};
+
+#endif // !defined(CONDITIONENGINE_H)
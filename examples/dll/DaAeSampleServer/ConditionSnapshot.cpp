@@ -0,0 +1,436 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Persistent snapshot of the condition states restored at startup.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "ConditionSnapshot.h"
+
+using namespace IClassicBaseNodeManager;
+
+//-----------------------------------------------------------------------------
+// FILE FORMAT
+//-----------------------------------------------------------------------------
+#define SNAPSHOT_MAGIC              0x504E5343   // "CSNP"
+#define SNAPSHOT_VERSION            1
+
+// SnapshotRecord::wFlags
+#define SNAPSHOT_ACTIVE             0x0001
+#define SNAPSHOT_ACKNOWLEDGED       0x0002
+#define SNAPSHOT_SEVERITY           0x0004
+#define SNAPSHOT_ACKREQUIRED        0x0008
+#define SNAPSHOT_ACKREQUIRED_VALUE  0x0010
+
+struct SnapshotHeader
+{
+	DWORD        dwMagic;
+	DWORD        dwVersion;
+	DWORD        dwCount;                        // number of records
+};
+
+// A record is followed by the characters of the message
+struct SnapshotRecord
+{
+	DWORD        dwConditionId;
+	DWORD        dwSubConditionId;
+	WORD         wFlags;
+	WORD         wQuality;
+	DWORD        dwSeverity;
+	FILETIME     activeTime;
+	FILETIME     changeTime;
+	DWORD        dwMessageLength;                // characters without terminator
+};
+
+//-----------------------------------------------------------------------------
+// CLASS ConditionSnapshot
+//-----------------------------------------------------------------------------
+
+ConditionSnapshot::ConditionSnapshot()
+{
+	m_fDirty = false;
+	InitializeSRWLock( &m_lock );
+}
+
+//-----------------------------------------------------------------------------
+// Update / Acknowledge
+// --------------------
+//    Update applies a state change passed to the generic server. A new
+//    active sub-condition has to be acknowledged again unless the state
+//    requires no acknowledgement. Acknowledge marks the condition as
+//    acknowledged.
+//-----------------------------------------------------------------------------
+void ConditionSnapshot::Update( AeConditionState& state )
+{
+	FILETIME timeStamp;
+	if (state.TimeStampPtr() != NULL) {
+		timeStamp = *state.TimeStampPtr();
+	}
+	else {
+		CoFileTimeNow( &timeStamp );
+	}
+
+	AcquireSRWLockExclusive( &m_lock );
+	std::unordered_map<DWORD, Entry>::iterator it = m_entries.find( state.CondID() );
+	if (it == m_entries.end() && !state.ActiveState()) {
+		ReleaseSRWLockExclusive( &m_lock );
+		return;                                  // normal state, nothing to keep
+	}
+	try {
+		if (it == m_entries.end()) {
+			Entry entry;
+			entry.dwSubConditionId = state.SubCondID();
+			entry.fActive          = false;
+			entry.fAcknowledged    = true;
+			it = m_entries.insert( std::make_pair( state.CondID(), entry ) ).first;
+		}
+
+		Entry& entry = it->second;
+		if (state.ActiveState() && (!entry.fActive || entry.dwSubConditionId != state.SubCondID())) {
+			entry.dwSubConditionId = state.SubCondID();
+			entry.fAcknowledged    = false;
+			entry.activeTime       = timeStamp;
+		}
+		entry.fActive           = (state.ActiveState() != FALSE);
+		entry.wQuality          = state.Quality();
+		entry.fSeverity         = (state.SeverityPtr() != NULL);
+		entry.dwSeverity        = entry.fSeverity ? *state.SeverityPtr() : 0;
+		entry.fAckRequired      = (state.AckRequiredPtr() != NULL);
+		entry.fAckRequiredValue = entry.fAckRequired && *state.AckRequiredPtr();
+		entry.changeTime        = timeStamp;
+		if (state.Message() != NULL) {
+			entry.message = state.Message();
+		}
+		else {
+			entry.message.clear();
+		}
+		if (entry.fAckRequired && !entry.fAckRequiredValue) {
+			entry.fAcknowledged = true;
+		}
+
+		if (!entry.fActive && entry.fAcknowledged) {
+			m_entries.erase( it );
+		}
+		m_fDirty = true;
+	}
+	catch (...) {
+		// not enough memory, the change is not saved
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+void ConditionSnapshot::Acknowledge( DWORD dwConditionId )
+{
+	AcquireSRWLockExclusive( &m_lock );
+	std::unordered_map<DWORD, Entry>::iterator it = m_entries.find( dwConditionId );
+	if (it != m_entries.end() && !it->second.fAcknowledged) {
+		it->second.fAcknowledged = true;
+		if (!it->second.fActive) {
+			m_entries.erase( it );
+		}
+		m_fDirty = true;
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+//-----------------------------------------------------------------------------
+// Load
+// ----
+//    Reads the snapshot saved by the last run and remembers the path for
+//    Save. Returns HRESULT_FROM_WIN32( ERROR_FILE_NOT_FOUND ) if there is
+//    no snapshot and HRESULT_FROM_WIN32( ERROR_INVALID_DATA ) if it is
+//    damaged; the table is empty then.
+//-----------------------------------------------------------------------------
+HRESULT ConditionSnapshot::Load( LPCWSTR path )
+{
+	if (path == NULL) {
+		return E_INVALIDARG;
+	}
+
+	HRESULT           hr = S_OK;
+	std::vector<BYTE> data;
+
+	HANDLE hFile = CreateFile( path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if (hFile == INVALID_HANDLE_VALUE) {
+		hr = HRESULT_FROM_WIN32( GetLastError() );
+	}
+	else {
+		LARGE_INTEGER size;
+		DWORD         dwRead = 0;
+		if (!GetFileSizeEx( hFile, &size ) || size.QuadPart > 0x10000000) {
+			hr = HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+		}
+		else {
+			try {
+				data.resize( (size_t)size.QuadPart );
+			}
+			catch (...) {
+				hr = E_OUTOFMEMORY;
+			}
+			if (SUCCEEDED( hr ) && !data.empty() &&
+				(!ReadFile( hFile, &data[0], (DWORD)data.size(), &dwRead, NULL ) || dwRead != data.size())) {
+				hr = HRESULT_FROM_WIN32( GetLastError() );
+			}
+		}
+		CloseHandle( hFile );
+	}
+
+	AcquireSRWLockExclusive( &m_lock );
+	m_entries.clear();
+	m_fDirty = false;
+	try {
+		m_path = path;
+
+		size_t offset = sizeof(SnapshotHeader);
+		SnapshotHeader header;
+		if (SUCCEEDED( hr )) {
+			if (data.size() < sizeof(SnapshotHeader)) {
+				throw HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+			}
+			memcpy( &header, &data[0], sizeof(SnapshotHeader) );
+			if (header.dwMagic != SNAPSHOT_MAGIC || header.dwVersion != SNAPSHOT_VERSION) {
+				throw HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+			}
+
+			for (DWORD i = 0; i < header.dwCount; ++i) {
+				SnapshotRecord record;
+				if (data.size() - offset < sizeof(SnapshotRecord)) {
+					throw HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+				}
+				memcpy( &record, &data[offset], sizeof(SnapshotRecord) );
+				offset += sizeof(SnapshotRecord);
+				if ((data.size() - offset) / sizeof(WCHAR) < record.dwMessageLength) {
+					throw HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+				}
+
+				Entry entry;
+				entry.dwSubConditionId  = record.dwSubConditionId;
+				entry.fActive           = (record.wFlags & SNAPSHOT_ACTIVE) != 0;
+				entry.fAcknowledged     = (record.wFlags & SNAPSHOT_ACKNOWLEDGED) != 0;
+				entry.fSeverity         = (record.wFlags & SNAPSHOT_SEVERITY) != 0;
+				entry.fAckRequired      = (record.wFlags & SNAPSHOT_ACKREQUIRED) != 0;
+				entry.fAckRequiredValue = (record.wFlags & SNAPSHOT_ACKREQUIRED_VALUE) != 0;
+				entry.wQuality          = record.wQuality;
+				entry.dwSeverity        = record.dwSeverity;
+				entry.activeTime        = record.activeTime;
+				entry.changeTime        = record.changeTime;
+				entry.message.resize( record.dwMessageLength );
+				if (record.dwMessageLength > 0) {
+					memcpy( &entry.message[0], &data[offset], record.dwMessageLength * sizeof(WCHAR) );
+				}
+				offset += record.dwMessageLength * sizeof(WCHAR);
+				m_entries[record.dwConditionId] = entry;
+			}
+		}
+	}
+	catch (HRESULT hresEx) {
+		hr = hresEx;
+		m_entries.clear();
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+		m_entries.clear();
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Save
+// ----
+//    Writes the table to a temporary file which then replaces the
+//    snapshot. Returns S_FALSE if nothing changed since the last Save.
+//-----------------------------------------------------------------------------
+HRESULT ConditionSnapshot::Save()
+{
+	HRESULT           hr = S_OK;
+	std::vector<BYTE> data;
+	std::wstring      path;
+
+	AcquireSRWLockExclusive( &m_lock );
+	if (!m_fDirty || m_path.empty()) {
+		ReleaseSRWLockExclusive( &m_lock );
+		return S_FALSE;
+	}
+	try {
+		path = m_path;
+
+		SnapshotHeader header;
+		header.dwMagic   = SNAPSHOT_MAGIC;
+		header.dwVersion = SNAPSHOT_VERSION;
+		header.dwCount   = (DWORD)m_entries.size();
+		data.insert( data.end(), (const BYTE*)&header, (const BYTE*)(&header + 1) );
+
+		std::unordered_map<DWORD, Entry>::const_iterator it;
+		for (it = m_entries.begin(); it != m_entries.end(); ++it) {
+			const Entry&   entry = it->second;
+			SnapshotRecord record;
+			record.dwConditionId    = it->first;
+			record.dwSubConditionId = entry.dwSubConditionId;
+			record.wFlags           = (entry.fActive           ? SNAPSHOT_ACTIVE            : 0) |
+									  (entry.fAcknowledged     ? SNAPSHOT_ACKNOWLEDGED      : 0) |
+									  (entry.fSeverity         ? SNAPSHOT_SEVERITY          : 0) |
+									  (entry.fAckRequired      ? SNAPSHOT_ACKREQUIRED       : 0) |
+									  (entry.fAckRequiredValue ? SNAPSHOT_ACKREQUIRED_VALUE : 0);
+			record.wQuality         = entry.wQuality;
+			record.dwSeverity       = entry.dwSeverity;
+			record.activeTime       = entry.activeTime;
+			record.changeTime       = entry.changeTime;
+			record.dwMessageLength  = (DWORD)entry.message.length();
+			data.insert( data.end(), (const BYTE*)&record, (const BYTE*)(&record + 1) );
+			data.insert( data.end(), (const BYTE*)entry.message.c_str(),
+						 (const BYTE*)(entry.message.c_str() + entry.message.length()) );
+		}
+		m_fDirty = false;
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	if (FAILED( hr )) {
+		return hr;
+	}
+
+	std::wstring tempPath;
+	try {
+		tempPath = path + L".tmp";
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+	if (SUCCEEDED( hr )) {
+		HANDLE hFile = CreateFile( tempPath.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+		DWORD  dwWritten = 0;
+		bool   fWritten = (hFile != INVALID_HANDLE_VALUE) &&
+						  WriteFile( hFile, &data[0], (DWORD)data.size(), &dwWritten, NULL ) &&
+						  dwWritten == data.size() && FlushFileBuffers( hFile );
+		if (!fWritten) {
+			hr = HRESULT_FROM_WIN32( GetLastError() );
+		}
+		if (hFile != INVALID_HANDLE_VALUE) {
+			CloseHandle( hFile );
+		}
+		if (fWritten && !MoveFileEx( tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH )) {
+			hr = HRESULT_FROM_WIN32( GetLastError() );
+		}
+	}
+
+	if (FAILED( hr )) {                          // try again with the next Save
+		AcquireSRWLockExclusive( &m_lock );
+		m_fDirty = true;
+		ReleaseSRWLockExclusive( &m_lock );
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Restore
+// -------
+//    Adds the states of the table to the collector and flushes it.
+//-----------------------------------------------------------------------------
+HRESULT ConditionSnapshot::Restore( ConditionStateCollector& collector, ConditionFilter filter,
+									std::vector<RestoredCondition>& restored )
+{
+	HRESULT hr = S_OK;
+	std::vector<std::pair<DWORD, Entry>> entries;
+	std::vector<DWORD> unknown;
+
+	AcquireSRWLockShared( &m_lock );
+	try {
+		entries.assign( m_entries.begin(), m_entries.end() );
+		restored.reserve( restored.size() + entries.size() );
+		unknown.reserve( entries.size() );
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+	ReleaseSRWLockShared( &m_lock );
+	if (FAILED( hr )) {
+		return hr;
+	}
+
+	for (size_t i = 0; i < entries.size() && SUCCEEDED( hr ); ++i) {
+		Entry&           entry = entries[i].second;
+		BOOL             fAckRequired = entry.fAckRequiredValue;
+		AeConditionState cs;
+
+		if (!filter( entries[i].first )) {
+			unknown.push_back( entries[i].first );   // reserved above
+			continue;
+		}
+
+		cs.CondID()         = entries[i].first;
+		cs.SubCondID()      = entry.dwSubConditionId;
+		cs.ActiveState()    = TRUE;
+		cs.Quality()        = entry.wQuality;
+		cs.SeverityPtr()    = entry.fSeverity ? &entry.dwSeverity : NULL;
+		cs.AckRequiredPtr() = entry.fAckRequired ? &fAckRequired : NULL;
+		if (entry.fActive) {
+			cs.Message()      = entry.message.empty() ? NULL : entry.message.c_str();
+			cs.TimeStampPtr() = &entry.activeTime;
+			hr = collector.Add( cs );
+		}
+		else {                                   // active and returned to normal
+			cs.TimeStampPtr() = &entry.activeTime;
+			hr = collector.Add( cs );
+			if (SUCCEEDED( hr )) {
+				cs.SubCondID()    = 0;
+				cs.ActiveState()  = FALSE;
+				cs.Message()      = entry.message.empty() ? NULL : entry.message.c_str();
+				cs.TimeStampPtr() = &entry.changeTime;
+				hr = collector.Add( cs );
+			}
+		}
+
+		RestoredCondition condition;
+		condition.dwConditionId    = entries[i].first;
+		condition.dwSubConditionId = entry.dwSubConditionId;
+		condition.fActive          = entry.fActive;
+		condition.fAcknowledged    = entry.fAcknowledged;
+		restored.push_back( condition );         // reserved above
+	}
+
+	if (!unknown.empty()) {
+		AcquireSRWLockExclusive( &m_lock );
+		for (size_t i = 0; i < unknown.size(); ++i) {
+			m_entries.erase( unknown[i] );
+		}
+		m_fDirty = true;
+		ReleaseSRWLockExclusive( &m_lock );
+	}
+
+	HRESULT hrFlush = collector.Flush();
+	return SUCCEEDED( hr ) ? hrFlush : hr;
+}
+
+DWORD ConditionSnapshot::Count() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwCount = (DWORD)m_entries.size();
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Persistent snapshot of the condition states restored at startup.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(CONDITIONSNAPSHOT_H)
+#define CONDITIONSNAPSHOT_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ConditionStateCollector.h"
+
+//-----------------------------------------------------------------------------
+// STRUCT RestoredCondition
+// ------------------------
+//    Condition whose state was restored by ConditionSnapshot::Restore.
+//    dwSubConditionId is the active or, for an inactive condition, the
+//    last active sub-condition.
+//-----------------------------------------------------------------------------
+struct RestoredCondition
+{
+	DWORD    dwConditionId;
+	DWORD    dwSubConditionId;
+	bool     fActive;
+	bool     fAcknowledged;
+};
+
+// Returns true if the condition is defined in the server
+typedef bool (*ConditionFilter)( DWORD dwConditionId );
+
+//-----------------------------------------------------------------------------
+// CLASS ConditionSnapshot
+// -----------------------
+//    Table of the conditions which are not in their normal state, i.e.
+//    active or not yet acknowledged, saved to a file so the alarm picture
+//    survives a restart of the server.
+//
+//    Update is called with each state change passed to the generic server
+//    and Acknowledge with each acknowledgement. A condition which is
+//    inactive and acknowledged is removed from the table. Save writes the
+//    table to the file given to Load if it changed; the file is replaced
+//    at once so a crash during Save leaves the previous snapshot intact.
+//    Each condition takes 36 bytes plus its message.
+//
+//    Restore passes the loaded states to a ConditionStateCollector with
+//    their original time stamps and flushes it, so all conditions are
+//    restored with one call of ProcessConditionStateChanges per batch.
+//    An inactive condition which was not acknowledged is restored as
+//    active and then inactive. The acknowledgements are not part of the
+//    state changes; they are returned in restored and have to be confirmed
+//    by the caller. Attribute values are not saved. Conditions rejected
+//    by the filter, e.g. removed from the configuration, are skipped and
+//    dropped from the table.
+//
+//    The methods are thread safe.
+//-----------------------------------------------------------------------------
+class ConditionSnapshot
+{
+public:
+	ConditionSnapshot();
+	~ConditionSnapshot() {}
+
+	// Operations
+	void    Update( IClassicBaseNodeManager::AeConditionState& state );
+	void    Acknowledge( DWORD dwConditionId );
+	HRESULT Load( LPCWSTR path );
+	HRESULT Save();
+	HRESULT Restore( ConditionStateCollector& collector, ConditionFilter filter,
+					 std::vector<RestoredCondition>& restored );
+
+	// Attributes
+	DWORD   Count() const;
+
+	// Implementation
+protected:
+	struct Entry
+	{
+		DWORD        dwSubConditionId;
+		bool         fActive;
+		bool         fAcknowledged;
+		bool         fSeverity;                  // dwSeverity is valid
+		bool         fAckRequired;               // fAckRequiredValue is valid
+		bool         fAckRequiredValue;
+		WORD         wQuality;
+		DWORD        dwSeverity;
+		FILETIME     activeTime;                 // time the sub-condition became active
+		FILETIME     changeTime;                 // time of the last state change
+		std::wstring message;                    // message of the last state change
+	};
+
+	std::unordered_map<DWORD, Entry> m_entries;
+	std::wstring                     m_path;
+	bool                             m_fDirty;
+	mutable SRWLOCK                  m_lock;
+
+private:
+	ConditionSnapshot( const ConditionSnapshot& );
+	ConditionSnapshot& operator=( const ConditionSnapshot& );
+};
+
+#endif // !defined(CONDITIONSNAPSHOT_H)
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Collects the condition state changes of a scan cycle.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "ConditionStateCollector.h"
+
+using namespace IClassicBaseNodeManager;
+
+//-----------------------------------------------------------------------------
+// CLASS ConditionStateCollector
+//-----------------------------------------------------------------------------
+
+ConditionStateCollector::ConditionStateCollector( DWORD dwMaxStates )
+{
+	m_dwMaxStates = (dwMaxStates > 0) ? dwMaxStates : 1;
+	InitializeSRWLock( &m_lock );
+}
+
+ConditionStateCollector::~ConditionStateCollector()
+{
+	ClearAttributes( m_attrs );
+}
+
+void ConditionStateCollector::ClearAttributes( std::vector<VARIANT>& attrs )
+{
+	for (size_t i = 0; i < attrs.size(); ++i) {
+		VariantClear( &attrs[i] );
+	}
+	attrs.clear();
+}
+
+//-----------------------------------------------------------------------------
+// Add
+// ---
+//    Adds a copy of the state to the changes of the current cycle. If the
+//    threshold is reached all collected changes are processed at once.
+//-----------------------------------------------------------------------------
+HRESULT ConditionStateCollector::Add( AeConditionState& state )
+{
+	HRESULT hr = S_OK;
+	bool    fFlush = false;
+
+	PendingState pending;
+	pending.dwConditionId     = state.CondID();
+	pending.dwSubConditionId  = state.SubCondID();
+	pending.fActive           = state.ActiveState();
+	pending.wQuality          = state.Quality();
+	pending.dwAttrCount       = (state.AttrValuesPtr() != NULL) ? state.AttrCount() : 0;
+	pending.fMessage          = (state.Message() != NULL);
+	pending.fSeverity         = (state.SeverityPtr() != NULL);
+	pending.dwSeverity        = pending.fSeverity ? *state.SeverityPtr() : 0;
+	pending.fAckRequired      = (state.AckRequiredPtr() != NULL);
+	pending.fAckRequiredValue = pending.fAckRequired ? *state.AckRequiredPtr() : FALSE;
+	if (state.TimeStampPtr() != NULL) {
+		pending.timeStamp = *state.TimeStampPtr();
+	}
+	else {
+		CoFileTimeNow( &pending.timeStamp );
+	}
+
+	AcquireSRWLockExclusive( &m_lock );
+	size_t attrCount = m_attrs.size();
+	try {
+		if (pending.fMessage) {
+			pending.message = state.Message();
+		}
+
+		pending.dwFirstAttr = (DWORD)attrCount;
+		for (DWORD i = 0; i < pending.dwAttrCount; ++i) {
+			VARIANT value;
+			VariantInit( &value );
+			m_attrs.push_back( value );
+			hr = VariantCopy( &m_attrs.back(), &state.AttrValuesPtr()[i] );
+			if (FAILED( hr )) {
+				throw hr;
+			}
+		}
+
+		m_states.push_back( pending );
+		fFlush = (m_states.size() >= m_dwMaxStates);
+	}
+	catch (HRESULT hresEx) {
+		hr = hresEx;
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+	if (FAILED( hr )) {
+		while (m_attrs.size() > attrCount) {     // remove the copied attributes
+			VariantClear( &m_attrs.back() );
+			m_attrs.pop_back();
+		}
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+
+	if (fFlush) {
+		hr = Flush();
+	}
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Flush
+// -----
+//    Processes all collected changes with a single call of
+//    ProcessConditionStateChanges. Returns S_FALSE if there are no changes.
+//-----------------------------------------------------------------------------
+HRESULT ConditionStateCollector::Flush()
+{
+	std::vector<PendingState> states;
+	std::vector<VARIANT>      attrs;
+
+	AcquireSRWLockExclusive( &m_lock );
+	states.swap( m_states );
+	attrs.swap( m_attrs );
+	ReleaseSRWLockExclusive( &m_lock );
+
+	if (states.empty()) {
+		return S_FALSE;
+	}
+
+	HRESULT hr = Process( states, attrs );
+	ClearAttributes( attrs );
+
+	// Keep the allocated storage for the next cycle if no other
+	// producer has added a change in the meantime
+	states.clear();
+	AcquireSRWLockExclusive( &m_lock );
+	if (m_states.empty() && m_attrs.empty()) {
+		m_states.swap( states );
+		m_attrs.swap( attrs );
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+HRESULT ConditionStateCollector::Process( std::vector<PendingState>& states, std::vector<VARIANT>& attrs )
+{
+	try {
+		std::vector<AeConditionState> changes( states.size() );
+		for (size_t i = 0; i < states.size(); ++i) {
+			PendingState&     pending = states[i];
+			AeConditionState& cs      = changes[i];
+
+			cs.CondID()         = pending.dwConditionId;
+			cs.SubCondID()      = pending.dwSubConditionId;
+			cs.ActiveState()    = pending.fActive;
+			cs.Quality()        = pending.wQuality;
+			cs.AttrCount()      = pending.dwAttrCount;
+			cs.AttrValuesPtr()  = (pending.dwAttrCount > 0) ? &attrs[pending.dwFirstAttr] : NULL;
+			cs.Message()        = pending.fMessage ? pending.message.c_str() : NULL;
+			cs.SeverityPtr()    = pending.fSeverity ? &pending.dwSeverity : NULL;
+			cs.AckRequiredPtr() = pending.fAckRequired ? &pending.fAckRequiredValue : NULL;
+			cs.TimeStampPtr()   = &pending.timeStamp;
+		}
+		return ProcessConditionStateChanges( (int)changes.size(), &changes[0] );
+	}
+	catch (...) {
+		return E_OUTOFMEMORY;
+	}
+}
+
+DWORD ConditionStateCollector::Count() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwCount = (DWORD)m_states.size();
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Collects the condition state changes of a scan cycle.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(CONDITIONSTATECOLLECTOR_H)
+#define CONDITIONSTATECOLLECTOR_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <string>
+#include <vector>
+#include "IClassicBaseNodeManager.h"
+
+//-----------------------------------------------------------------------------
+// CLASS ConditionStateCollector
+// -----------------------------
+//    Accumulates the condition state changes of all producers during a scan
+//    cycle and processes them with a single call of
+//    ProcessConditionStateChanges when Flush is called or when the number
+//    of collected changes reaches the threshold.
+//
+//    Add copies the state including the attribute values, the message and
+//    the optional severity, acknowledge flag and time stamp, so the caller
+//    may release its storage immediately. A state without a time stamp gets
+//    the time of the Add call, not the time of the flush.
+//
+//    The methods are thread safe. The generic server is called without any
+//    lock held.
+//-----------------------------------------------------------------------------
+class ConditionStateCollector
+{
+public:
+	ConditionStateCollector( DWORD dwMaxStates );
+	~ConditionStateCollector();
+
+	// Operations
+	HRESULT Add( IClassicBaseNodeManager::AeConditionState& state );
+	HRESULT Flush();
+
+	// Attributes
+	DWORD   Count() const;
+
+	// Implementation
+protected:
+	// Collected state, the optional values are only valid if the
+	// corresponding flag is set
+	struct PendingState
+	{
+		DWORD        dwConditionId;
+		DWORD        dwSubConditionId;
+		BOOL         fActive;
+		WORD         wQuality;
+		DWORD        dwFirstAttr;                // index in m_attrs
+		DWORD        dwAttrCount;
+		bool         fMessage;
+		std::wstring message;
+		bool         fSeverity;
+		DWORD        dwSeverity;
+		bool         fAckRequired;
+		BOOL         fAckRequiredValue;
+		FILETIME     timeStamp;
+	};
+
+	HRESULT Process( std::vector<PendingState>& states, std::vector<VARIANT>& attrs );
+	static void ClearAttributes( std::vector<VARIANT>& attrs );
+
+	DWORD                     m_dwMaxStates;
+	std::vector<PendingState> m_states;
+	std::vector<VARIANT>      m_attrs;           // attribute values of all states
+	mutable SRWLOCK           m_lock;
+
+private:
+	ConditionStateCollector( const ConditionStateCollector& );
+	ConditionStateCollector& operator=( const ConditionStateCollector& );
+};
+
+#endif // !defined(CONDITIONSTATECOLLECTOR_H)
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Reusable attribute values of AE events with interned strings.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "EventAttributePool.h"
+
+//-----------------------------------------------------------------------------
+// CLASS EventAttributePool
+//-----------------------------------------------------------------------------
+
+EventAttributePool::EventAttributePool( DWORD dwMaxStrings )
+{
+	m_dwMaxStrings = dwMaxStrings;
+	InitializeSRWLock( &m_lock );
+}
+
+EventAttributePool::~EventAttributePool()
+{
+	std::unordered_map<DWORD, Category>::iterator category;
+	for (category = m_categories.begin(); category != m_categories.end(); ++category) {
+		for (size_t i = 0; i < category->second.freeArrays.size(); ++i) {
+			delete [] category->second.freeArrays[i];
+		}
+	}
+
+	std::unordered_map<std::wstring, BSTR>::iterator str;
+	for (str = m_strings.begin(); str != m_strings.end(); ++str) {
+		SysFreeString( str->second );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// DefineAttribute
+// ---------------
+//    Adds an attribute to the attributes of a category. Returns
+//    E_UNEXPECTED if an array of the category was already acquired.
+//-----------------------------------------------------------------------------
+HRESULT EventAttributePool::DefineAttribute( DWORD dwCategoryId, DWORD dwAttributeId )
+{
+	HRESULT hr = S_OK;
+
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		Category& category = m_categories[dwCategoryId];
+		if (category.fAcquired) {
+			hr = E_UNEXPECTED;
+		}
+		else {
+			category.attributeIds.push_back( dwAttributeId );
+		}
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Intern
+// ------
+//    Returns the BSTR with the value shared by all events. The BSTR is
+//    owned by the pool and must not be freed. Returns NULL if out of
+//    memory or if dwMaxStrings strings are already interned.
+//-----------------------------------------------------------------------------
+BSTR EventAttributePool::Intern( LPCWSTR value )
+{
+	if (value == NULL) {
+		return NULL;
+	}
+
+	AcquireSRWLockShared( &m_lock );
+	BSTR bstr = NULL;
+	try {
+		std::unordered_map<std::wstring, BSTR>::const_iterator str = m_strings.find( value );
+		if (str != m_strings.end()) {
+			bstr = str->second;
+		}
+	}
+	catch (...) {
+	}
+	ReleaseSRWLockShared( &m_lock );
+	if (bstr != NULL) {
+		return bstr;
+	}
+
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		std::wstring key( value );
+		std::unordered_map<std::wstring, BSTR>::const_iterator str = m_strings.find( key );
+		if (str != m_strings.end()) {            // interned by another thread meanwhile
+			bstr = str->second;
+		}
+		else if (m_strings.size() < m_dwMaxStrings) {
+			bstr = SysAllocString( value );
+			if (bstr != NULL) {
+				m_strings[key] = bstr;
+			}
+		}
+	}
+	catch (...) {
+		SysFreeString( bstr );
+		bstr = NULL;
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return bstr;
+}
+
+//-----------------------------------------------------------------------------
+// Acquire / Release
+// -----------------
+//    Acquire returns an array with the attributes of a category, all
+//    values are VT_EMPTY. Returns NULL if the category has no attributes
+//    or if out of memory. Release resets the values and returns the array
+//    to the pool; BSTR values must have been returned by Intern.
+//-----------------------------------------------------------------------------
+LPVARIANT EventAttributePool::Acquire( DWORD dwCategoryId, DWORD* pdwCount )
+{
+	LPVARIANT attributes = NULL;
+	DWORD     dwCount = 0;
+
+	AcquireSRWLockExclusive( &m_lock );
+	std::unordered_map<DWORD, Category>::iterator category = m_categories.find( dwCategoryId );
+	if (category != m_categories.end()) {
+		category->second.fAcquired = true;
+		dwCount = (DWORD)category->second.attributeIds.size();
+		if (!category->second.freeArrays.empty()) {
+			attributes = category->second.freeArrays.back();
+			category->second.freeArrays.pop_back();
+		}
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+
+	if (attributes == NULL && dwCount > 0) {     // all arrays of the category in use
+		try {
+			attributes = new VARIANT[dwCount];
+			for (DWORD i = 0; i < dwCount; ++i) {
+				VariantInit( &attributes[i] );
+			}
+		}
+		catch (...) {
+			attributes = NULL;
+		}
+	}
+	if (pdwCount != NULL) {
+		*pdwCount = (attributes != NULL) ? dwCount : 0;
+	}
+	return attributes;
+}
+
+void EventAttributePool::Release( DWORD dwCategoryId, LPVARIANT attributes )
+{
+	if (attributes == NULL) {
+		return;
+	}
+
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		Category& category = m_categories.at( dwCategoryId );
+		for (size_t i = 0; i < category.attributeIds.size(); ++i) {
+			V_VT( &attributes[i] ) = VT_EMPTY;   // the values are not owned by the array
+		}
+		category.freeArrays.push_back( attributes );
+		attributes = NULL;
+	}
+	catch (...) {
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+
+	delete [] attributes;                        // not returned to the pool
+}
+
+//-----------------------------------------------------------------------------
+// AttributeCount / StringCount
+//-----------------------------------------------------------------------------
+DWORD EventAttributePool::AttributeCount( DWORD dwCategoryId ) const
+{
+	AcquireSRWLockShared( &m_lock );
+	std::unordered_map<DWORD, Category>::const_iterator category = m_categories.find( dwCategoryId );
+	DWORD dwCount = (category != m_categories.end()) ? (DWORD)category->second.attributeIds.size() : 0;
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
+
+DWORD EventAttributePool::StringCount() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwCount = (DWORD)m_strings.size();
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
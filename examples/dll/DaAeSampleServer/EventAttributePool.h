@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Reusable attribute values of AE events with interned strings.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(EVENTATTRIBUTEPOOL_H)
+#define EVENTATTRIBUTEPOOL_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// CLASS EventAttributePool
+// ------------------------
+//    Storage for the attribute values of simple and tracking events which
+//    avoids allocations at high event rates.
+//
+//    DefineAttribute is called with each AddEventAttribute so the pool
+//    knows the number of attributes of a category. Acquire returns an
+//    array with one VARIANT per attribute of the category; Release returns
+//    it to the pool for the next event of the category. An array is only
+//    allocated if all arrays of the category are in use.
+//
+//    Recurring strings like device names are interned: Intern returns a
+//    BSTR owned by the pool, which is allocated once and shared by all
+//    events. The values of a pooled array may only be scalars or interned
+//    BSTRs, Release resets them without freeing them. At most dwMaxStrings
+//    strings are interned; strings which change with every event must not
+//    be interned.
+//
+//    All attributes must be defined before the first array of the
+//    category is acquired. The methods are thread safe.
+//-----------------------------------------------------------------------------
+class EventAttributePool
+{
+public:
+	EventAttributePool( DWORD dwMaxStrings );
+	~EventAttributePool();
+
+	// Operations
+	HRESULT   DefineAttribute( DWORD dwCategoryId, DWORD dwAttributeId );
+	BSTR      Intern( LPCWSTR value );
+	LPVARIANT Acquire( DWORD dwCategoryId, DWORD* pdwCount );
+	void      Release( DWORD dwCategoryId, LPVARIANT attributes );
+
+	// Attributes
+	DWORD     AttributeCount( DWORD dwCategoryId ) const;
+	DWORD     StringCount() const;
+
+	// Implementation
+protected:
+	struct Category
+	{
+		std::vector<DWORD>     attributeIds;     // in the order of AddEventAttribute
+		std::vector<LPVARIANT> freeArrays;
+		bool                   fAcquired;        // an array was acquired once
+
+		Category() : fAcquired( false ) {}
+	};
+
+	std::unordered_map<DWORD, Category>        m_categories;
+	std::unordered_map<std::wstring, BSTR>     m_strings;
+	DWORD                                      m_dwMaxStrings;
+	mutable SRWLOCK                            m_lock;
+
+private:
+	EventAttributePool( const EventAttributePool& );
+	EventAttributePool& operator=( const EventAttributePool& );
+};
+
+#endif // !defined(EVENTATTRIBUTEPOOL_H)
@@ -0,0 +1,733 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Memory-mapped journal of the simple and tracking events.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include <algorithm>
+#include "EventJournal.h"
+
+//-----------------------------------------------------------------------------
+// FILE FORMAT
+//-----------------------------------------------------------------------------
+#define JOURNAL_MAGIC         0x4C4E4A45     // "EJNL"
+#define JOURNAL_VERSION       1
+#define JOURNAL_FILE_PREFIX   L"Events"
+#define JOURNAL_FILE_PATTERN  L"Events*.jnl"
+#define JOURNAL_TRACKING      0x0001         // RecordHeader::wFlags
+#define JOURNAL_MAX_STRING    0xFFFE         // characters of a string at most
+#define JOURNAL_TIME_STRIDE   64             // records per entry of the time index
+#define JOURNAL_REPLAY_CHUNK  65536          // bytes copied out per lock of a replay
+
+// Start of a segment file, followed by the records
+struct SegmentHeader
+{
+	DWORD        dwMagic;
+	DWORD        dwVersion;
+	DWORD        dwNumber;
+	DWORD        dwReserved;
+};
+
+// Start of a record, followed by the message, the actor ID (both zero
+// terminated) and the attributes. An attribute is stored as WORD type and
+// the value; a BSTR as WORD length and the characters without terminator.
+struct RecordHeader
+{
+	DWORD        dwLength;                       // including the padding to 8 bytes
+	WORD         wFlags;
+	WORD         wAttrCount;
+	ULONGLONG    timeStamp;
+	DWORD        sourceId;
+	DWORD        categoryId;
+	DWORD        dwSeverity;
+	WORD         wMessageLength;                 // characters without terminator
+	WORD         wActorLength;
+};
+
+static inline ULONGLONG ToTime( const FILETIME& ft )
+{
+	return ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+// Bytes of a scalar value, MAXDWORD for types which are not recorded.
+static DWORD ScalarSize( VARTYPE vt )
+{
+	switch (vt) {
+		case VT_EMPTY: case VT_NULL:
+			return 0;
+		case VT_I1: case VT_UI1:
+			return 1;
+		case VT_I2: case VT_UI2: case VT_BOOL:
+			return 2;
+		case VT_I4: case VT_UI4: case VT_INT: case VT_UINT: case VT_R4: case VT_ERROR:
+			return 4;
+		case VT_I8: case VT_UI8: case VT_R8: case VT_CY: case VT_DATE:
+			return 8;
+	}
+	return MAXDWORD;
+}
+
+// Bytes of a recorded attribute including its type.
+static DWORD AttributeSize( const VARIANT* value )
+{
+	if (V_VT( value ) == VT_BSTR) {
+		DWORD dwLength = (V_BSTR( value ) != NULL) ? SysStringLen( V_BSTR( value ) ) : 0;
+		return sizeof(WORD) + sizeof(WORD) + std::min<DWORD>( dwLength, JOURNAL_MAX_STRING ) * sizeof(WCHAR);
+	}
+	DWORD dwSize = ScalarSize( V_VT( value ) );
+	return sizeof(WORD) + ((dwSize != MAXDWORD) ? dwSize : 0);
+}
+
+//-----------------------------------------------------------------------------
+// CLASS EventJournal
+//-----------------------------------------------------------------------------
+
+EventJournal::EventJournal( DWORD dwSegmentSize, DWORD dwMaxSegments )
+{
+	m_dwSegmentSize = std::max<DWORD>( dwSegmentSize, 65536 );
+	m_dwMaxSegments = std::max<DWORD>( dwMaxSegments, 1 );
+	m_dwNextNumber  = 1;
+	InitializeSRWLock( &m_lock );
+}
+
+EventJournal::~EventJournal()
+{
+	Close();
+}
+
+void EventJournal::SegmentPath( DWORD dwNumber, std::wstring& path ) const
+{
+	WCHAR fileName[32];
+	swprintf_s( fileName, 32, JOURNAL_FILE_PREFIX L"%08u.jnl", dwNumber );
+	path = m_directory + L"\\" + fileName;
+}
+
+//-----------------------------------------------------------------------------
+// Open / Close
+// ------------
+//    Open reads the segments in the directory, which is created if
+//    necessary, and starts a new segment for the events to come. Segments
+//    which cannot be read are left untouched.
+//-----------------------------------------------------------------------------
+HRESULT EventJournal::Open( LPCWSTR directory )
+{
+	if (directory == NULL) {
+		return E_INVALIDARG;
+	}
+	Close();
+
+	HRESULT hr = S_OK;
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		m_directory = directory;
+		if (!CreateDirectory( directory, NULL ) && GetLastError() != ERROR_ALREADY_EXISTS) {
+			throw HRESULT_FROM_WIN32( GetLastError() );
+		}
+
+		std::vector<DWORD> numbers;
+		WIN32_FIND_DATA    findData;
+		HANDLE hFind = FindFirstFile( (m_directory + L"\\" JOURNAL_FILE_PATTERN).c_str(), &findData );
+		if (hFind != INVALID_HANDLE_VALUE) {
+			do {
+				DWORD dwNumber = wcstoul( findData.cFileName + wcslen( JOURNAL_FILE_PREFIX ), NULL, 10 );
+				if (dwNumber > 0) {
+					numbers.push_back( dwNumber );
+				}
+			} while (FindNextFile( hFind, &findData ));
+			FindClose( hFind );
+		}
+		std::sort( numbers.begin(), numbers.end() );
+
+		m_dwNextNumber = numbers.empty() ? 1 : numbers.back() + 1;
+		for (size_t i = 0; i < numbers.size(); ++i) {
+			Segment* segment;
+			if (SUCCEEDED( OpenSegment( numbers[i], false, &segment ) )) {
+				m_segments.push_back( segment );
+			}
+		}
+
+		// A crash may have left an interrupted record behind the last
+		// record of the last segment, so it is not continued.
+		hr = StartSegment();
+	}
+	catch (HRESULT hresEx) {
+		hr = hresEx;
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+
+	if (FAILED( hr )) {
+		Close();
+	}
+	return hr;
+}
+
+void EventJournal::Close()
+{
+	AcquireSRWLockExclusive( &m_lock );
+	for (size_t i = 0; i < m_segments.size(); ++i) {
+		CloseSegment( m_segments[i], false );
+	}
+	m_segments.clear();
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+//-----------------------------------------------------------------------------
+// OpenSegment / CloseSegment / StartSegment
+// -----------------------------------------
+//    OpenSegment maps a new or existing segment file into memory. The
+//    records of an existing segment are indexed up to the first record
+//    which is not complete. StartSegment appends a new segment and deletes
+//    the oldest segments beyond dwMaxSegments.
+//-----------------------------------------------------------------------------
+HRESULT EventJournal::OpenSegment( DWORD dwNumber, bool fCreate, Segment** ppSegment )
+{
+	std::wstring path;
+	SegmentPath( dwNumber, path );
+
+	HANDLE hFile = CreateFile( path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+							   fCreate ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+	if (hFile == INVALID_HANDLE_VALUE) {
+		return HRESULT_FROM_WIN32( GetLastError() );
+	}
+
+	DWORD dwSize = m_dwSegmentSize;
+	if (!fCreate) {
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx( hFile, &size ) || size.QuadPart < (LONGLONG)sizeof(SegmentHeader) ||
+			size.QuadPart > MAXDWORD) {
+			CloseHandle( hFile );
+			return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+		}
+		dwSize = (DWORD)size.QuadPart;
+	}
+
+	// The mapping extends a new file to the size of the segment
+	HANDLE hMapping = CreateFileMapping( hFile, NULL, PAGE_READWRITE, 0, dwSize, NULL );
+	BYTE*  view     = (hMapping != NULL) ? (BYTE*)MapViewOfFile( hMapping, FILE_MAP_WRITE, 0, 0, dwSize ) : NULL;
+	if (view == NULL) {
+		HRESULT hr = HRESULT_FROM_WIN32( GetLastError() );
+		if (hMapping != NULL) {
+			CloseHandle( hMapping );
+		}
+		CloseHandle( hFile );
+		return hr;
+	}
+
+	Segment* segment = NULL;
+	try {
+		segment = new Segment;
+	}
+	catch (...) {
+	}
+	if (segment == NULL) {
+		UnmapViewOfFile( view );
+		CloseHandle( hMapping );
+		CloseHandle( hFile );
+		return E_OUTOFMEMORY;
+	}
+	segment->dwNumber  = dwNumber;
+	segment->dwSize    = dwSize;
+	segment->hFile     = hFile;
+	segment->hMapping  = hMapping;
+	segment->view      = view;
+	segment->dwUsed    = sizeof(SegmentHeader);
+	segment->dwRecords = 0;
+	segment->minTime   = MAXULONGLONG;
+	segment->maxTime   = 0;
+
+	SegmentHeader* header = (SegmentHeader*)view;
+	if (fCreate) {
+		header->dwMagic    = JOURNAL_MAGIC;
+		header->dwVersion  = JOURNAL_VERSION;
+		header->dwNumber   = dwNumber;
+		header->dwReserved = 0;
+	}
+	else if (header->dwMagic != JOURNAL_MAGIC || header->dwVersion != JOURNAL_VERSION ||
+			 header->dwNumber != dwNumber) {
+		CloseSegment( segment, false );
+		return HRESULT_FROM_WIN32( ERROR_INVALID_DATA );
+	}
+	else {
+		try {
+			while (IsValidRecord( segment, segment->dwUsed )) {
+				IndexRecord( segment, segment->dwUsed );
+				segment->dwUsed += ((const RecordHeader*)(view + segment->dwUsed))->dwLength;
+			}
+		}
+		catch (...) {
+			CloseSegment( segment, false );
+			return E_OUTOFMEMORY;
+		}
+	}
+
+	*ppSegment = segment;
+	return S_OK;
+}
+
+void EventJournal::CloseSegment( Segment* segment, bool fDelete )
+{
+	UnmapViewOfFile( segment->view );
+	CloseHandle( segment->hMapping );
+	CloseHandle( segment->hFile );
+	if (fDelete) {
+		std::wstring path;
+		try {
+			SegmentPath( segment->dwNumber, path );
+			DeleteFile( path.c_str() );
+		}
+		catch (...) {
+		}
+	}
+	delete segment;
+}
+
+HRESULT EventJournal::StartSegment()
+{
+	Segment* segment;
+	HRESULT  hr = OpenSegment( m_dwNextNumber, true, &segment );
+	if (FAILED( hr )) {
+		return hr;
+	}
+	m_dwNextNumber++;
+
+	try {
+		m_segments.push_back( segment );
+	}
+	catch (...) {
+		CloseSegment( segment, true );
+		return E_OUTOFMEMORY;
+	}
+
+	while (m_segments.size() > m_dwMaxSegments) {
+		CloseSegment( m_segments.front(), true );
+		m_segments.erase( m_segments.begin() );
+	}
+	return S_OK;
+}
+
+// A record is valid if it is complete and lies within the used part of
+// the segment.
+bool EventJournal::IsValidRecord( const Segment* segment, DWORD dwOffset ) const
+{
+	if (dwOffset > segment->dwSize || segment->dwSize - dwOffset < sizeof(RecordHeader)) {
+		return false;
+	}
+	const RecordHeader* record = (const RecordHeader*)(segment->view + dwOffset);
+	if (record->dwLength < sizeof(RecordHeader) || (record->dwLength % 8) != 0 ||
+		record->dwLength > segment->dwSize - dwOffset) {
+		return false;
+	}
+	DWORD dwStrings = (record->wMessageLength + 1 + record->wActorLength + 1) * sizeof(WCHAR);
+	if (dwStrings > record->dwLength - sizeof(RecordHeader)) {
+		return false;
+	}
+	LPCWSTR message = (LPCWSTR)(record + 1);
+	return message[record->wMessageLength] == L'\0' &&
+		   message[record->wMessageLength + 1 + record->wActorLength] == L'\0';
+}
+
+// Adds a record to the time index and the source index of the segment.
+void EventJournal::IndexRecord( Segment* segment, DWORD dwOffset )
+{
+	const RecordHeader* record = (const RecordHeader*)(segment->view + dwOffset);
+
+	if ((segment->dwRecords % JOURNAL_TIME_STRIDE) == 0) {
+		TimeMark mark;
+		mark.maxTime  = segment->maxTime;
+		mark.dwOffset = dwOffset;
+		segment->timeIndex.push_back( mark );
+	}
+	segment->sourceIndex[record->sourceId].push_back( dwOffset );
+
+	segment->minTime = std::min<ULONGLONG>( segment->minTime, record->timeStamp );
+	segment->maxTime = std::max<ULONGLONG>( segment->maxTime, record->timeStamp );
+	segment->dwRecords++;
+}
+
+//-----------------------------------------------------------------------------
+// Append
+// ------
+//    Writes an event into the current segment, a new segment is started if
+//    it does not fit. Returns E_UNEXPECTED if the journal is not open.
+//-----------------------------------------------------------------------------
+HRESULT EventJournal::Append(
+	bool       fTracking,
+	DWORD      categoryId,
+	DWORD      sourceId,
+	LPCWSTR    message,
+	DWORD      dwSeverity,
+	LPCWSTR    actorId,
+	DWORD      dwAttrCount,
+	LPVARIANT  attributes,
+	LPFILETIME timeStamp )
+{
+	if (dwAttrCount > 0xFFFF || (dwAttrCount > 0 && attributes == NULL)) {
+		return E_INVALIDARG;
+	}
+
+	FILETIME now;
+	if (timeStamp == NULL) {
+		CoFileTimeNow( &now );
+		timeStamp = &now;
+	}
+	DWORD dwMessageLength = (message != NULL) ? (DWORD)std::min<size_t>( wcslen( message ), JOURNAL_MAX_STRING ) : 0;
+	DWORD dwActorLength   = (actorId != NULL) ? (DWORD)std::min<size_t>( wcslen( actorId ), JOURNAL_MAX_STRING ) : 0;
+
+	DWORD dwLength = sizeof(RecordHeader) + (dwMessageLength + 1 + dwActorLength + 1) * sizeof(WCHAR);
+	for (DWORD i = 0; i < dwAttrCount; ++i) {
+		dwLength += AttributeSize( &attributes[i] );
+	}
+	dwLength = (dwLength + 7) & ~7;
+	if (dwLength > m_dwSegmentSize - sizeof(SegmentHeader)) {
+		return E_INVALIDARG;
+	}
+
+	HRESULT hr = S_OK;
+	AcquireSRWLockExclusive( &m_lock );
+	if (m_segments.empty()) {
+		hr = E_UNEXPECTED;
+	}
+	else if (m_segments.back()->dwSize - m_segments.back()->dwUsed < dwLength) {
+		hr = StartSegment();
+	}
+	if (SUCCEEDED( hr )) {
+		Segment*      segment = m_segments.back();
+		DWORD         dwOffset = segment->dwUsed;
+		RecordHeader* record = (RecordHeader*)(segment->view + dwOffset);
+
+		record->wFlags         = fTracking ? JOURNAL_TRACKING : 0;
+		record->wAttrCount     = (WORD)dwAttrCount;
+		record->timeStamp      = ToTime( *timeStamp );
+		record->sourceId       = sourceId;
+		record->categoryId     = categoryId;
+		record->dwSeverity     = dwSeverity;
+		record->wMessageLength = (WORD)dwMessageLength;
+		record->wActorLength   = (WORD)dwActorLength;
+
+		WCHAR* text = (WCHAR*)(record + 1);
+		memcpy( text, message, dwMessageLength * sizeof(WCHAR) );
+		text += dwMessageLength;
+		*text++ = L'\0';
+		memcpy( text, actorId, dwActorLength * sizeof(WCHAR) );
+		text += dwActorLength;
+		*text++ = L'\0';
+
+		BYTE* p = (BYTE*)text;
+		for (DWORD i = 0; i < dwAttrCount; ++i) {
+			const VARIANT* value = &attributes[i];
+			WORD  vt = V_VT( value );
+			if (vt == VT_BSTR) {
+				WORD wLength = (WORD)((AttributeSize( value ) - 2 * sizeof(WORD)) / sizeof(WCHAR));
+				memcpy( p, &vt, sizeof(WORD) );
+				memcpy( p + sizeof(WORD), &wLength, sizeof(WORD) );
+				memcpy( p + 2 * sizeof(WORD), V_BSTR( value ), wLength * sizeof(WCHAR) );
+				p += 2 * sizeof(WORD) + wLength * sizeof(WCHAR);
+				continue;
+			}
+			DWORD dwSize = ScalarSize( vt );
+			if (dwSize == MAXDWORD) {            // not recorded
+				vt     = VT_EMPTY;
+				dwSize = 0;
+			}
+			memcpy( p, &vt, sizeof(WORD) );
+			memcpy( p + sizeof(WORD), &V_UI1( value ), dwSize );
+			p += sizeof(WORD) + dwSize;
+		}
+		memset( p, 0, (BYTE*)record + dwLength - p );
+
+		// The length makes the record valid, so it is written last
+		InterlockedExchange( (LONG*)&record->dwLength, (LONG)dwLength );
+		segment->dwUsed += dwLength;
+
+		try {
+			IndexRecord( segment, dwOffset );
+		}
+		catch (...) {
+			hr = E_OUTOFMEMORY;                  // recorded but not indexed
+		}
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Flush
+// -----
+//    Writes the used part of the current segment to disk.
+//-----------------------------------------------------------------------------
+void EventJournal::Flush()
+{
+	AcquireSRWLockShared( &m_lock );
+	if (!m_segments.empty()) {
+		FlushViewOfFile( m_segments.back()->view, m_segments.back()->dwUsed );
+	}
+	ReleaseSRWLockShared( &m_lock );
+}
+
+//-----------------------------------------------------------------------------
+// Replay
+// ------
+//    Passes the events with a time stamp from from to to (inclusive) of a
+//    source or of JOURNAL_ALL_SOURCES to the reader. The events appended
+//    during the replay are included until the replay reached the end of
+//    the current segment.
+//-----------------------------------------------------------------------------
+HRESULT EventJournal::Replay( const FILETIME& from, const FILETIME& to, DWORD sourceId, JournalReader* reader )
+{
+	if (reader == NULL) {
+		return E_INVALIDARG;
+	}
+
+	ReplayPosition       position = { 0, MAXDWORD };
+	std::vector<BYTE>    chunk;
+	std::vector<VARIANT> attributes;
+	HRESULT              hr;
+
+	do {
+		hr = ReadChunk( ToTime( from ), ToTime( to ), sourceId, position, chunk );
+		if (FAILED( hr )) {
+			break;
+		}
+
+		bool fStop = false;
+		for (size_t offset = 0; offset < chunk.size() && !fStop; ) {
+			JournalEvent ev;
+			if (Decode( &chunk[offset], ev, attributes )) {
+				fStop = !reader->OnEvent( ev );
+			}
+			for (size_t i = 0; i < attributes.size(); ++i) {
+				VariantClear( &attributes[i] );
+			}
+			offset += ((const RecordHeader*)&chunk[offset])->dwLength;
+		}
+		if (fStop) {
+			return S_OK;
+		}
+	} while (hr == S_OK);
+
+	return SUCCEEDED( hr ) ? S_OK : hr;
+}
+
+// Returns the offset of the first record of the segment which may have a
+// time stamp of from or later: the records before the time mark found have
+// earlier time stamps.
+DWORD EventJournal::FirstRecord( const Segment* segment, ULONGLONG from ) const
+{
+	size_t first = 0;
+	size_t last  = segment->timeIndex.size();
+	while (first < last) {                       // first mark with maxTime >= from
+		size_t middle = (first + last) / 2;
+		if (segment->timeIndex[middle].maxTime < from) {
+			first = middle + 1;
+		}
+		else {
+			last = middle;
+		}
+	}
+	return (first > 0) ? segment->timeIndex[first - 1].dwOffset : (DWORD)sizeof(SegmentHeader);
+}
+
+//-----------------------------------------------------------------------------
+// ReadChunk
+// ---------
+//    Copies the next records in the range to chunk, about
+//    JOURNAL_REPLAY_CHUNK bytes, and advances position behind them.
+//    Returns S_FALSE if the end of the journal was reached.
+//-----------------------------------------------------------------------------
+HRESULT EventJournal::ReadChunk(
+	ULONGLONG       from,
+	ULONGLONG       to,
+	DWORD           sourceId,
+	ReplayPosition& position,
+	std::vector<BYTE>& chunk )
+{
+	HRESULT hr = S_OK;
+
+	chunk.clear();
+	AcquireSRWLockShared( &m_lock );
+	try {
+		while (chunk.size() < JOURNAL_REPLAY_CHUNK) {
+			// the segment may have been deleted since the last chunk
+			const Segment* segment = NULL;
+			for (size_t i = 0; i < m_segments.size() && segment == NULL; ++i) {
+				if (m_segments[i]->dwNumber >= position.dwSegment) {
+					segment = m_segments[i];
+				}
+			}
+			if (segment == NULL) {
+				hr = S_FALSE;
+				break;
+			}
+			if (segment->dwNumber != position.dwSegment) {
+				position.dwSegment = segment->dwNumber;
+				position.dwNext    = MAXDWORD;
+			}
+
+			bool fDone = (segment->dwRecords == 0 || segment->maxTime < from || segment->minTime > to);
+			if (!fDone && sourceId == JOURNAL_ALL_SOURCES) {
+				if (position.dwNext == MAXDWORD) {
+					position.dwNext = FirstRecord( segment, from );
+				}
+				while (position.dwNext < segment->dwUsed && chunk.size() < JOURNAL_REPLAY_CHUNK) {
+					const BYTE*         data   = segment->view + position.dwNext;
+					const RecordHeader* record = (const RecordHeader*)data;
+					if (record->timeStamp >= from && record->timeStamp <= to) {
+						chunk.insert( chunk.end(), data, data + record->dwLength );
+					}
+					position.dwNext += record->dwLength;
+				}
+				fDone = (position.dwNext >= segment->dwUsed);
+			}
+			else if (!fDone) {
+				std::unordered_map<DWORD, std::vector<DWORD>>::const_iterator source = segment->sourceIndex.find( sourceId );
+				if (source == segment->sourceIndex.end()) {
+					fDone = true;
+				}
+				else {
+					const std::vector<DWORD>& offsets = source->second;
+					if (position.dwNext == MAXDWORD) {
+						position.dwNext = 0;
+					}
+					while (position.dwNext < offsets.size() && chunk.size() < JOURNAL_REPLAY_CHUNK) {
+						const BYTE*         data   = segment->view + offsets[position.dwNext];
+						const RecordHeader* record = (const RecordHeader*)data;
+						if (record->timeStamp >= from && record->timeStamp <= to) {
+							chunk.insert( chunk.end(), data, data + record->dwLength );
+						}
+						position.dwNext++;
+					}
+					fDone = (position.dwNext >= offsets.size());
+				}
+			}
+
+			if (fDone) {                         // continue with the next segment
+				position.dwSegment++;
+				position.dwNext = MAXDWORD;
+			}
+		}
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+	ReleaseSRWLockShared( &m_lock );
+	return hr;
+}
+
+// Decodes a record copied out of the journal. Returns false if the record
+// is damaged or out of memory.
+bool EventJournal::Decode( const BYTE* data, JournalEvent& ev, std::vector<VARIANT>& attributes )
+{
+	const RecordHeader* record = (const RecordHeader*)data;
+	const BYTE*         end    = data + record->dwLength;
+
+	ev.fTracking   = (record->wFlags & JOURNAL_TRACKING) != 0;
+	ev.timeStamp.dwLowDateTime  = (DWORD)record->timeStamp;
+	ev.timeStamp.dwHighDateTime = (DWORD)(record->timeStamp >> 32);
+	ev.sourceId    = record->sourceId;
+	ev.categoryId  = record->categoryId;
+	ev.dwSeverity  = record->dwSeverity;
+	ev.message     = (LPCWSTR)(record + 1);
+	LPCWSTR actor  = ev.message + record->wMessageLength + 1;
+	ev.actorId     = ev.fTracking ? actor : NULL;
+
+	const BYTE* p = (const BYTE*)(actor + record->wActorLength + 1);
+	try {
+		attributes.resize( record->wAttrCount );
+	}
+	catch (...) {
+		attributes.clear();
+		return false;
+	}
+	for (size_t i = 0; i < attributes.size(); ++i) {
+		VariantInit( &attributes[i] );
+	}
+
+	for (size_t i = 0; i < attributes.size(); ++i) {
+		WORD vt;
+		if (end - p < (ptrdiff_t)sizeof(WORD)) {
+			return false;
+		}
+		memcpy( &vt, p, sizeof(WORD) );
+		p += sizeof(WORD);
+
+		if (vt == VT_BSTR) {
+			WORD wLength;
+			if (end - p < (ptrdiff_t)sizeof(WORD)) {
+				return false;
+			}
+			memcpy( &wLength, p, sizeof(WORD) );
+			p += sizeof(WORD);
+			if (end - p < (ptrdiff_t)(wLength * sizeof(WCHAR))) {
+				return false;
+			}
+			BSTR bstr = SysAllocStringLen( NULL, wLength );
+			if (bstr == NULL) {
+				return false;
+			}
+			memcpy( bstr, p, wLength * sizeof(WCHAR) );
+			p += wLength * sizeof(WCHAR);
+			V_VT( &attributes[i] )   = VT_BSTR;
+			V_BSTR( &attributes[i] ) = bstr;
+			continue;
+		}
+
+		DWORD dwSize = ScalarSize( vt );
+		if (dwSize == MAXDWORD || end - p < (ptrdiff_t)dwSize) {
+			return false;
+		}
+		memcpy( &V_UI1( &attributes[i] ), p, dwSize );
+		V_VT( &attributes[i] ) = vt;
+		p += dwSize;
+	}
+
+	ev.dwAttrCount = (DWORD)attributes.size();
+	ev.attributes  = attributes.empty() ? NULL : &attributes[0];
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// IsOpen / SegmentCount
+//-----------------------------------------------------------------------------
+bool EventJournal::IsOpen() const
+{
+	AcquireSRWLockShared( &m_lock );
+	bool fOpen = !m_segments.empty();
+	ReleaseSRWLockShared( &m_lock );
+	return fOpen;
+}
+
+DWORD EventJournal::SegmentCount() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwCount = (DWORD)m_segments.size();
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Memory-mapped journal of the simple and tracking events.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(EVENTJOURNAL_H)
+#define EVENTJOURNAL_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define JOURNAL_ALL_SOURCES   0xFFFFFFFF     // Replay the events of all sources
+
+//-----------------------------------------------------------------------------
+// STRUCT JournalEvent
+// -------------------
+//    Event read from the journal. The strings and attribute values are
+//    valid during the call of JournalReader::OnEvent only.
+//-----------------------------------------------------------------------------
+struct JournalEvent
+{
+	bool         fTracking;
+	FILETIME     timeStamp;
+	DWORD        sourceId;
+	DWORD        categoryId;
+	DWORD        dwSeverity;
+	LPCWSTR      message;
+	LPCWSTR      actorId;                        // tracking events only, else NULL
+	DWORD        dwAttrCount;
+	LPVARIANT    attributes;
+};
+
+//-----------------------------------------------------------------------------
+// CLASS JournalReader
+// -------------------
+//    Receives the events of EventJournal::Replay in the order they were
+//    written. Returns false to stop the replay.
+//-----------------------------------------------------------------------------
+class JournalReader
+{
+public:
+	virtual ~JournalReader() {}
+
+	virtual bool OnEvent( const JournalEvent& ev ) = 0;
+};
+
+//-----------------------------------------------------------------------------
+// CLASS EventJournal
+// ------------------
+//    Append-only journal of all simple and tracking events, kept in files
+//    of dwSegmentSize bytes in a directory. The files are mapped into
+//    memory, so appending an event encodes it directly into the mapped
+//    view without a system call. The events are safe when the process
+//    ends; the operating system writes them to disk in the background,
+//    Flush forces the written part to disk.
+//
+//    A new segment is started when the current one is full and with each
+//    Open, the oldest segment is deleted when more than dwMaxSegments
+//    segments exist. Open reads the existing segments and rebuilds their
+//    indexes.
+//
+//    Records are 8-byte aligned and contain the fixed fields, the message
+//    and actor ID as zero terminated strings and the attributes with their
+//    type. Attributes of other than scalar or BSTR types (e.g. arrays) are
+//    recorded as VT_EMPTY. The length of a record is written last so a
+//    record interrupted by a crash is not read.
+//
+//    Each segment has an index by time and by source: the time range of
+//    its events, every JOURNAL_TIME_STRIDE-th record with the latest time
+//    stamp before it, and the records of each source. Replay uses them to
+//    skip segments and records outside the requested range; the events
+//    are copied out in chunks so appending is not held up by a replay.
+//    The methods are thread safe.
+//-----------------------------------------------------------------------------
+class EventJournal
+{
+public:
+	EventJournal( DWORD dwSegmentSize, DWORD dwMaxSegments );
+	~EventJournal();
+
+	// Operations
+	HRESULT Open( LPCWSTR directory );
+	void    Close();
+	HRESULT Append(
+				bool       fTracking,
+				DWORD      categoryId,
+				DWORD      sourceId,
+				LPCWSTR    message,
+				DWORD      dwSeverity,
+				LPCWSTR    actorId,
+				DWORD      dwAttrCount,
+				LPVARIANT  attributes,
+				LPFILETIME timeStamp );
+	HRESULT Replay( const FILETIME& from, const FILETIME& to, DWORD sourceId, JournalReader* reader );
+	void    Flush();
+
+	// Attributes
+	bool    IsOpen() const;
+	DWORD   SegmentCount() const;
+
+	// Implementation
+protected:
+	// Latest time stamp of the records before a record
+	struct TimeMark
+	{
+		ULONGLONG    maxTime;
+		DWORD        dwOffset;
+	};
+
+	struct Segment
+	{
+		DWORD        dwNumber;
+		DWORD        dwSize;                     // size of the file
+		HANDLE       hFile;
+		HANDLE       hMapping;
+		BYTE*        view;
+		DWORD        dwUsed;                     // bytes used including the header
+		DWORD        dwRecords;
+		ULONGLONG    minTime;
+		ULONGLONG    maxTime;
+		std::vector<TimeMark>                         timeIndex;
+		std::unordered_map<DWORD, std::vector<DWORD>> sourceIndex;  // record offsets per source
+	};
+
+	// Position of a replay between two chunks
+	struct ReplayPosition
+	{
+		DWORD        dwSegment;                  // number of the segment
+		DWORD        dwNext;                     // offset or index in the source index, MAXDWORD if not started
+	};
+
+	HRESULT OpenSegment( DWORD dwNumber, bool fCreate, Segment** ppSegment );
+	void    CloseSegment( Segment* segment, bool fDelete );
+	HRESULT StartSegment();
+	void    IndexRecord( Segment* segment, DWORD dwOffset );
+	bool    IsValidRecord( const Segment* segment, DWORD dwOffset ) const;
+	void    SegmentPath( DWORD dwNumber, std::wstring& path ) const;
+	DWORD   FirstRecord( const Segment* segment, ULONGLONG from ) const;
+	HRESULT ReadChunk( ULONGLONG from, ULONGLONG to, DWORD sourceId, ReplayPosition& position, std::vector<BYTE>& chunk );
+	static bool Decode( const BYTE* record, JournalEvent& ev, std::vector<VARIANT>& attributes );
+
+	DWORD                   m_dwSegmentSize;
+	DWORD                   m_dwMaxSegments;
+	std::wstring            m_directory;
+	DWORD                   m_dwNextNumber;      // number of the next segment
+	std::vector<Segment*>   m_segments;          // oldest first, the last one is written
+	mutable SRWLOCK         m_lock;
+
+private:
+	EventJournal( const EventJournal& );
+	EventJournal& operator=( const EventJournal& );
+};
+
+#endif // !defined(EVENTJOURNAL_H)
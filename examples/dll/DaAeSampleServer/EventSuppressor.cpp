@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Rate limiting and duplicate folding of simple and tracking events.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include <algorithm>
+#include "EventSuppressor.h"
+
+//-----------------------------------------------------------------------------
+// CLASS EventSuppressor
+//-----------------------------------------------------------------------------
+
+EventSuppressor::EventSuppressor( const EventLimit& defaultLimit )
+{
+	m_defaultLimit = defaultLimit;
+	InitializeSRWLock( &m_lock );
+}
+
+HRESULT EventSuppressor::SetLimit( DWORD categoryId, const EventLimit& limit )
+{
+	if (limit.dwBurst == 0) {
+		return E_INVALIDARG;
+	}
+
+	HRESULT hr = S_OK;
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		m_limits[categoryId] = limit;
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+const EventLimit& EventSuppressor::Limit( DWORD categoryId ) const
+{
+	std::unordered_map<DWORD, EventLimit>::const_iterator it = m_limits.find( categoryId );
+	return (it != m_limits.end()) ? it->second : m_defaultLimit;
+}
+
+void EventSuppressor::Refill( Bucket& bucket, const EventLimit& limit, ULONGLONG now )
+{
+	bucket.tokens += (double)(now - bucket.lastRefill) * limit.dwRate / 1000;
+	if (bucket.tokens > limit.dwBurst) {
+		bucket.tokens = limit.dwBurst;
+	}
+	bucket.lastRefill = now;
+}
+
+//-----------------------------------------------------------------------------
+// Admit
+// -----
+//    Returns the number of occurrences the event represents if it is to
+//    be forwarded, or 0 if it is folded or dropped. pfRepeatCount returns
+//    whether the category has a repeat count attribute. If the state of the
+//    source cannot be allocated the event is forwarded.
+//-----------------------------------------------------------------------------
+DWORD EventSuppressor::Admit(
+	DWORD   sourceId,
+	DWORD   categoryId,
+	LPCWSTR message,
+	DWORD   dwSeverity,
+	bool*   pfRepeatCount )
+{
+	ULONGLONG now     = GetTickCount64();
+	DWORD     dwCount = 1;
+
+	if (message == NULL) {
+		message = L"";
+	}
+
+	AcquireSRWLockExclusive( &m_lock );
+	const EventLimit& limit = Limit( categoryId );
+	*pfRepeatCount = limit.fRepeatCount;
+	try {
+		std::unordered_map<ULONGLONG, Bucket>::iterator it = m_buckets.find( Key( sourceId, categoryId ) );
+		if (it == m_buckets.end()) {
+			Bucket bucket;
+			bucket.tokens         = limit.dwBurst;
+			bucket.lastRefill     = now;
+			bucket.lastForward    = now;
+			bucket.fForwarded     = false;
+			bucket.dwLastSeverity = 0;
+			bucket.dwFolded       = 0;
+			bucket.dwDropped      = 0;
+			bucket.dwDroppedSeverity = 0;
+			it = m_buckets.insert( std::make_pair( Key( sourceId, categoryId ), bucket ) ).first;
+		}
+		Bucket& bucket = it->second;
+		Refill( bucket, limit, now );
+
+		bool fDuplicate = bucket.fForwarded && bucket.dwLastSeverity == dwSeverity &&
+						  bucket.lastMessage == message;
+
+		if (fDuplicate && now - bucket.lastForward < limit.dwFoldTime) {
+			bucket.dwFolded++;
+			dwCount = 0;
+		}
+		else if (bucket.tokens < 1) {
+			bucket.droppedMessage    = message;
+			bucket.dwDroppedSeverity = std::max<DWORD>( bucket.dwDroppedSeverity, dwSeverity );
+			bucket.dwDropped++;
+			dwCount = 0;
+		}
+		else {
+			bucket.tokens -= 1;
+			if (fDuplicate) {
+				dwCount += bucket.dwFolded;
+			}
+			else {
+				if (bucket.dwFolded > 0) {
+					// report the repeats of the replaced message with the next summaries
+					SuppressionSummary summary;
+					summary.sourceId   = sourceId;
+					summary.categoryId = categoryId;
+					summary.dwSeverity = bucket.dwLastSeverity;
+					summary.dwDropped  = 0;
+					summary.dwRepeated = bucket.dwFolded;
+					summary.repeatedMessage = bucket.lastMessage;
+					m_pending.push_back( summary );
+				}
+				bucket.lastMessage    = message;
+				bucket.dwLastSeverity = dwSeverity;
+				bucket.fForwarded     = true;
+			}
+			bucket.dwFolded    = 0;
+			bucket.lastForward = now;
+		}
+	}
+	catch (...) {
+		dwCount = 1;                             // forward unchecked
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return dwCount;
+}
+
+//-----------------------------------------------------------------------------
+// Collect
+// -------
+//    Appends the summaries of the sources whose suppression ended and
+//    removes the state of the sources which are quiet again. Returns the
+//    number of appended summaries.
+//-----------------------------------------------------------------------------
+DWORD EventSuppressor::Collect( std::vector<SuppressionSummary>& summaries )
+{
+	ULONGLONG now     = GetTickCount64();
+	DWORD     dwCount = 0;
+
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		summaries.insert( summaries.end(), m_pending.begin(), m_pending.end() );
+		dwCount = (DWORD)m_pending.size();
+		m_pending.clear();
+
+		std::unordered_map<ULONGLONG, Bucket>::iterator it = m_buckets.begin();
+		while (it != m_buckets.end()) {
+			Bucket&           bucket = it->second;
+			const EventLimit& limit  = Limit( (DWORD)it->first );
+			Refill( bucket, limit, now );
+
+			bool fFull    = (bucket.tokens >= limit.dwBurst);
+			bool fExpired = (now - bucket.lastForward >= limit.dwFoldTime);
+
+			if ((bucket.dwDropped > 0 && fFull) || (bucket.dwFolded > 0 && fExpired)) {
+				SuppressionSummary summary;
+				summary.sourceId   = (DWORD)(it->first >> 32);
+				summary.categoryId = (DWORD)it->first;
+				summary.dwSeverity = 0;
+				summary.dwDropped  = fFull ? bucket.dwDropped : 0;
+				summary.dwRepeated = fExpired ? bucket.dwFolded : 0;
+				if (summary.dwDropped > 0) {
+					summary.dwSeverity     = bucket.dwDroppedSeverity;
+					summary.droppedMessage = bucket.droppedMessage;
+				}
+				if (summary.dwRepeated > 0) {
+					summary.dwSeverity      = std::max<DWORD>( summary.dwSeverity, bucket.dwLastSeverity );
+					summary.repeatedMessage = bucket.lastMessage;
+				}
+				summaries.push_back( summary );
+				dwCount++;
+
+				bucket.dwDropped -= summary.dwDropped;
+				bucket.dwFolded  -= summary.dwRepeated;
+				if (summary.dwDropped > 0) {
+					bucket.dwDroppedSeverity = 0;
+					bucket.droppedMessage.clear();
+				}
+			}
+
+			if (fFull && fExpired && bucket.dwDropped == 0 && bucket.dwFolded == 0) {
+				it = m_buckets.erase( it );
+			}
+			else {
+				++it;
+			}
+		}
+	}
+	catch (...) {
+		// not enough memory, the summaries are reported next time
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return dwCount;
+}
+
+DWORD EventSuppressor::SourceCount() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwCount = (DWORD)m_buckets.size();
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
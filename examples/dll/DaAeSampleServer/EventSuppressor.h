@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Rate limiting and duplicate folding of simple and tracking events.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(EVENTSUPPRESSOR_H)
+#define EVENTSUPPRESSOR_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// STRUCT EventLimit
+// -----------------
+//    Limits of the events of one category, applied per event source.
+//    dwRate events per second are forwarded on average with bursts of up
+//    to dwBurst events. An event with the same message and severity as the
+//    last forwarded event of the source is folded into it if it occurs
+//    within dwFoldTime milliseconds. If fRepeatCount is set the category
+//    has an attribute which receives the number of occurrences an event
+//    represents.
+//-----------------------------------------------------------------------------
+struct EventLimit
+{
+	DWORD    dwRate;
+	DWORD    dwBurst;
+	DWORD    dwFoldTime;
+	bool     fRepeatCount;
+};
+
+//-----------------------------------------------------------------------------
+// STRUCT SuppressionSummary
+// -------------------------
+//    Events of a source and category which were not forwarded: dwDropped
+//    events exceeded the rate limit, the last of them with droppedMessage,
+//    and dwRepeated duplicates of repeatedMessage were folded without a
+//    later event reporting them. dwSeverity is the highest severity of
+//    these events.
+//-----------------------------------------------------------------------------
+struct SuppressionSummary
+{
+	DWORD        sourceId;
+	DWORD        categoryId;
+	DWORD        dwSeverity;
+	DWORD        dwDropped;
+	DWORD        dwRepeated;
+	std::wstring droppedMessage;
+	std::wstring repeatedMessage;
+};
+
+//-----------------------------------------------------------------------------
+// CLASS EventSuppressor
+// ---------------------
+//    Suppression stage in front of ProcessSimpleEvent and
+//    ProcessTrackingEvent. Admit decides for each event whether it is
+//    forwarded, folded into the last forwarded duplicate or dropped by the
+//    token bucket of its source and category. The first duplicate after
+//    the fold time is forwarded again and reports the folded occurrences
+//    in its repeat count.
+//
+//    Collect is called periodically and returns a summary for each source
+//    and category whose suppression ended: the token bucket is full again
+//    or the fold time of folded duplicates expired.
+//
+//    The methods are thread safe.
+//-----------------------------------------------------------------------------
+class EventSuppressor
+{
+public:
+	EventSuppressor( const EventLimit& defaultLimit );
+	~EventSuppressor() {}
+
+	// Operations
+	HRESULT SetLimit( DWORD categoryId, const EventLimit& limit );
+	DWORD   Admit( DWORD sourceId, DWORD categoryId, LPCWSTR message, DWORD dwSeverity, bool* pfRepeatCount );
+	DWORD   Collect( std::vector<SuppressionSummary>& summaries );
+
+	// Attributes
+	DWORD   SourceCount() const;
+
+	// Implementation
+protected:
+	struct Bucket
+	{
+		double       tokens;
+		ULONGLONG    lastRefill;
+		ULONGLONG    lastForward;
+		bool         fForwarded;                 // lastMessage / dwLastSeverity valid
+		std::wstring lastMessage;
+		DWORD        dwLastSeverity;
+		DWORD        dwFolded;                   // duplicates since lastForward
+		DWORD        dwDropped;                  // events dropped since the last summary
+		DWORD        dwDroppedSeverity;          // highest severity of the dropped events
+		std::wstring droppedMessage;             // message of the last dropped event
+	};
+
+	const EventLimit& Limit( DWORD categoryId ) const;
+	static void Refill( Bucket& bucket, const EventLimit& limit, ULONGLONG now );
+	static ULONGLONG Key( DWORD sourceId, DWORD categoryId ) { return ((ULONGLONG)sourceId << 32) | categoryId; }
+
+	EventLimit                            m_defaultLimit;
+	std::unordered_map<DWORD, EventLimit> m_limits;          // by category
+	std::unordered_map<ULONGLONG, Bucket> m_buckets;         // by source and category
+	std::vector<SuppressionSummary>       m_pending;         // repeats of replaced messages
+	mutable SRWLOCK                       m_lock;
+
+private:
+	EventSuppressor( const EventSuppressor& );
+	EventSuppressor& operator=( const EventSuppressor& );
+};
+
+#endif // !defined(EVENTSUPPRESSOR_H)
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Least recently used list of dynamically created items.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include <unordered_set>
+#include "IdleItemTracker.h"
+
+//-----------------------------------------------------------------------------
+// CLASS IdleItemTracker
+//-----------------------------------------------------------------------------
+
+IdleItemTracker::IdleItemTracker( DWORD dwMaxIdleTime, DWORD dwMemoryBudget )
+{
+	m_dwMaxIdleTime  = dwMaxIdleTime;
+	m_dwMemoryBudget = dwMemoryBudget;
+	m_dwMemoryUsage  = 0;
+	InitializeSRWLock( &m_lock );
+}
+
+IdleItemTracker::~IdleItemTracker()
+{
+}
+
+void IdleItemTracker::MarkInUse( Entry& entry )
+{
+	if (!entry.fInUse) {
+		m_idleItems.erase( entry.idle );
+		entry.idle   = m_idleItems.end();
+		entry.fInUse = true;
+	}
+}
+
+// The item becomes the most recently used one
+void IdleItemTracker::MarkIdle( void* deviceItem, Entry& entry, ULONGLONG now )
+{
+	if (entry.fInUse) {
+		entry.idle   = m_idleItems.insert( m_idleItems.end(), deviceItem );
+		entry.fInUse = false;
+	}
+	else {
+		m_idleItems.splice( m_idleItems.end(), m_idleItems, entry.idle );
+	}
+	entry.lastUse = now;
+}
+
+//-----------------------------------------------------------------------------
+// Register
+// --------
+//    Starts tracking of an item added to the server's cache. dwSize is the
+//    estimated memory used by the item. The item is not in use until it is
+//    reported by SetInUse or SetActiveItems.
+//-----------------------------------------------------------------------------
+void IdleItemTracker::Register( void* deviceItem, DWORD dwSize )
+{
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		std::pair<EntryMap::iterator, bool> res = m_entries.insert( std::make_pair( deviceItem, Entry() ) );
+		Entry& entry = res.first->second;
+		if (res.second) {
+			entry.dwSize  = dwSize;
+			entry.fInUse  = true;                // MarkIdle inserts it into the list
+			entry.idle    = m_idleItems.end();
+			m_dwMemoryUsage += dwSize;
+			MarkIdle( deviceItem, entry, GetTickCount64() );
+		}
+	}
+	catch (...) {
+		// the item is not tracked and stays in the cache
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+void IdleItemTracker::Unregister( void* deviceItem )
+{
+	AcquireSRWLockExclusive( &m_lock );
+	EntryMap::iterator it = m_entries.find( deviceItem );
+	if (it != m_entries.end()) {
+		if (!it->second.fInUse) {
+			m_idleItems.erase( it->second.idle );
+		}
+		m_dwMemoryUsage -= it->second.dwSize;
+		m_entries.erase( it );
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+// Called when the subscription of the item is started or stopped. Items
+// which are not tracked are ignored.
+void IdleItemTracker::SetInUse( void* deviceItem, bool fInUse )
+{
+	AcquireSRWLockExclusive( &m_lock );
+	EntryMap::iterator it = m_entries.find( deviceItem );
+	if (it != m_entries.end()) {
+		if (fInUse) {
+			MarkInUse( it->second );
+		}
+		else {
+			MarkIdle( deviceItem, it->second, GetTickCount64() );
+		}
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+//-----------------------------------------------------------------------------
+// SetActiveItems
+// --------------
+//    Reconciles the state with the items used by at least one client as
+//    returned by GetActiveItems. Items in the list are in use, all others
+//    become idle from now on if they were in use.
+//-----------------------------------------------------------------------------
+void IdleItemTracker::SetActiveItems( int numItems, void** deviceItems )
+{
+	try {
+		std::unordered_set<void*> active( deviceItems, deviceItems + numItems );
+		ULONGLONG now = GetTickCount64();
+
+		AcquireSRWLockExclusive( &m_lock );
+		for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+			if (active.find( it->first ) != active.end()) {
+				MarkInUse( it->second );
+			}
+			else if (it->second.fInUse) {
+				MarkIdle( it->first, it->second, now );
+			}
+		}
+		ReleaseSRWLockExclusive( &m_lock );
+	}
+	catch (...) {
+		// not enough memory, the state is reconciled next time
+	}
+}
+
+//-----------------------------------------------------------------------------
+// SelectIdleItems
+// ---------------
+//    Appends the items to be removed from the server's cache to the list
+//    and stops tracking them. Returns the number of selected items.
+//-----------------------------------------------------------------------------
+DWORD IdleItemTracker::SelectIdleItems( std::vector<void*>& deviceItems )
+{
+	DWORD dwSelected = 0;
+
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		ULONGLONG now = GetTickCount64();
+
+		while (!m_idleItems.empty()) {
+			void*              deviceItem = m_idleItems.front();
+			EntryMap::iterator it         = m_entries.find( deviceItem );
+
+			if (m_dwMemoryUsage <= m_dwMemoryBudget && now - it->second.lastUse < m_dwMaxIdleTime) {
+				break;                           // all other items were used later
+			}
+			deviceItems.push_back( deviceItem );
+			m_idleItems.pop_front();
+			m_dwMemoryUsage -= it->second.dwSize;
+			m_entries.erase( it );
+			dwSelected++;
+		}
+	}
+	catch (...) {
+		// not enough memory, the remaining items are selected next time
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return dwSelected;
+}
+
+DWORD IdleItemTracker::Count() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwCount = (DWORD)m_entries.size();
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
+
+DWORD IdleItemTracker::MemoryUsage() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwUsage = m_dwMemoryUsage;
+	ReleaseSRWLockShared( &m_lock );
+	return dwUsage;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Least recently used list of dynamically created items.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(IDLEITEMTRACKER_H)
+#define IDLEITEMTRACKER_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// CLASS IdleItemTracker
+// ---------------------
+//    Keeps track of the items added to the server's cache on demand and
+//    selects the ones to be removed again, so the size of the cache does
+//    not depend on how many different items clients have ever accessed.
+//
+//    An item is in use while at least one client has it in a group; this
+//    is reported when its subscription is started or stopped (see
+//    SubscriptionManager) and reconciled periodically with the list
+//    returned by GetActiveItems. Items not in use are kept in
+//    least recently used order. SelectIdleItems returns the items idle for
+//    longer than the maximum idle time and, if the estimated memory of all
+//    tracked items exceeds the budget, the least recently used ones until
+//    the budget is met again. Items in use are never selected.
+//
+//    The methods are thread safe.
+//-----------------------------------------------------------------------------
+class IdleItemTracker
+{
+public:
+	IdleItemTracker( DWORD dwMaxIdleTime, DWORD dwMemoryBudget );
+	~IdleItemTracker();
+
+	// Operations
+	void    Register( void* deviceItem, DWORD dwSize );
+	void    Unregister( void* deviceItem );
+	void    SetInUse( void* deviceItem, bool fInUse );
+	void    SetActiveItems( int numItems, void** deviceItems );
+	DWORD   SelectIdleItems( std::vector<void*>& deviceItems );
+
+	// Attributes
+	DWORD   Count() const;
+	DWORD   MemoryUsage() const;
+
+	// Implementation
+protected:
+	struct Entry
+	{
+		DWORD                       dwSize;
+		bool                        fInUse;
+		ULONGLONG                   lastUse;       // GetTickCount64() value
+		std::list<void*>::iterator  idle;          // position in m_idleItems if not in use
+	};
+
+	typedef std::unordered_map<void*, Entry> EntryMap;
+
+	void    MarkInUse( Entry& entry );
+	void    MarkIdle( void* deviceItem, Entry& entry, ULONGLONG now );
+
+	DWORD               m_dwMaxIdleTime;
+	DWORD               m_dwMemoryBudget;
+	DWORD               m_dwMemoryUsage;
+	EntryMap            m_entries;
+	std::list<void*>    m_idleItems;         // least recently used first
+	mutable SRWLOCK     m_lock;
+
+private:
+	IdleItemTracker( const IdleItemTracker& );
+	IdleItemTracker& operator=( const IdleItemTracker& );
+};
+
+#endif // !defined(IDLEITEMTRACKER_H)
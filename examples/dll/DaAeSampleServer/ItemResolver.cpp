@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Resolves item IDs of dynamic address spaces by registered patterns.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include <algorithm>
+#include "ItemResolver.h"
+
+using namespace IClassicBaseNodeManager;
+
+//-----------------------------------------------------------------------------
+// CLASS ItemResolver
+//-----------------------------------------------------------------------------
+
+// Parses a decimal number without leading zeros and advances text behind it.
+bool ItemResolver::ParseNumber( LPCWSTR& text, DWORD* value )
+{
+	if (*text < L'0' || *text > L'9') {
+		return false;
+	}
+	if (*text == L'0' && text[1] >= L'0' && text[1] <= L'9') {
+		return false;                            // leading zero
+	}
+
+	ULONGLONG number = 0;
+	while (*text >= L'0' && *text <= L'9') {
+		number = number * 10 + (*text++ - L'0');
+		if (number > 0xFFFFFFFF) {
+			return false;
+		}
+	}
+	*value = (DWORD)number;
+	return true;
+}
+
+// Data types which can be requested for a dynamic item.
+bool ItemResolver::IsSupportedType( VARTYPE dataType )
+{
+	switch (dataType) {
+		case VT_BOOL:
+		case VT_I1:  case VT_UI1:
+		case VT_I2:  case VT_UI2:
+		case VT_I4:  case VT_UI4:
+		case VT_I8:  case VT_UI8:
+		case VT_R4:  case VT_R8:
+		case VT_BSTR:
+			return true;
+		default:
+			return false;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// AddPattern
+// ----------
+//    Compiles the pattern and adds it to the resolver. Returns E_INVALIDARG
+//    if the pattern is not valid. Patterns are checked in the order they
+//    are added. Must not be called concurrently with Resolve.
+//-----------------------------------------------------------------------------
+HRESULT ItemResolver::AddPattern(
+	DWORD          dwPatternId,
+	LPCWSTR        pattern,
+	VARTYPE        dataType,
+	DaAccessRights accessRights )
+{
+	if (pattern == NULL || *pattern == L'\0') {
+		return E_INVALIDARG;
+	}
+
+	try {
+		Pattern compiled;
+		compiled.dwPatternId  = dwPatternId;
+		compiled.dataType     = dataType;
+		compiled.accessRights = accessRights;
+
+		std::wstring literal;
+		for (LPCWSTR p = pattern; *p; ) {
+			if (*p == L'}') {
+				return E_INVALIDARG;
+			}
+			if (*p != L'{') {
+				literal += *p++;
+				continue;
+			}
+
+			LPCWSTR end = wcschr( p, L'}' );
+			if (end == NULL || compiled.fields.size() >= RESOLVER_MAX_FIELDS ||
+				(literal.empty() && !compiled.fields.empty())) {
+				return E_INVALIDARG;             // two adjacent fields cannot be separated
+			}
+
+			Field field;
+			field.literal = literal;
+			field.dwMin   = 0;
+			field.dwMax   = 0xFFFFFFFF;
+			field.dwStep  = 1;
+
+			LPCWSTR range = std::find( p + 1, end, L':' );
+			if (range != end) {
+				range++;
+				if (!ParseNumber( range, &field.dwMin ) || *range++ != L'-' ||
+					!ParseNumber( range, &field.dwMax ) || field.dwMin > field.dwMax) {
+					return E_INVALIDARG;
+				}
+				if (*range == L'/' && (!ParseNumber( ++range, &field.dwStep ) || field.dwStep == 0)) {
+					return E_INVALIDARG;
+				}
+				if (range != end) {
+					return E_INVALIDARG;
+				}
+			}
+			else if (std::find( p + 1, end, L'{' ) != end) {
+				return E_INVALIDARG;
+			}
+
+			compiled.fields.push_back( field );
+			literal.clear();
+			p = end + 1;
+		}
+		compiled.tail = literal;
+
+		m_patterns.push_back( compiled );
+	}
+	catch (...) {
+		return E_OUTOFMEMORY;
+	}
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Resolve
+// -------
+//    Checks the item ID against the registered patterns. If a pattern
+//    matches, the parsed numbers are returned with the data type of the
+//    item: the canonical requested type if the client requested a
+//    supported type, otherwise the type defined for the pattern.
+//    Returns S_FALSE if no pattern matches.
+//-----------------------------------------------------------------------------
+HRESULT ItemResolver::Resolve(
+	LPCWSTR       itemId,
+	VARTYPE       requestedType,
+	ResolvedItem* item ) const
+{
+	if (itemId == NULL || item == NULL) {
+		return E_INVALIDARG;
+	}
+
+	for (size_t i = 0; i < m_patterns.size(); ++i) {
+		if (Match( m_patterns[i], itemId, item )) {
+			VARTYPE dataType = (VARTYPE)(requestedType & ~VT_BYREF);
+			if (!IsSupportedType( dataType )) {
+				dataType = m_patterns[i].dataType;
+			}
+			item->dwPatternId  = m_patterns[i].dwPatternId;
+			item->dataType     = dataType;
+			item->accessRights = m_patterns[i].accessRights;
+			return S_OK;
+		}
+	}
+	return S_FALSE;
+}
+
+//-----------------------------------------------------------------------------
+// FormatItemId
+// ------------
+//    Returns the item ID of the pattern with the specified field values,
+//    which is the ID Resolve accepts for these values. Returns E_INVALIDARG
+//    if the pattern is unknown or a value is not valid for its field.
+//-----------------------------------------------------------------------------
+HRESULT ItemResolver::FormatItemId(
+	DWORD         dwPatternId,
+	DWORD         dwFieldCount,
+	const DWORD*  fields,
+	std::wstring& itemId ) const
+{
+	for (size_t i = 0; i < m_patterns.size(); ++i) {
+		const Pattern& pattern = m_patterns[i];
+		if (pattern.dwPatternId != dwPatternId) {
+			continue;
+		}
+		if (dwFieldCount != pattern.fields.size()) {
+			return E_INVALIDARG;
+		}
+
+		try {
+			itemId.clear();
+			for (size_t f = 0; f < pattern.fields.size(); ++f) {
+				const Field& field = pattern.fields[f];
+				if (fields[f] < field.dwMin || fields[f] > field.dwMax ||
+					(fields[f] - field.dwMin) % field.dwStep != 0) {
+					return E_INVALIDARG;
+				}
+				WCHAR number[16];
+				swprintf_s( number, 16, L"%lu", (unsigned long)fields[f] );
+				itemId += field.literal;
+				itemId += number;
+			}
+			itemId += pattern.tail;
+		}
+		catch (...) {
+			return E_OUTOFMEMORY;
+		}
+		return S_OK;
+	}
+	return E_INVALIDARG;
+}
+
+bool ItemResolver::Match( const Pattern& pattern, LPCWSTR itemId, ResolvedItem* item ) const
+{
+	LPCWSTR p = itemId;
+
+	for (size_t i = 0; i < pattern.fields.size(); ++i) {
+		const Field& field = pattern.fields[i];
+		if (wcsncmp( p, field.literal.c_str(), field.literal.length() ) != 0) {
+			return false;
+		}
+		p += field.literal.length();
+
+		DWORD value;
+		if (!ParseNumber( p, &value ) || value < field.dwMin || value > field.dwMax ||
+			(value - field.dwMin) % field.dwStep != 0) {
+			return false;
+		}
+		item->fields[i] = value;
+	}
+	item->dwFieldCount = (DWORD)pattern.fields.size();
+
+	return wcscmp( p, pattern.tail.c_str() ) == 0;
+}
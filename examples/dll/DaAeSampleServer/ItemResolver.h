@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Resolves item IDs of dynamic address spaces by registered patterns.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(ITEMRESOLVER_H)
+#define ITEMRESOLVER_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <string>
+#include <vector>
+#include "IClassicBaseNodeManager.h"
+
+#define RESOLVER_MAX_FIELDS   8              // max. number of fields per pattern
+
+//-----------------------------------------------------------------------------
+// STRUCT ResolvedItem
+// -------------------
+//    Result of ItemResolver::Resolve. fields contains the numbers parsed
+//    from the item ID in the order of the fields in the pattern.
+//-----------------------------------------------------------------------------
+struct ResolvedItem
+{
+	DWORD                                   dwPatternId;
+	DWORD                                   dwFieldCount;
+	DWORD                                   fields[RESOLVER_MAX_FIELDS];
+	VARTYPE                                 dataType;
+	IClassicBaseNodeManager::DaAccessRights accessRights;
+};
+
+//-----------------------------------------------------------------------------
+// CLASS ItemResolver
+// ------------------
+//    Resolves item IDs of address spaces which are too large to be
+//    defined in advance. A pattern consists of literal text and numeric
+//    fields:
+//       {name}                any number
+//       {name:min-max}        number in the range min ... max
+//       {name:min-max/step}   number in the range which is a multiple
+//                             of step above min
+//    e.g. "Devices.PLC{n:1-4}.DB{m:1-16}.DBW{offset:0-126/2}". The name
+//    is only used for documentation and may be omitted.
+//
+//    Numbers must not have leading zeros, so every address has exactly
+//    one item ID. FormatItemId builds this item ID from the field values.
+//
+//    Patterns are compiled by AddPattern. Resolve does not allocate
+//    memory and may be called concurrently.
+//-----------------------------------------------------------------------------
+class ItemResolver
+{
+public:
+	ItemResolver() {}
+	~ItemResolver() {}
+
+	// Operations
+	HRESULT AddPattern(
+				DWORD                                   dwPatternId,
+				LPCWSTR                                 pattern,
+				VARTYPE                                 dataType,
+				IClassicBaseNodeManager::DaAccessRights accessRights );
+
+	HRESULT Resolve(
+				LPCWSTR                                 itemId,
+				VARTYPE                                 requestedType,
+				ResolvedItem                          * item ) const;
+
+	HRESULT FormatItemId(
+				DWORD                                   dwPatternId,
+				DWORD                                   dwFieldCount,
+				const DWORD                           * fields,
+				std::wstring                          & itemId ) const;
+
+	// Implementation
+protected:
+	struct Field
+	{
+		std::wstring  literal;                   // text in front of the field
+		DWORD         dwMin;
+		DWORD         dwMax;
+		DWORD         dwStep;
+	};
+
+	struct Pattern
+	{
+		DWORD                                   dwPatternId;
+		std::vector<Field>                      fields;
+		std::wstring                            tail;          // text behind the last field
+		VARTYPE                                 dataType;
+		IClassicBaseNodeManager::DaAccessRights accessRights;
+	};
+
+	static bool ParseNumber( LPCWSTR& text, DWORD* value );
+	static bool IsSupportedType( VARTYPE dataType );
+	bool        Match( const Pattern& pattern, LPCWSTR itemId, ResolvedItem* item ) const;
+
+	std::vector<Pattern>  m_patterns;
+};
+
+#endif // !defined(ITEMRESOLVER_H)
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Translation of event attributes to the DA items they are read from.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "ItemTranslationTable.h"
+
+//-----------------------------------------------------------------------------
+// CLASS ItemTranslationTable
+//-----------------------------------------------------------------------------
+
+ItemTranslationTable::ItemTranslationTable()
+{
+	InitializeSRWLock( &m_lock );
+}
+
+// The IDs are mixed into one 64 bit value, the multiplication spreads the
+// small and dense IDs used for conditions and attributes over all bits
+size_t ItemTranslationTable::KeyHash::operator()( const Key& key ) const
+{
+	ULONGLONG hash = ((ULONGLONG)key.dwConditionId << 32) | key.dwSubConditionId;
+	hash ^= (ULONGLONG)key.dwAttributeId * 0x9E3779B97F4A7C15ULL;
+	hash *= 0xFF51AFD7ED558CCDULL;
+	return (size_t)(hash ^ (hash >> 32));
+}
+
+//-----------------------------------------------------------------------------
+// Add
+// ---
+//    Registers the DA item of an attribute of a condition. For single
+//    state conditions dwSubConditionId is 0. An attribute registered
+//    before keeps its item.
+//-----------------------------------------------------------------------------
+HRESULT ItemTranslationTable::Add(
+	DWORD        dwConditionId,
+	DWORD        dwSubConditionId,
+	DWORD        dwAttributeId,
+	LPCWSTR      itemId,
+	LPCWSTR      nodeName,
+	const CLSID& clsid )
+{
+	return AddTranslation( dwConditionId, &dwSubConditionId, 1, dwAttributeId, itemId, nodeName, clsid );
+}
+
+//-----------------------------------------------------------------------------
+// AddLimitCondition
+// -----------------
+//    Registers the DA item of a condition bound to the ConditionEngine for
+//    the sub-conditions of all limits of the definition. A single state
+//    condition uses the sub-condition ID 0 for all limits.
+//-----------------------------------------------------------------------------
+HRESULT ItemTranslationTable::AddLimitCondition(
+	DWORD                  dwConditionId,
+	const LimitDefinition& definition,
+	DWORD                  dwAttributeId,
+	LPCWSTR                itemId,
+	LPCWSTR                nodeName,
+	const CLSID&           clsid )
+{
+	return AddTranslation( dwConditionId, definition.subConditionIds, LIMIT_COUNT, dwAttributeId, itemId, nodeName, clsid );
+}
+
+HRESULT ItemTranslationTable::AddTranslation(
+	DWORD        dwConditionId,
+	const DWORD* subConditionIds,
+	DWORD        dwSubConditions,
+	DWORD        dwAttributeId,
+	LPCWSTR      itemId,
+	LPCWSTR      nodeName,
+	const CLSID& clsid )
+{
+	if (itemId == NULL || *itemId == L'\0') {
+		return E_INVALIDARG;
+	}
+
+	HRESULT hr = S_OK;
+
+	AcquireSRWLockExclusive( &m_lock );
+	DWORD dwIndex = (DWORD)m_translations.size();
+	try {
+		Translation translation;
+		translation.itemId   = itemId;
+		translation.nodeName = (nodeName != NULL) ? nodeName : L"";
+		translation.clsid    = clsid;
+		m_translations.push_back( translation );
+
+		for (DWORD i = 0; i < dwSubConditions; ++i) {
+			Key key = { dwConditionId, subConditionIds[i], dwAttributeId };
+			m_map.insert( TranslationMap::value_type( key, dwIndex ) );
+		}
+	}
+	catch (...) {
+		for (DWORD i = 0; i < dwSubConditions; ++i) {
+			Key key = { dwConditionId, subConditionIds[i], dwAttributeId };
+			TranslationMap::iterator it = m_map.find( key );
+			if (it != m_map.end() && it->second == dwIndex) {
+				m_map.erase( it );
+			}
+		}
+		m_translations.resize( dwIndex );
+		hr = E_OUTOFMEMORY;
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+//-----------------------------------------------------------------------------
+// Translate
+// ---------
+//    Returns the DA item of an attribute of a condition. The node name is
+//    NULL for items of the local node. If no item is registered for the
+//    attribute the strings are NULL and the CLSID is CLSID_NULL.
+//-----------------------------------------------------------------------------
+HRESULT ItemTranslationTable::Translate(
+	DWORD   dwConditionId,
+	DWORD   dwSubConditionId,
+	DWORD   dwAttributeId,
+	LPWSTR* itemId,
+	LPWSTR* nodeName,
+	CLSID*  clsid ) const
+{
+	if (itemId == NULL || nodeName == NULL || clsid == NULL) {
+		return E_INVALIDARG;
+	}
+	*itemId   = NULL;
+	*nodeName = NULL;
+	*clsid    = CLSID_NULL;
+
+	HRESULT hr = S_OK;
+	Key     key = { dwConditionId, dwSubConditionId, dwAttributeId };
+
+	AcquireSRWLockShared( &m_lock );
+	TranslationMap::const_iterator it = m_map.find( key );
+	if (it != m_map.end()) {
+		const Translation& translation = m_translations[it->second];
+		try {
+			*itemId = new WCHAR[translation.itemId.length() + 1];
+			wmemcpy( *itemId, translation.itemId.c_str(), translation.itemId.length() + 1 );
+			if (!translation.nodeName.empty()) {
+				*nodeName = new WCHAR[translation.nodeName.length() + 1];
+				wmemcpy( *nodeName, translation.nodeName.c_str(), translation.nodeName.length() + 1 );
+			}
+			*clsid = translation.clsid;
+		}
+		catch (...) {
+			delete [] *itemId;
+			*itemId = NULL;
+			hr = E_OUTOFMEMORY;
+		}
+	}
+	ReleaseSRWLockShared( &m_lock );
+	return hr;
+}
+
+DWORD ItemTranslationTable::Count() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwCount = (DWORD)m_map.size();
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
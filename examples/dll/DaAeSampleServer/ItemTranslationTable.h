@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Translation of event attributes to the DA items they are read from.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(ITEMTRANSLATIONTABLE_H)
+#define ITEMTRANSLATIONTABLE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ConditionEngine.h"
+
+//-----------------------------------------------------------------------------
+// CLASS ItemTranslationTable
+// --------------------------
+//    Maps the attributes of conditions to the DA items they are read from,
+//    as returned by OnTranslateToItemId. The entries are hashed by
+//    condition ID, sub-condition ID and attribute ID, so each translation
+//    is one lookup regardless of the number of conditions.
+//
+//    AddLimitCondition registers the item of a condition bound to the
+//    ConditionEngine for all sub-conditions of its LimitDefinition. The
+//    sub-conditions share the strings of one translation.
+//
+//    Translate returns copies of the strings allocated with new[]; the
+//    generic server takes ownership of them. An attribute without an item
+//    returns NULL strings and CLSID_NULL. The methods are thread safe.
+//-----------------------------------------------------------------------------
+class ItemTranslationTable
+{
+public:
+	ItemTranslationTable();
+	~ItemTranslationTable() {}
+
+	// Operations
+	HRESULT Add(
+				DWORD        dwConditionId,
+				DWORD        dwSubConditionId,
+				DWORD        dwAttributeId,
+				LPCWSTR      itemId,
+				LPCWSTR      nodeName,
+				const CLSID& clsid );
+
+	HRESULT AddLimitCondition(
+				DWORD                  dwConditionId,
+				const LimitDefinition& definition,
+				DWORD                  dwAttributeId,
+				LPCWSTR                itemId,
+				LPCWSTR                nodeName,
+				const CLSID&           clsid );
+
+	HRESULT Translate(
+				DWORD   dwConditionId,
+				DWORD   dwSubConditionId,
+				DWORD   dwAttributeId,
+				LPWSTR* itemId,
+				LPWSTR* nodeName,
+				CLSID*  clsid ) const;
+
+	// Attributes
+	DWORD   Count() const;
+
+	// Implementation
+protected:
+	struct Translation
+	{
+		std::wstring itemId;
+		std::wstring nodeName;               // empty for the local node
+		CLSID        clsid;
+	};
+
+	struct Key
+	{
+		DWORD    dwConditionId;
+		DWORD    dwSubConditionId;
+		DWORD    dwAttributeId;
+
+		bool operator==( const Key& other ) const
+		{
+			return dwConditionId == other.dwConditionId &&
+				   dwSubConditionId == other.dwSubConditionId &&
+				   dwAttributeId == other.dwAttributeId;
+		}
+	};
+
+	struct KeyHash
+	{
+		size_t operator()( const Key& key ) const;
+	};
+
+	typedef std::unordered_map<Key, DWORD, KeyHash> TranslationMap;     // key -> index in m_translations
+
+	HRESULT AddTranslation(
+				DWORD        dwConditionId,
+				const DWORD* subConditionIds,
+				DWORD        dwSubConditions,
+				DWORD        dwAttributeId,
+				LPCWSTR      itemId,
+				LPCWSTR      nodeName,
+				const CLSID& clsid );
+
+	std::vector<Translation> m_translations;
+	TranslationMap           m_map;
+	mutable SRWLOCK          m_lock;
+
+private:
+	ItemTranslationTable( const ItemTranslationTable& );
+	ItemTranslationTable& operator=( const ItemTranslationTable& );
+};
+
+#endif // !defined(ITEMTRANSLATIONTABLE_H)
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Bounded cache of item IDs which could not be resolved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include <algorithm>
+#include "NegativeCache.h"
+
+#define BLOOM_BITS_PER_ENTRY    10               // about 1% false positives
+#define BLOOM_PROBES            4
+
+//-----------------------------------------------------------------------------
+// CLASS NegativeCache
+//-----------------------------------------------------------------------------
+
+NegativeCache::NegativeCache( DWORD dwMaxEntries, DWORD dwTimeToLive )
+{
+	m_dwMaxEntries = (dwMaxEntries > 0) ? dwMaxEntries : 1;
+	m_dwTimeToLive = dwTimeToLive;
+	m_dwRemoved    = 0;
+	m_bloom.resize( (m_dwMaxEntries * BLOOM_BITS_PER_ENTRY + 31) / 32, 0 );
+	InitializeSRWLock( &m_lock );
+}
+
+// FNV-1a over the characters of the ID
+ULONGLONG NegativeCache::Hash( LPCWSTR itemId, size_t length )
+{
+	ULONGLONG hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= (ULONGLONG)itemId[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// The probes are derived from the two halves of the hash (double hashing).
+bool NegativeCache::BloomContains( ULONGLONG hash ) const
+{
+	ULONGLONG bits  = (ULONGLONG)m_bloom.size() * 32;
+	DWORD     h1    = (DWORD)hash;
+	DWORD     h2    = (DWORD)(hash >> 32) | 1;
+
+	for (DWORD i = 0; i < BLOOM_PROBES; ++i) {
+		ULONGLONG bit = (h1 + (ULONGLONG)i * h2) % bits;
+		if ((m_bloom[(size_t)(bit >> 5)] & (1UL << (bit & 31))) == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void NegativeCache::BloomAdd( ULONGLONG hash )
+{
+	ULONGLONG bits  = (ULONGLONG)m_bloom.size() * 32;
+	DWORD     h1    = (DWORD)hash;
+	DWORD     h2    = (DWORD)(hash >> 32) | 1;
+
+	for (DWORD i = 0; i < BLOOM_PROBES; ++i) {
+		ULONGLONG bit = (h1 + (ULONGLONG)i * h2) % bits;
+		m_bloom[(size_t)(bit >> 5)] |= (1UL << (bit & 31));
+	}
+}
+
+void NegativeCache::RebuildBloom()
+{
+	std::fill( m_bloom.begin(), m_bloom.end(), 0 );
+	EntryMap::const_iterator it;
+	for (it = m_entries.begin(); it != m_entries.end(); ++it) {
+		BloomAdd( Hash( it->first.c_str(), it->first.length() ) );
+	}
+	m_dwRemoved = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Contains
+// --------
+//    Returns true if the ID is in the cache and has not yet expired.
+//-----------------------------------------------------------------------------
+bool NegativeCache::Contains( LPCWSTR itemId ) const
+{
+	if (itemId == NULL) {
+		return false;
+	}
+
+	size_t    length = wcslen( itemId );
+	ULONGLONG hash   = Hash( itemId, length );
+	bool      fFound = false;
+
+	AcquireSRWLockShared( &m_lock );
+	if (BloomContains( hash )) {
+		try {
+			EntryMap::const_iterator it = m_entries.find( std::wstring( itemId, length ) );
+			fFound = (it != m_entries.end() && it->second > GetTickCount64());
+		}
+		catch (...) {
+		}
+	}
+	ReleaseSRWLockShared( &m_lock );
+	return fFound;
+}
+
+//-----------------------------------------------------------------------------
+// Add
+// ---
+//    Adds the ID or restarts its time to live. Expired entries and, if the
+//    cache is full, the oldest entries are removed first.
+//-----------------------------------------------------------------------------
+void NegativeCache::Add( LPCWSTR itemId )
+{
+	if (itemId == NULL) {
+		return;
+	}
+
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		ULONGLONG now = GetTickCount64();
+		Purge( now );
+
+		std::wstring id( itemId );
+		std::pair<EntryMap::iterator, bool> res = m_entries.insert( std::make_pair( id, now + m_dwTimeToLive ) );
+		res.first->second = now + m_dwTimeToLive;
+
+		Expiration expiration;
+		expiration.expires = res.first->second;
+		expiration.itemId  = id;
+		m_expirations.push_back( expiration );
+
+		if (res.second) {
+			BloomAdd( Hash( id.c_str(), id.length() ) );
+		}
+	}
+	catch (...) {
+		// the ID is not cached and will be resolved again
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+// Removes expired entries and the oldest entries beyond the size limit.
+// The caller must hold the lock exclusively.
+void NegativeCache::Purge( ULONGLONG now )
+{
+	while (!m_expirations.empty()) {
+		const Expiration& oldest = m_expirations.front();
+		// An entry added again has a later or, within the same tick, an
+		// equal expiration queued; only the first of them removes it
+		EntryMap::iterator entry    = m_entries.find( oldest.itemId );
+		bool               fCurrent = (entry != m_entries.end() && entry->second == oldest.expires);
+
+		if (fCurrent && oldest.expires > now && m_entries.size() < m_dwMaxEntries) {
+			break;
+		}
+		if (fCurrent) {
+			m_entries.erase( entry );
+			m_dwRemoved++;
+		}
+		m_expirations.pop_front();
+	}
+
+	// Too many removed IDs make the filter useless
+	if (m_dwRemoved > m_dwMaxEntries / 2) {
+		RebuildBloom();
+	}
+}
+
+void NegativeCache::Clear()
+{
+	AcquireSRWLockExclusive( &m_lock );
+	m_entries.clear();
+	m_expirations.clear();
+	std::fill( m_bloom.begin(), m_bloom.end(), 0 );
+	m_dwRemoved = 0;
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+DWORD NegativeCache::Count() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwCount = (DWORD)m_entries.size();
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Bounded cache of item IDs which could not be resolved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(NEGATIVECACHE_H)
+#define NEGATIVECACHE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// CLASS NegativeCache
+// -------------------
+//    Remembers item IDs which could not be resolved, so repeated requests
+//    for misspelled or retired items do not reach the device again until
+//    the entry expires after dwTimeToLive milliseconds. The cache holds at
+//    most dwMaxEntries IDs; if it is full the oldest entry is dropped.
+//
+//    A Bloom filter in front of the hash table answers the common case,
+//    an ID which is not in the cache, without hashing into the table and
+//    without comparing strings. Expired and dropped entries stay in the
+//    filter until it is rebuilt, which only causes an additional table
+//    lookup for these IDs.
+//-----------------------------------------------------------------------------
+class NegativeCache
+{
+public:
+	NegativeCache( DWORD dwMaxEntries, DWORD dwTimeToLive );
+	~NegativeCache() {}
+
+	// Operations
+	bool    Contains( LPCWSTR itemId ) const;
+	void    Add( LPCWSTR itemId );
+	void    Clear();
+
+	// Attributes
+	DWORD   Count() const;
+
+	// Implementation
+protected:
+	static ULONGLONG Hash( LPCWSTR itemId, size_t length );
+
+	bool    BloomContains( ULONGLONG hash ) const;
+	void    BloomAdd( ULONGLONG hash );
+	void    Purge( ULONGLONG now );
+	void    RebuildBloom();
+
+	typedef std::unordered_map<std::wstring, ULONGLONG> EntryMap;       // ID -> expiration time
+
+	// The ID is looked up again on expiration; iterators into m_entries
+	// would not survive the erase of an ID queued twice or a rehash
+	struct Expiration
+	{
+		ULONGLONG            expires;
+		std::wstring         itemId;
+	};
+
+	DWORD                    m_dwMaxEntries;
+	DWORD                    m_dwTimeToLive;
+	EntryMap                 m_entries;
+	std::deque<Expiration>   m_expirations;      // in the order the entries were added
+	std::vector<DWORD>       m_bloom;
+	DWORD                    m_dwRemoved;        // entries removed since the filter was built
+	mutable SRWLOCK          m_lock;
+
+private:
+	NegativeCache( const NegativeCache& );
+	NegativeCache& operator=( const NegativeCache& );
+};
+
+#endif // !defined(NEGATIVECACHE_H)
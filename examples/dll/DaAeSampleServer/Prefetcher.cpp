@@ -0,0 +1,118 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Detection of sequential item requests for read-ahead.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "Prefetcher.h"
+
+//-----------------------------------------------------------------------------
+// CLASS Prefetcher
+//-----------------------------------------------------------------------------
+
+Prefetcher::Prefetcher( DWORD dwMinWindow, DWORD dwMaxWindow, DWORD dwMaxStreams )
+{
+	m_dwMinWindow  = dwMinWindow;
+	m_dwMaxWindow  = (dwMaxWindow > dwMinWindow) ? dwMaxWindow : dwMinWindow;
+	m_dwMaxStreams = (dwMaxStreams > 0) ? dwMaxStreams : 1;
+	InitializeSRWLock( &m_lock );
+}
+
+// The number of streams is small, a linear search is sufficient
+void Prefetcher::DropOldestStream()
+{
+	StreamMap::iterator oldest = m_streams.begin();
+	for (StreamMap::iterator it = m_streams.begin(); it != m_streams.end(); ++it) {
+		if (it->second.lastUse < oldest->second.lastUse) {
+			oldest = it;
+		}
+	}
+	if (oldest != m_streams.end()) {
+		m_streams.erase( oldest );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// OnRequest
+// ---------
+//    Reports the request of an item which is not yet in the cache. Returns
+//    the number of addresses following dwAddress in steps of dwStride
+//    which should be added to the cache together with it.
+//-----------------------------------------------------------------------------
+DWORD Prefetcher::OnRequest( ULONGLONG streamId, DWORD dwAddress, DWORD dwStride )
+{
+	DWORD dwWindow = 0;
+
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		ULONGLONG           now = GetTickCount64();
+		StreamMap::iterator it  = m_streams.find( streamId );
+
+		if (it == m_streams.end()) {
+			if (m_streams.size() >= m_dwMaxStreams) {
+				DropOldestStream();
+			}
+			it = m_streams.insert( std::make_pair( streamId, Stream() ) ).first;
+			it->second.dwWindow = m_dwMinWindow;
+		}
+		else {
+			Stream& stream = it->second;
+			if (dwAddress == stream.dwNext) {
+				// The client continues behind the prefetched range
+				stream.dwWindow = (stream.dwWindow == 0) ? m_dwMinWindow : stream.dwWindow * 2;
+				if (stream.dwWindow > m_dwMaxWindow) {
+					stream.dwWindow = m_dwMaxWindow;
+				}
+			}
+			else if (dwAddress < stream.dwLast || dwAddress > stream.dwNext) {
+				stream.dwWindow /= 2;
+			}
+			// else: an address inside the prefetched range which was
+			// removed from the cache meanwhile, the window is kept
+		}
+
+		Stream& stream = it->second;
+		stream.dwLast  = dwAddress;
+		stream.dwNext  = dwAddress + dwStride * (stream.dwWindow + 1);
+		stream.lastUse = now;
+		dwWindow       = stream.dwWindow;
+	}
+	catch (...) {
+		// not enough memory, nothing is prefetched
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return dwWindow;
+}
+
+DWORD Prefetcher::StreamCount() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwCount = (DWORD)m_streams.size();
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
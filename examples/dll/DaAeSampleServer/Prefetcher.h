@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Detection of sequential item requests for read-ahead.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(PREFETCHER_H)
+#define PREFETCHER_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <unordered_map>
+
+//-----------------------------------------------------------------------------
+// CLASS Prefetcher
+// ----------------
+//    Decides how many items following a requested address are added to the
+//    server's cache in advance. Clients typically add the items of a data
+//    block in ascending order, one OnRequestItems call per item; with
+//    read-ahead the following requests find the items already in the cache.
+//
+//    Requests are grouped into streams, e.g. one per data block. The first
+//    request of a stream prefetches dwMinWindow addresses. A request for
+//    the address directly behind the prefetched range continues the
+//    sequence and doubles the window up to dwMaxWindow; a request anywhere
+//    else halves it, so random access stops prefetching after a few
+//    requests. At most dwMaxStreams streams are kept, the least recently
+//    used one is dropped first.
+//
+//    The methods are thread safe.
+//-----------------------------------------------------------------------------
+class Prefetcher
+{
+public:
+	Prefetcher( DWORD dwMinWindow, DWORD dwMaxWindow, DWORD dwMaxStreams );
+	~Prefetcher() {}
+
+	// Operations
+	DWORD   OnRequest( ULONGLONG streamId, DWORD dwAddress, DWORD dwStride );
+
+	// Attributes
+	DWORD   StreamCount() const;
+
+	// Implementation
+protected:
+	struct Stream
+	{
+		DWORD      dwLast;                       // last requested address
+		DWORD      dwNext;                       // first address behind the prefetched range
+		DWORD      dwWindow;                     // number of addresses prefetched
+		ULONGLONG  lastUse;                      // GetTickCount64() value
+	};
+
+	typedef std::unordered_map<ULONGLONG, Stream> StreamMap;
+
+	void    DropOldestStream();
+
+	DWORD           m_dwMinWindow;
+	DWORD           m_dwMaxWindow;
+	DWORD           m_dwMaxStreams;
+	StreamMap       m_streams;
+	mutable SRWLOCK m_lock;
+
+private:
+	Prefetcher( const Prefetcher& );
+	Prefetcher& operator=( const Prefetcher& );
+};
+
+#endif // !defined(PREFETCHER_H)
@@ -0,0 +1,482 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Custom item properties shared between items with the same schema.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include <new>
+#include <unordered_map>
+#include "PropertyStore.h"
+
+//-----------------------------------------------------------------------------
+// CLASS PropertySet
+//-----------------------------------------------------------------------------
+
+PropertySet::~PropertySet()
+{
+	for (size_t i = 0; i < m_values.size(); ++i) {
+		VariantClear( &m_values[i] );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Add
+// ---
+//    Appends a property. The value is copied; NULL or VT_EMPTY means that
+//    the value is supplied by the generic server.
+//-----------------------------------------------------------------------------
+HRESULT PropertySet::Add( int propertyId, const VARIANT* value )
+{
+	if (IndexOf( propertyId ) >= 0) {
+		return E_INVALIDARG;
+	}
+
+	VARIANT copy;
+	VariantInit( &copy );
+	if (value != NULL) {
+		HRESULT hr = VariantCopy( &copy, value );
+		if (FAILED( hr )) {
+			return hr;
+		}
+	}
+
+	size_t count = m_ids.size();
+	try {
+		m_ids.push_back( propertyId );
+		m_values.push_back( copy );
+		m_providers.push_back( NULL );
+		m_timeToLive.push_back( 0 );
+	}
+	catch (...) {
+		m_ids.resize( count );
+		m_values.resize( count );
+		m_providers.resize( count );
+		m_timeToLive.resize( count );
+		VariantClear( &copy );
+		return E_OUTOFMEMORY;
+	}
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// AddDeviceProperty
+// -----------------
+//    Appends a property whose value is read from the provider and cached
+//    for dwTimeToLive milliseconds.
+//-----------------------------------------------------------------------------
+HRESULT PropertySet::AddDeviceProperty( int propertyId, PropertyProvider* provider, DWORD dwTimeToLive )
+{
+	if (provider == NULL) {
+		return E_INVALIDARG;
+	}
+
+	HRESULT hr = Add( propertyId, NULL );
+	if (SUCCEEDED( hr )) {
+		m_providers.back()  = provider;
+		m_timeToLive.back() = dwTimeToLive;
+	}
+	return hr;
+}
+
+// Returns the index of the property or -1 if it is not in the set. The
+// sets are small, a linear search is faster than a lookup table.
+int PropertySet::IndexOf( int propertyId ) const
+{
+	for (size_t i = 0; i < m_ids.size(); ++i) {
+		if (m_ids[i] == propertyId) {
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+//-----------------------------------------------------------------------------
+// CLASS PropertyStore
+//-----------------------------------------------------------------------------
+
+PropertyStore::PropertyStore( DWORD dwErrorTimeToLive )
+{
+	m_dwErrorTimeToLive = dwErrorTimeToLive;
+	InitializeSRWLock( &m_lock );
+	InitializeSRWLock( &m_cacheLock );
+}
+
+PropertyStore::~PropertyStore()
+{
+	for (size_t i = 0; i < m_sets.size(); ++i) {
+		delete m_sets[i];
+	}
+
+	std::map<CacheKey, CachedProperty>::iterator it;
+	for (it = m_cache.begin(); it != m_cache.end(); ++it) {
+		VariantClear( &it->second.value );
+	}
+}
+
+// Returns a new empty set or NULL if there is not enough memory
+PropertySet* PropertyStore::CreateSet()
+{
+	PropertySet* propertySet = NULL;
+
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		m_sets.reserve( m_sets.size() + 1 );
+		propertySet = new PropertySet;
+		m_sets.push_back( propertySet );
+	}
+	catch (...) {
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return propertySet;
+}
+
+HRESULT PropertyStore::Assign( void* deviceItem, const PropertySet* propertySet )
+{
+	HRESULT hr = S_OK;
+
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		m_items[deviceItem] = propertySet;
+	}
+	catch (...) {
+		hr = E_OUTOFMEMORY;
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return hr;
+}
+
+void PropertyStore::Remove( void* deviceItem )
+{
+	AcquireSRWLockExclusive( &m_lock );
+	m_items.erase( deviceItem );
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+// The sets are never deleted while the store exists, so the returned
+// pointer stays valid after the lock is released.
+const PropertySet* PropertyStore::Find( void* deviceItem ) const
+{
+	const PropertySet* propertySet = NULL;
+
+	AcquireSRWLockShared( &m_lock );
+	std::unordered_map<void*, const PropertySet*>::const_iterator it = m_items.find( deviceItem );
+	if (it != m_items.end()) {
+		propertySet = it->second;
+	}
+	ReleaseSRWLockShared( &m_lock );
+	return propertySet;
+}
+
+//-----------------------------------------------------------------------------
+// QueryProperties
+// ---------------
+//    Implements OnQueryProperties. Returns S_FALSE if the item has no
+//    custom properties.
+//-----------------------------------------------------------------------------
+HRESULT PropertyStore::QueryProperties( void* deviceItem, int* noProp, int** ids ) const
+{
+	*noProp = 0;
+	*ids    = NULL;
+
+	const PropertySet* propertySet = Find( deviceItem );
+	if (propertySet == NULL || propertySet->Count() == 0) {
+		return S_FALSE;
+	}
+
+	int* propIDs = new (std::nothrow) int [propertySet->Count()];
+	if (propIDs == NULL) {
+		return E_OUTOFMEMORY;
+	}
+	memcpy( propIDs, propertySet->Ids(), propertySet->Count() * sizeof( int ) );
+	*noProp = propertySet->Count();
+	*ids    = propIDs;
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// GetPropertyValue
+// ----------------
+//    Implements OnGetPropertyValue. Returns S_FALSE if the item has no such
+//    property or its value is supplied by the generic server.
+//-----------------------------------------------------------------------------
+HRESULT PropertyStore::GetPropertyValue( void* deviceItem, int propertyId, LPVARIANT propertyValue ) const
+{
+	const PropertySet* propertySet = Find( deviceItem );
+	if (propertySet == NULL) {
+		return S_FALSE;
+	}
+
+	int index = propertySet->IndexOf( propertyId );
+	if (index < 0) {
+		return S_FALSE;
+	}
+	VariantInit( propertyValue );
+	return GetValue( deviceItem, *propertySet, index, propertyValue );
+}
+
+// Returns the value of the property at index of the set of the item
+HRESULT PropertyStore::GetValue( void* deviceItem, const PropertySet& propertySet, int index, LPVARIANT propertyValue ) const
+{
+	if (propertySet.Provider( index ) != NULL) {
+		return GetDeviceValue( deviceItem, propertySet, index, propertyValue );
+	}
+	if (V_VT( &propertySet.Value( index ) ) == VT_EMPTY) {
+		return S_FALSE;
+	}
+	return VariantCopy( propertyValue, &propertySet.Value( index ) );
+}
+
+//-----------------------------------------------------------------------------
+// GetDeviceValue
+// --------------
+//    Returns the cached value of a device property. An expired value is
+//    returned and queued for a refresh; only a value which was never read
+//    is read from the device.
+//-----------------------------------------------------------------------------
+HRESULT PropertyStore::GetDeviceValue( void* deviceItem, const PropertySet& propertySet, int index, LPVARIANT propertyValue ) const
+{
+	PropertyProvider* provider = propertySet.Provider( index );
+	ULONGLONG         source;
+
+	if (!provider->GetPropertySource( deviceItem, &source )) {
+		return S_FALSE;
+	}
+
+	CacheKey key( source, propertySet.Ids()[index] );
+	HRESULT  hr     = S_OK;
+	bool     fFound = false;
+	bool     fQueue = false;
+
+	AcquireSRWLockShared( &m_cacheLock );
+	std::map<CacheKey, CachedProperty>::const_iterator it = m_cache.find( key );
+	if (it != m_cache.end()) {
+		bool fExpired = (GetTickCount64() >= it->second.expires);
+		if (SUCCEEDED( it->second.hrRead )) {
+			fFound = true;
+			hr     = VariantCopy( propertyValue, &it->second.value );
+			if (fExpired) {
+				fQueue = (InterlockedCompareExchange( &it->second.refreshPending, 1, 0 ) == 0);
+			}
+		}
+		else if (!fExpired) {                    // the device failed recently
+			fFound = true;
+			hr     = it->second.hrRead;
+		}
+	}
+	ReleaseSRWLockShared( &m_cacheLock );
+
+	if (fQueue) {
+		AcquireSRWLockExclusive( &m_cacheLock );
+		try {
+			m_refreshQueue.push_back( key );
+		}
+		catch (...) {
+			m_cache.find( key )->second.refreshPending = 0;   // queued again by the next read
+		}
+		ReleaseSRWLockExclusive( &m_cacheLock );
+	}
+	if (fFound) {
+		return hr;
+	}
+
+	// First request or the cached error expired, the value is read from
+	// the device
+	VARIANT value;
+	VariantInit( &value );
+	HRESULT hrRead = provider->ReadProperty( source, key.second, &value );
+	if (SUCCEEDED( hrRead )) {
+		hr = VariantCopy( propertyValue, &value );
+	}
+	else {
+		VariantClear( &value );
+		hr = hrRead;
+	}
+	StoreDeviceValue( key, provider, propertySet.TimeToLive( index ), hrRead, value );
+	VariantClear( &value );
+	return hr;
+}
+
+// Stores a value read from the device in the cache. The value is moved into
+// the cache and value is VT_EMPTY afterwards. A failed read is stored with
+// its error and expires after m_dwErrorTimeToLive.
+void PropertyStore::StoreDeviceValue( const CacheKey& key, PropertyProvider* provider, DWORD dwTimeToLive, HRESULT hrRead, VARIANT& value ) const
+{
+	AcquireSRWLockExclusive( &m_cacheLock );
+	try {
+		std::map<CacheKey, CachedProperty>::iterator it = m_cache.find( key );
+		if (it == m_cache.end()) {
+			CachedProperty cached;
+			VariantInit( &cached.value );
+			cached.hrRead         = S_OK;
+			cached.refreshPending = 0;
+			it = m_cache.insert( std::make_pair( key, cached ) ).first;
+		}
+		VariantClear( &it->second.value );
+		it->second.value        = value;         // moved
+		it->second.hrRead       = hrRead;
+		it->second.expires      = GetTickCount64() + (SUCCEEDED( hrRead ) ? dwTimeToLive : m_dwErrorTimeToLive);
+		it->second.dwTimeToLive = dwTimeToLive;
+		it->second.provider     = provider;
+		VariantInit( &value );
+	}
+	catch (...) {
+		// not enough memory, the value is read again next time
+	}
+	ReleaseSRWLockExclusive( &m_cacheLock );
+}
+
+//-----------------------------------------------------------------------------
+// RefreshProperties
+// -----------------
+//    Reads up to dwMaxProperties expired device properties from the device.
+//    Called periodically by a background thread.
+//-----------------------------------------------------------------------------
+void PropertyStore::RefreshProperties( DWORD dwMaxProperties )
+{
+	for (DWORD i = 0; i < dwMaxProperties; ++i) {
+		CacheKey          key;
+		PropertyProvider* provider     = NULL;
+		DWORD             dwTimeToLive = 0;
+		bool              fEmpty       = true;
+
+		AcquireSRWLockExclusive( &m_cacheLock );
+		if (!m_refreshQueue.empty()) {
+			fEmpty = false;
+			key    = m_refreshQueue.back();
+			m_refreshQueue.pop_back();
+			std::map<CacheKey, CachedProperty>::const_iterator it = m_cache.find( key );
+			if (it != m_cache.end()) {
+				provider     = it->second.provider;
+				dwTimeToLive = it->second.dwTimeToLive;
+			}
+		}
+		ReleaseSRWLockExclusive( &m_cacheLock );
+
+		if (fEmpty) {
+			break;
+		}
+		if (provider == NULL) {
+			continue;
+		}
+
+		VARIANT value;
+		VariantInit( &value );
+		HRESULT hrRead = provider->ReadProperty( key.first, key.second, &value );
+		if (SUCCEEDED( hrRead )) {
+			StoreDeviceValue( key, provider, dwTimeToLive, hrRead, value );
+		}
+		VariantClear( &value );
+
+		// A failed refresh is retried with the next read of the value
+		AcquireSRWLockShared( &m_cacheLock );
+		std::map<CacheKey, CachedProperty>::const_iterator it = m_cache.find( key );
+		if (it != m_cache.end()) {
+			InterlockedExchange( &it->second.refreshPending, 0 );
+		}
+		ReleaseSRWLockShared( &m_cacheLock );
+	}
+}
+
+//-----------------------------------------------------------------------------
+// GetPropertyValues
+// -----------------
+//    Returns the values of numProps properties of numItems items. The
+//    values and errors are returned in arrays of numItems * numProps
+//    elements ordered by item, i.e. the value of property p of item i is
+//    propertyValues[i * numProps + p]. An error of S_FALSE means that the
+//    item has no such property or the value is supplied by the generic
+//    server; the value is VT_EMPTY in this case. Device properties are
+//    returned as by GetPropertyValue.
+//    Returns S_FALSE if at least one value is not returned.
+//-----------------------------------------------------------------------------
+HRESULT PropertyStore::GetPropertyValues(
+	int             numItems,
+	void**          deviceItems,
+	int             numProps,
+	const int*      propertyIds,
+	LPVARIANT       propertyValues,
+	HRESULT*        errors ) const
+{
+	if (numItems < 0 || numProps < 0) {
+		return E_INVALIDARG;
+	}
+
+	typedef std::unordered_map<const PropertySet*, std::vector<int>> IndexMap;
+
+	HRESULT hrResult = S_OK;
+
+	for (size_t n = 0; n < (size_t)numItems * numProps; ++n) {
+		VariantInit( &propertyValues[n] );
+		errors[n] = E_OUTOFMEMORY;
+	}
+
+	try {
+		std::vector<const PropertySet*> sets( numItems );
+
+		AcquireSRWLockShared( &m_lock );
+		for (int i = 0; i < numItems; ++i) {
+			std::unordered_map<void*, const PropertySet*>::const_iterator it = m_items.find( deviceItems[i] );
+			sets[i] = (it != m_items.end()) ? it->second : NULL;
+		}
+		ReleaseSRWLockShared( &m_lock );
+
+		// Positions of the requested properties per distinct set
+		IndexMap                 indexMap;
+		const PropertySet*       lastSet     = NULL;
+		const std::vector<int>*  lastIndexes = NULL;
+
+		for (int i = 0; i < numItems; ++i) {
+			LPVARIANT values = propertyValues + (size_t)i * numProps;
+			HRESULT*  hrs    = errors + (size_t)i * numProps;
+
+			if (sets[i] != lastSet || lastIndexes == NULL) {
+				lastSet = sets[i];
+				std::pair<IndexMap::iterator, bool> res = indexMap.insert( std::make_pair( lastSet, std::vector<int>() ) );
+				if (res.second) {
+					res.first->second.resize( numProps, -1 );
+					for (int p = 0; lastSet != NULL && p < numProps; ++p) {
+						res.first->second[p] = lastSet->IndexOf( propertyIds[p] );
+					}
+				}
+				lastIndexes = &res.first->second;
+			}
+
+			for (int p = 0; p < numProps; ++p) {
+				int index = (*lastIndexes)[p];
+				hrs[p] = (index < 0) ? S_FALSE : GetValue( deviceItems[i], *lastSet, index, &values[p] );
+				if (hrs[p] != S_OK) {
+					hrResult = S_FALSE;
+				}
+			}
+		}
+	}
+	catch (...) {
+		return E_OUTOFMEMORY;
+	}
+	return hrResult;
+}
@@ -0,0 +1,188 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Custom item properties shared between items with the same schema.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(PROPERTYSTORE_H)
+#define PROPERTYSTORE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// CLASS PropertyProvider
+// ----------------------
+//    Source of properties whose values are stored on the device, e.g. the
+//    serial number or firmware version of a controller. GetPropertySource
+//    returns the device object the properties of an item belong to; items
+//    with the same source share the cached values. ReadProperty reads a
+//    value from the device. It is called without any lock of the
+//    PropertyStore held and may block.
+//-----------------------------------------------------------------------------
+class PropertyProvider
+{
+public:
+	virtual ~PropertyProvider() {}
+
+	virtual bool    GetPropertySource( void* deviceItem, ULONGLONG* source ) = 0;
+	virtual HRESULT ReadProperty( ULONGLONG source, int propertyId, LPVARIANT value ) = 0;
+};
+
+//-----------------------------------------------------------------------------
+// CLASS PropertySet
+// -----------------
+//    The custom properties of a group of items with the same schema, with
+//    the property IDs in the order returned by OnQueryProperties and the
+//    values returned by OnGetPropertyValue. A value of VT_EMPTY means that
+//    the value is supplied by the generic server, e.g. the EU limits of
+//    analog items. Properties added with AddDeviceProperty are read from a
+//    PropertyProvider when they are requested. A set is filled once and
+//    must not be changed after it was assigned to items.
+//-----------------------------------------------------------------------------
+class PropertySet
+{
+public:
+	PropertySet() {}
+	~PropertySet();
+
+	// Operations
+	HRESULT Add( int propertyId, const VARIANT* value );
+	HRESULT AddDeviceProperty( int propertyId, PropertyProvider* provider, DWORD dwTimeToLive );
+
+	// Attributes
+	int          Count() const { return (int)m_ids.size(); }
+	const int*   Ids() const { return m_ids.empty() ? NULL : &m_ids[0]; }
+	int          IndexOf( int propertyId ) const;
+	const VARIANT& Value( int index ) const { return m_values[index]; }
+	PropertyProvider* Provider( int index ) const { return m_providers[index]; }
+	DWORD        TimeToLive( int index ) const { return m_timeToLive[index]; }
+
+	// Implementation
+protected:
+	std::vector<int>                 m_ids;
+	std::vector<VARIANT>             m_values;        // owned, parallel to m_ids
+	std::vector<PropertyProvider*>   m_providers;     // NULL if the value is in m_values
+	std::vector<DWORD>               m_timeToLive;    // device properties only
+
+private:
+	PropertySet( const PropertySet& );
+	PropertySet& operator=( const PropertySet& );
+};
+
+//-----------------------------------------------------------------------------
+// CLASS PropertyStore
+// -------------------
+//    Maps items to their PropertySet and answers OnQueryProperties and
+//    OnGetPropertyValue with a single hash lookup. Items with the same
+//    properties share one set, so the ID list and the values (including
+//    the BSTRs) exist once instead of once per item.
+//
+//    The generic server takes ownership of the returned ID array and the
+//    property value, therefore QueryProperties returns a copy of the shared
+//    ID array and GetPropertyValue a copy of the cached value; no strings
+//    are built and no item specific code is executed per call.
+//
+//    The values of device properties are cached per property source and
+//    property ID. A value is read from the device only when it is first
+//    requested; the request waits for the device in this case. After its
+//    time to live the cached value is still returned while the property
+//    is queued for a refresh, which is done by RefreshProperties in the
+//    background, so reads of a known value never wait for the device.
+//
+//    A failed first read is cached with its error for dwErrorTimeToLive
+//    milliseconds, so a device which does not answer is not queried by
+//    every request. The next request after this time reads again.
+//
+//    GetPropertyValues reads the same properties of many items at once,
+//    e.g. the EU limits of all items of a branch. The items are looked up
+//    under one lock and the positions of the requested properties are
+//    determined once per distinct set instead of once per item.
+//
+//    The sets are owned by the store and live until it is destroyed.
+//    Assign and Remove may be called while properties are read.
+//-----------------------------------------------------------------------------
+class PropertyStore
+{
+public:
+	PropertyStore( DWORD dwErrorTimeToLive );
+	~PropertyStore();
+
+	// Operations
+	PropertySet* CreateSet();
+	HRESULT      Assign( void* deviceItem, const PropertySet* propertySet );
+	void         Remove( void* deviceItem );
+
+	HRESULT      QueryProperties( void* deviceItem, int* noProp, int** ids ) const;
+	HRESULT      GetPropertyValue( void* deviceItem, int propertyId, LPVARIANT propertyValue ) const;
+	HRESULT      GetPropertyValues(
+					int             numItems,
+					void**          deviceItems,
+					int             numProps,
+					const int*      propertyIds,
+					LPVARIANT       propertyValues,
+					HRESULT*        errors ) const;
+
+	void         RefreshProperties( DWORD dwMaxProperties );
+
+	// Implementation
+protected:
+	typedef std::pair<ULONGLONG, int> CacheKey;  // property source and ID
+
+	struct CachedProperty
+	{
+		VARIANT                  value;           // VT_EMPTY if hrRead failed
+		HRESULT                  hrRead;          // result of the last read from the device
+		ULONGLONG                expires;         // GetTickCount64() value
+		DWORD                    dwTimeToLive;
+		PropertyProvider*        provider;
+		mutable volatile LONG    refreshPending;
+	};
+
+	const PropertySet* Find( void* deviceItem ) const;
+	HRESULT      GetValue( void* deviceItem, const PropertySet& propertySet, int index, LPVARIANT propertyValue ) const;
+	HRESULT      GetDeviceValue( void* deviceItem, const PropertySet& propertySet, int index, LPVARIANT propertyValue ) const;
+	void         StoreDeviceValue( const CacheKey& key, PropertyProvider* provider, DWORD dwTimeToLive, HRESULT hrRead, VARIANT& value ) const;
+
+	std::vector<PropertySet*>                          m_sets;
+	std::unordered_map<void*, const PropertySet*>      m_items;
+	DWORD                                              m_dwErrorTimeToLive;
+	mutable SRWLOCK                                    m_lock;
+
+	// Values of the device properties, filled by the const read methods
+	mutable std::map<CacheKey, CachedProperty>         m_cache;
+	mutable std::vector<CacheKey>                      m_refreshQueue;
+	mutable SRWLOCK                                    m_cacheLock;
+
+private:
+	PropertyStore( const PropertyStore& );
+	PropertyStore& operator=( const PropertyStore& );
+};
+
+#endif // !defined(PROPERTYSTORE_H)
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Simulated controllers whose tag lists are queried on demand.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "SimulatedDevice.h"
+
+using namespace IClassicBaseNodeManager;
+
+//-----------------------------------------------------------------------------
+// CLASS SimulatedDevice
+//-----------------------------------------------------------------------------
+
+SimulatedDevice::SimulatedDevice(
+	LPCWSTR rootBranch,
+	WCHAR   delimiter,
+	DWORD   dwControllers,
+	DWORD   dwDataBlocks,
+	DWORD   dwDataWords,
+	DWORD   dwLatency )
+	: m_rootBranch( rootBranch )
+{
+	m_delimiter     = delimiter;
+	m_dwControllers = dwControllers;
+	m_dwDataBlocks  = dwDataBlocks;
+	m_dwDataWords   = dwDataWords;
+	m_dwLatency     = dwLatency;
+
+	m_memory.resize( dwControllers * dwDataBlocks * dwDataWords );
+	for (size_t i = 0; i < m_memory.size(); ++i) {
+		m_memory[i] = (SHORT)(i % 1000);
+	}
+	InitializeCriticalSection( &m_csMemory );
+}
+
+SimulatedDevice::~SimulatedDevice()
+{
+	DeleteCriticalSection( &m_csMemory );
+}
+
+// Data words are addressed by their byte offset, so only even offsets are valid.
+bool SimulatedDevice::IsValidAddress( DWORD dwController, DWORD dwDataBlock, DWORD dwOffset ) const
+{
+	return dwController >= 1 && dwController <= m_dwControllers &&
+		   dwDataBlock >= 1 && dwDataBlock <= m_dwDataBlocks &&
+		   (dwOffset % 2) == 0 && dwOffset / 2 < m_dwDataWords;
+}
+
+//-----------------------------------------------------------------------------
+// ReadDataWords / WriteDataWords
+// ------------------------------
+//    Reads or writes data words of one data block with a single request.
+//    Returns E_INVALIDARG without accessing the device if an address is
+//    not valid.
+//-----------------------------------------------------------------------------
+HRESULT SimulatedDevice::ReadDataWords(
+	DWORD        dwController,
+	DWORD        dwDataBlock,
+	DWORD        dwCount,
+	const DWORD* offsets,
+	SHORT*       values )
+{
+	for (DWORD i = 0; i < dwCount; ++i) {
+		if (!IsValidAddress( dwController, dwDataBlock, offsets[i] )) {
+			return E_INVALIDARG;
+		}
+	}
+
+	Sleep( m_dwLatency );                        // simulated request to the device
+
+	size_t block = ((dwController - 1) * m_dwDataBlocks + (dwDataBlock - 1)) * m_dwDataWords;
+
+	EnterCriticalSection( &m_csMemory );
+	for (DWORD i = 0; i < dwCount; ++i) {
+		values[i] = m_memory[block + offsets[i] / 2];
+	}
+	LeaveCriticalSection( &m_csMemory );
+	return S_OK;
+}
+
+HRESULT SimulatedDevice::WriteDataWords(
+	DWORD        dwController,
+	DWORD        dwDataBlock,
+	DWORD        dwCount,
+	const DWORD* offsets,
+	const SHORT* values )
+{
+	for (DWORD i = 0; i < dwCount; ++i) {
+		if (!IsValidAddress( dwController, dwDataBlock, offsets[i] )) {
+			return E_INVALIDARG;
+		}
+	}
+
+	Sleep( m_dwLatency );                        // simulated request to the device
+
+	size_t block = ((dwController - 1) * m_dwDataBlocks + (dwDataBlock - 1)) * m_dwDataWords;
+
+	EnterCriticalSection( &m_csMemory );
+	for (DWORD i = 0; i < dwCount; ++i) {
+		m_memory[block + offsets[i] / 2] = values[i];
+	}
+	LeaveCriticalSection( &m_csMemory );
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// ReadControllerInfo
+// ------------------
+//    Reads the identification of a controller with a single request.
+//-----------------------------------------------------------------------------
+HRESULT SimulatedDevice::ReadControllerInfo( DWORD dwController, ControllerInfo* info )
+{
+	if (dwController < 1 || dwController > m_dwControllers || info == NULL) {
+		return E_INVALIDARG;
+	}
+
+	Sleep( m_dwLatency );                        // simulated request to the device
+
+	swprintf_s( info->serialNumber, 32, L"SIM-%04u-%05u", 2019, 10000 + dwController * 137 );
+	swprintf_s( info->firmwareVersion, 16, L"V%u.%u", 3, dwController % 4 );
+	info->calibrationDate = 43466.0 + dwController * 30;     // 30 days apart from 1/1/2019
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// WriteAcknowledgements
+// ---------------------
+//    Writes the acknowledgements of several alarms of a controller with a
+//    single request and returns the result of each acknowledgement.
+//-----------------------------------------------------------------------------
+HRESULT SimulatedDevice::WriteAcknowledgements(
+	DWORD        dwController,
+	DWORD        dwCount,
+	const DWORD* conditionIds,
+	HRESULT*     results )
+{
+	if (dwController < 1 || dwController > m_dwControllers || conditionIds == NULL || results == NULL) {
+		return E_INVALIDARG;
+	}
+
+	Sleep( m_dwLatency );                        // simulated request to the device
+
+	for (DWORD i = 0; i < dwCount; ++i) {
+		results[i] = S_OK;
+	}
+	return S_OK;
+}
+
+void SimulatedDevice::AddEntry(
+	std::vector<BrowseEntry>& entries,
+	LPCWSTR                   format,
+	DWORD                     dwNumber,
+	bool                      fBranch,
+	VARTYPE                   dataType,
+	DaAccessRights            accessRights )
+{
+	WCHAR name[32];
+	swprintf_s( name, 32, format, dwNumber );
+
+	BrowseEntry entry;
+	entry.name         = name;
+	entry.fBranch      = fBranch;
+	entry.dataType     = dataType;
+	entry.accessRights = accessRights;
+	entries.push_back( entry );
+}
+
+// Parses "<delimiter><name><number>" at path and advances path behind it.
+bool SimulatedDevice::ParseSegment( LPCWSTR& path, LPCWSTR name, DWORD dwMax, DWORD* dwNumber ) const
+{
+	size_t len = wcslen( name );
+	if (path[0] != m_delimiter || wcsncmp( path + 1, name, len ) != 0 ||
+		path[len + 1] < L'0' || path[len + 1] > L'9') {
+		return false;
+	}
+	WCHAR* end;
+	*dwNumber = wcstoul( path + len + 1, &end, 10 );
+	path      = end;
+	return *dwNumber >= 1 && *dwNumber <= dwMax;
+}
+
+//-----------------------------------------------------------------------------
+// BrowseBranch
+// ------------
+//    Returns the controllers below the root branch, the data blocks of a
+//    controller and the data words of a data block.
+//-----------------------------------------------------------------------------
+HRESULT SimulatedDevice::BrowseBranch( LPCWSTR branchPath, std::vector<BrowseEntry>& entries )
+{
+	if (branchPath == NULL || wcsncmp( branchPath, m_rootBranch.c_str(), m_rootBranch.length() ) != 0) {
+		return E_INVALIDARG;
+	}
+
+	Sleep( m_dwLatency );                        // simulated request to the device
+
+	LPCWSTR path = branchPath + m_rootBranch.length();
+	DWORD   dwController;
+	DWORD   dwDataBlock;
+
+	try {
+		if (*path == L'\0') {
+			for (DWORD i = 1; i <= m_dwControllers; ++i) {
+				AddEntry( entries, L"PLC%u", i, true, VT_EMPTY, NotKnown );
+			}
+		}
+		else if (!ParseSegment( path, L"PLC", m_dwControllers, &dwController )) {
+			return E_INVALIDARG;
+		}
+		else if (*path == L'\0') {
+			for (DWORD i = 1; i <= m_dwDataBlocks; ++i) {
+				AddEntry( entries, L"DB%u", i, true, VT_EMPTY, NotKnown );
+			}
+		}
+		else if (!ParseSegment( path, L"DB", m_dwDataBlocks, &dwDataBlock ) || *path != L'\0') {
+			return E_INVALIDARG;
+		}
+		else {
+			for (DWORD i = 0; i < m_dwDataWords; ++i) {
+				AddEntry( entries, L"DBW%u", i * 2, false, VT_I2, ReadWritable );
+			}
+		}
+	}
+	catch (...) {
+		return E_OUTOFMEMORY;
+	}
+	return S_OK;
+}
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Simulated controllers whose tag lists are queried on demand.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(SIMULATEDDEVICE_H)
+#define SIMULATEDDEVICE_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <vector>
+#include "BrowseIndex.h"
+
+//-----------------------------------------------------------------------------
+// CLASS SimulatedDevice
+// ---------------------
+//    Simulates a gateway with several controllers (PLC1 ... PLCn). Each
+//    controller has data blocks (DB1 ... DBm) with data words (DBW0,
+//    DBW2, ...). The address space is mounted below a root branch, e.g.
+//       Devices.PLC1.DB1.DBW0
+//
+//    The data words are kept in the memory of the device and are read and
+//    written in blocks, one request per data block.
+//
+//    The tag lists are not registered at startup. As BrowseProvider the
+//    device returns the children of a branch only when the branch is
+//    browsed; each query takes dwLatency milliseconds like a request to
+//    a real controller.
+//
+//    ReadControllerInfo returns the identification of a controller, which
+//    is also one request and is used for the device-backed properties of
+//    the data words. WriteAcknowledgements writes the acknowledgements of
+//    alarms to a controller with one request.
+//-----------------------------------------------------------------------------
+// Identification of a controller, read with a separate request
+struct ControllerInfo
+{
+	WCHAR    serialNumber[32];
+	WCHAR    firmwareVersion[16];
+	DATE     calibrationDate;
+};
+
+class SimulatedDevice : public BrowseProvider
+{
+public:
+	SimulatedDevice(
+				LPCWSTR rootBranch,
+				WCHAR   delimiter,
+				DWORD   dwControllers,
+				DWORD   dwDataBlocks,
+				DWORD   dwDataWords,
+				DWORD   dwLatency );
+	virtual ~SimulatedDevice();
+
+	// BrowseProvider
+	virtual HRESULT BrowseBranch( LPCWSTR branchPath, std::vector<BrowseEntry>& entries );
+
+	// Operations
+	bool    IsValidAddress( DWORD dwController, DWORD dwDataBlock, DWORD dwOffset ) const;
+
+	HRESULT ReadDataWords(
+				DWORD        dwController,
+				DWORD        dwDataBlock,
+				DWORD        dwCount,
+				const DWORD* offsets,
+				SHORT*       values );
+
+	HRESULT WriteDataWords(
+				DWORD        dwController,
+				DWORD        dwDataBlock,
+				DWORD        dwCount,
+				const DWORD* offsets,
+				const SHORT* values );
+
+	HRESULT ReadControllerInfo( DWORD dwController, ControllerInfo* info );
+
+	HRESULT WriteAcknowledgements(
+				DWORD        dwController,
+				DWORD        dwCount,
+				const DWORD* conditionIds,
+				HRESULT*     results );
+
+	// Attributes
+	LPCWSTR  RootBranch() const { return m_rootBranch.c_str(); }
+	DWORD    Controllers() const { return m_dwControllers; }
+	DWORD    DataBlocks() const { return m_dwDataBlocks; }
+	DWORD    DataWords() const { return m_dwDataWords; }
+
+	// Implementation
+protected:
+	bool        ParseSegment( LPCWSTR& path, LPCWSTR name, DWORD dwMax, DWORD* dwNumber ) const;
+	static void AddEntry(
+				std::vector<BrowseEntry>&               entries,
+				LPCWSTR                                 format,
+				DWORD                                   dwNumber,
+				bool                                    fBranch,
+				VARTYPE                                 dataType,
+				IClassicBaseNodeManager::DaAccessRights accessRights );
+
+	std::wstring  m_rootBranch;
+	WCHAR         m_delimiter;
+	DWORD         m_dwControllers;
+	DWORD         m_dwDataBlocks;
+	DWORD         m_dwDataWords;
+	DWORD         m_dwLatency;
+
+	std::vector<SHORT>  m_memory;                // data words of all controllers
+	CRITICAL_SECTION    m_csMemory;
+};
+
+#endif // !defined(SIMULATEDDEVICE_H)
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Acquisition of the device items used by clients.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include <unordered_set>
+#include "SubscriptionManager.h"
+
+//-----------------------------------------------------------------------------
+// CLASS SubscriptionManager
+//-----------------------------------------------------------------------------
+
+SubscriptionManager::SubscriptionManager()
+{
+	InitializeSRWLock( &m_lock );
+}
+
+SubscriptionManager::~SubscriptionManager()
+{
+}
+
+// The caller must hold the lock exclusively and reserve the space in
+// m_subscribed.
+void SubscriptionManager::Start( void* deviceItem, Subscription& subscription )
+{
+	subscription.index = m_subscribed.size();
+	m_subscribed.push_back( deviceItem );
+}
+
+// Removes the item from m_subscribed by moving the last item to its place
+void SubscriptionManager::Stop( Subscription& subscription )
+{
+	void* last = m_subscribed.back();
+	m_subscribed[subscription.index] = last;
+	m_items.find( last )->second.index = subscription.index;
+	m_subscribed.pop_back();
+}
+
+void SubscriptionManager::Register( void* deviceItem )
+{
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		Subscription subscription = { false, 0 };
+		m_items.insert( std::make_pair( deviceItem, subscription ) );
+	}
+	catch (...) {
+		// the item is not acquired from the device
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+void SubscriptionManager::Unregister( void* deviceItem )
+{
+	AcquireSRWLockExclusive( &m_lock );
+	SubscriptionMap::iterator it = m_items.find( deviceItem );
+	if (it != m_items.end()) {
+		if (it->second.fClient) {
+			Stop( it->second );
+		}
+		m_items.erase( it );
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+}
+
+// OnAddItem may be called several times for the same item
+bool SubscriptionManager::AddClient( void* deviceItem )
+{
+	bool fStarted = false;
+
+	AcquireSRWLockExclusive( &m_lock );
+	try {
+		SubscriptionMap::iterator it = m_items.find( deviceItem );
+		if (it != m_items.end() && !it->second.fClient) {
+			m_subscribed.reserve( m_subscribed.size() + 1 );
+			Start( deviceItem, it->second );
+			it->second.fClient = true;
+			fStarted = true;
+		}
+	}
+	catch (...) {
+		// not enough memory, the item is subscribed by SetActiveItems later
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return fStarted;
+}
+
+// OnRemoveItem is called once when no client uses the item any more
+bool SubscriptionManager::RemoveClient( void* deviceItem )
+{
+	bool fStopped = false;
+
+	AcquireSRWLockExclusive( &m_lock );
+	SubscriptionMap::iterator it = m_items.find( deviceItem );
+	if (it != m_items.end() && it->second.fClient) {
+		Stop( it->second );
+		it->second.fClient = false;
+		fStopped = true;
+	}
+	ReleaseSRWLockExclusive( &m_lock );
+	return fStopped;
+}
+
+//-----------------------------------------------------------------------------
+// SetActiveItems
+// --------------
+//    Reconciles the client use with the items used by at least one client
+//    as returned by GetActiveItems.
+//-----------------------------------------------------------------------------
+void SubscriptionManager::SetActiveItems( int numItems, void** deviceItems )
+{
+	try {
+		std::unordered_set<void*> active( deviceItems, deviceItems + numItems );
+
+		AcquireSRWLockExclusive( &m_lock );
+		try {
+			for (SubscriptionMap::iterator it = m_items.begin(); it != m_items.end(); ++it) {
+				bool fActive = (active.find( it->first ) != active.end());
+				if (fActive == it->second.fClient) {
+					continue;
+				}
+				if (fActive) {
+					m_subscribed.reserve( m_subscribed.size() + 1 );
+					Start( it->first, it->second );
+				}
+				else {
+					Stop( it->second );
+				}
+				it->second.fClient = fActive;
+			}
+		}
+		catch (...) {
+			// not enough memory, the counts are reconciled next time
+		}
+		ReleaseSRWLockExclusive( &m_lock );
+	}
+	catch (...) {
+	}
+}
+
+// Returns a snapshot of the items to be acquired from the device
+void SubscriptionManager::GetSubscribedItems( std::vector<void*>& deviceItems ) const
+{
+	AcquireSRWLockShared( &m_lock );
+	try {
+		deviceItems.assign( m_subscribed.begin(), m_subscribed.end() );
+	}
+	catch (...) {
+		deviceItems.clear();
+	}
+	ReleaseSRWLockShared( &m_lock );
+}
+
+DWORD SubscriptionManager::SubscribedCount() const
+{
+	AcquireSRWLockShared( &m_lock );
+	DWORD dwCount = (DWORD)m_subscribed.size();
+	ReleaseSRWLockShared( &m_lock );
+	return dwCount;
+}
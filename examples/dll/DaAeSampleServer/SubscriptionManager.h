@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Acquisition of the device items used by clients.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(SUBSCRIPTIONMANAGER_H)
+#define SUBSCRIPTIONMANAGER_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <unordered_map>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// CLASS SubscriptionManager
+// -------------------------
+//    Decides which device items are acquired from the device. An item is
+//    subscribed, that is polled by the RefreshThread, while it is used by
+//    a client, so only items in use cause device traffic.
+//
+//    The generic server calls OnAddItem for every group the item is added
+//    to, but OnRemoveItem only once when no client uses the item any more.
+//    The client use is therefore a flag and not counted: AddClient sets
+//    it, RemoveClient clears it. SetActiveItems reconciles the flags
+//    periodically with the list returned by GetActiveItems.
+//
+//    AddClient and RemoveClient return true if the subscription is started
+//    or stopped by the call. Only items registered with Register are
+//    handled, calls for other items are ignored. The methods are thread
+//    safe.
+//-----------------------------------------------------------------------------
+class SubscriptionManager
+{
+public:
+	SubscriptionManager();
+	~SubscriptionManager();
+
+	// Operations
+	void    Register( void* deviceItem );
+	void    Unregister( void* deviceItem );
+	bool    AddClient( void* deviceItem );
+	bool    RemoveClient( void* deviceItem );
+	void    SetActiveItems( int numItems, void** deviceItems );
+	void    GetSubscribedItems( std::vector<void*>& deviceItems ) const;
+
+	// Attributes
+	DWORD   SubscribedCount() const;
+
+	// Implementation
+protected:
+	struct Subscription
+	{
+		bool     fClient;                        // used by at least one client
+		size_t   index;                          // position in m_subscribed if fClient
+	};
+
+	typedef std::unordered_map<void*, Subscription> SubscriptionMap;
+
+	void    Start( void* deviceItem, Subscription& subscription );
+	void    Stop( Subscription& subscription );
+
+	SubscriptionMap        m_items;
+	std::vector<void*>     m_subscribed;         // items used by at least one client
+	mutable SRWLOCK        m_lock;
+
+private:
+	SubscriptionManager( const SubscriptionManager& );
+	SubscriptionManager& operator=( const SubscriptionManager& );
+};
+
+#endif // !defined(SUBSCRIPTIONMANAGER_H)
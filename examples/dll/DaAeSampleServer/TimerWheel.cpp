@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Hashed timer wheel shared by many short timers.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#include "TimerWheel.h"
+
+//-----------------------------------------------------------------------------
+// CLASS TimerWheel
+//-----------------------------------------------------------------------------
+
+TimerWheel::TimerWheel( DWORD dwResolution, DWORD dwSlots )
+	: m_slots( (dwSlots > 0) ? dwSlots : 1 )
+{
+	m_dwResolution = (dwResolution > 0) ? dwResolution : 1;
+	m_current      = 0;
+	m_fStarted     = false;
+	m_dwCount      = 0;
+}
+
+HRESULT TimerWheel::Schedule( DWORD dwId, DWORD dwTag, ULONGLONG due )
+{
+	// Round up to the resolution, a timer in the past expires with the next slot
+	ULONGLONG tick = (due + m_dwResolution - 1) / m_dwResolution;
+	if (!m_fStarted) {
+		m_current  = tick;
+		m_fStarted = true;
+	}
+	if (tick < m_current) {
+		tick = m_current;
+	}
+
+	TimerEntry entry;
+	entry.dwId  = dwId;
+	entry.dwTag = dwTag;
+	entry.due   = tick;
+	try {
+		m_slots[tick % m_slots.size()].push_back( entry );
+	}
+	catch (...) {
+		return E_OUTOFMEMORY;
+	}
+	m_dwCount++;
+	return S_OK;
+}
+
+//-----------------------------------------------------------------------------
+// Advance
+// -------
+//    Moves the wheel to now and appends the expired timers to expired.
+//    Returns the number of expired timers. If the wheel is behind by more
+//    than one revolution every slot is visited only once.
+//-----------------------------------------------------------------------------
+DWORD TimerWheel::Advance( ULONGLONG now, std::vector<TimerEntry>& expired )
+{
+	if (!m_fStarted || m_dwCount == 0) {
+		m_current  = now / m_dwResolution + 1;
+		m_fStarted = true;
+		return 0;
+	}
+
+	ULONGLONG last    = now / m_dwResolution;
+	DWORD     dwCount = 0;
+	if (last >= m_current + m_slots.size()) {
+		m_current = last - m_slots.size() + 1;   // all slots are visited anyway
+	}
+
+	try {
+		for (; m_current <= last; ++m_current) {
+			std::vector<TimerEntry>& slot = m_slots[m_current % m_slots.size()];
+			for (size_t i = 0; i < slot.size(); ) {
+				if (slot[i].due <= last) {
+					expired.push_back( slot[i] );
+					slot[i] = slot.back();
+					slot.pop_back();
+					m_dwCount--;
+					dwCount++;
+				}
+				else {
+					++i;                         // due in a later round
+				}
+			}
+		}
+	}
+	catch (...) {
+		// not enough memory, the remaining timers expire with the next call
+	}
+	return dwCount;
+}
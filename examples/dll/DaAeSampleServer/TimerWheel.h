@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Hashed timer wheel shared by many short timers.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(TIMERWHEEL_H)
+#define TIMERWHEEL_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// STRUCT TimerEntry
+// -----------------
+//    A scheduled timer. dwTag is returned unchanged; the owner uses it to
+//    detect timers which were replaced by a later Schedule call, so timers
+//    never need to be removed from the wheel.
+//-----------------------------------------------------------------------------
+struct TimerEntry
+{
+	DWORD        dwId;
+	DWORD        dwTag;
+	ULONGLONG    due;
+};
+
+//-----------------------------------------------------------------------------
+// CLASS TimerWheel
+// ----------------
+//    Hashed timer wheel with dwSlots slots of dwResolution milliseconds
+//    each. Schedule and Advance take constant time per timer independent
+//    of the number of scheduled timers; timers due more than one
+//    revolution ahead stay in their slot until their round comes.
+//    Timers expire at the first Advance call at or after their due time,
+//    rounded up to the resolution.
+//
+//    The class is not thread safe, the owner serializes the calls.
+//-----------------------------------------------------------------------------
+class TimerWheel
+{
+public:
+	TimerWheel( DWORD dwResolution, DWORD dwSlots );
+	~TimerWheel() {}
+
+	// Operations
+	HRESULT Schedule( DWORD dwId, DWORD dwTag, ULONGLONG due );
+	DWORD   Advance( ULONGLONG now, std::vector<TimerEntry>& expired );
+
+	// Attributes
+	DWORD   Count() const { return m_dwCount; }
+
+	// Implementation
+protected:
+	DWORD                                 m_dwResolution;
+	std::vector<std::vector<TimerEntry>>  m_slots;
+	ULONGLONG                             m_current;     // tick of the next slot to expire
+	bool                                  m_fStarted;
+	DWORD                                 m_dwCount;
+
+private:
+	TimerWheel( const TimerWheel& );
+	TimerWheel& operator=( const TimerWheel& );
+};
+
+#endif // !defined(TIMERWHEEL_H)
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Compiled matcher for OPC browse filter expressions.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+//-----------------------------------------------------------------------------
+// INCLUDES
+//-----------------------------------------------------------------------------
+#include "stdafx.h"
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <emmintrin.h>                           // SSE2 character scan
+#endif
+#include "WildcardFilter.h"
+
+#define NO_POSITION  ((size_t)-1)
+
+//-----------------------------------------------------------------------------
+// CLASS WildcardFilter
+//-----------------------------------------------------------------------------
+
+WildcardFilter::WildcardFilter( LPCWSTR pattern )
+{
+	m_fMatchAll     = false;
+	m_fLeadingStar  = false;
+	m_fTrailingStar = false;
+	Compile( pattern );
+}
+
+//-----------------------------------------------------------------------------
+// Compile
+// -------
+//    Translates the filter expression into tokens and segments.
+//-----------------------------------------------------------------------------
+void WildcardFilter::Compile( LPCWSTR pattern )
+{
+	if (pattern == NULL || *pattern == L'\0') {
+		m_fMatchAll = true;
+		return;
+	}
+
+	m_fLeadingStar  = (pattern[0] == L'*');
+	m_fTrailingStar = (pattern[wcslen( pattern ) - 1] == L'*');
+
+	Segment segment = { 0, 0, 0, NO_POSITION, 0 };
+
+	for (LPCWSTR p = pattern; ; ) {
+		if (*p == L'*' || *p == L'\0') {
+			if (segment.tokenCount > 0) {
+				m_segments.push_back( segment );
+			}
+			while (*p == L'*') {
+				++p;
+			}
+			if (*p == L'\0') {
+				break;
+			}
+			segment.firstToken   = m_tokens.size();
+			segment.tokenCount   = 0;
+			segment.length       = 0;
+			segment.literalToken = NO_POSITION;
+			continue;
+		}
+
+		Token token;
+		token.offset = 0;
+		token.length = 1;
+
+		if (*p == L'?') {
+			token.kind = TokenAnyChar;
+			++p;
+		}
+		else if (*p == L'#') {
+			token.kind = TokenDigit;
+			++p;
+		}
+		else if (*p == L'[' && p[1] != L']' && !(p[1] == L'!' && p[2] == L']') &&
+				 wcschr( p + 1, L']' ) != NULL) {
+			CharList list;
+			list.fNegate = false;
+			memset( list.ascii, 0, sizeof( list.ascii ) );
+
+			++p;
+			if (*p == L'!') {
+				list.fNegate = true;
+				++p;
+			}
+			while (*p != L']') {
+				WCHAR lo = *p++;
+				WCHAR hi = lo;
+				if (*p == L'-' && p[1] != L']') {
+					hi = p[1];
+					p += 2;
+				}
+				for (WCHAR ch = lo; ch <= hi && ch < 128; ++ch) {
+					list.ascii[ch >> 5] |= (1UL << (ch & 31));
+				}
+				if (hi >= 128) {
+					list.ranges.push_back( std::make_pair( (WCHAR)(lo < 128 ? 128 : lo), hi ) );
+				}
+			}
+			++p;                                 // skip ']'
+
+			token.kind   = TokenCharList;
+			token.offset = m_charLists.size();
+			m_charLists.push_back( list );
+		}
+		else {
+			// Literal character, consecutive characters are merged into one token
+			if (segment.tokenCount > 0 && m_tokens.back().kind == TokenLiteral) {
+				m_literals += *p++;
+				m_tokens.back().length++;
+				segment.length++;
+				continue;
+			}
+			token.kind   = TokenLiteral;
+			token.offset = m_literals.length();
+			m_literals  += *p++;
+			if (segment.literalToken == NO_POSITION) {
+				segment.literalToken  = m_tokens.size();
+				segment.literalOffset = segment.length;
+			}
+		}
+
+		m_tokens.push_back( token );
+		segment.tokenCount++;
+		segment.length += token.length;
+	}
+
+	if (m_segments.empty()) {                    // only '*'
+		m_fMatchAll = true;
+		return;
+	}
+
+	// Literal text every matching name starts with
+	if (!m_fLeadingStar) {
+		const Segment& first = m_segments[0];
+		for (size_t i = 0; i < first.tokenCount; ++i) {
+			const Token& token = m_tokens[first.firstToken + i];
+			if (token.kind != TokenLiteral) {
+				break;
+			}
+			m_prefix.append( m_literals, token.offset, token.length );
+		}
+	}
+}
+
+bool WildcardFilter::MatchCharList( const CharList& list, WCHAR ch ) const
+{
+	bool fFound = false;
+
+	if (ch < 128) {
+		fFound = (list.ascii[ch >> 5] & (1UL << (ch & 31))) != 0;
+	}
+	else {
+		for (size_t i = 0; i < list.ranges.size() && !fFound; ++i) {
+			fFound = (ch >= list.ranges[i].first && ch <= list.ranges[i].second);
+		}
+	}
+	return fFound != list.fNegate;
+}
+
+// Matches the segment at the start of name. The caller guarantees that name
+// has at least segment.length characters.
+bool WildcardFilter::MatchSegment( const Segment& segment, const WCHAR* name ) const
+{
+	for (size_t i = 0; i < segment.tokenCount; ++i) {
+		const Token& token = m_tokens[segment.firstToken + i];
+		switch (token.kind) {
+			case TokenLiteral:
+				if (wmemcmp( name, m_literals.c_str() + token.offset, token.length ) != 0) {
+					return false;
+				}
+				break;
+			case TokenDigit:
+				if (*name < L'0' || *name > L'9') {
+					return false;
+				}
+				break;
+			case TokenCharList:
+				if (!MatchCharList( m_charLists[token.offset], *name )) {
+					return false;
+				}
+				break;
+			default:                             // TokenAnyChar
+				break;
+		}
+		name += token.length;
+	}
+	return true;
+}
+
+// Returns the left-most position in [from, end) where the segment matches
+// completely or NO_POSITION.
+size_t WildcardFilter::FindSegment( const Segment& segment, const WCHAR* name, size_t from, size_t end ) const
+{
+	if (end < segment.length || from > end - segment.length) {
+		return NO_POSITION;
+	}
+	size_t last = end - segment.length;          // last possible start position
+
+	if (segment.literalToken == NO_POSITION) {
+		for (size_t pos = from; pos <= last; ++pos) {
+			if (MatchSegment( segment, name + pos )) {
+				return pos;
+			}
+		}
+		return NO_POSITION;
+	}
+
+	// Scan for the first character of the literal text and verify candidates
+	WCHAR  ch  = m_literals[m_tokens[segment.literalToken].offset];
+	size_t off = segment.literalOffset;
+
+	for (size_t pos = from; pos <= last; ++pos) {
+		size_t count = last - pos + 1;
+		size_t hit   = FindChar( name + pos + off, count, ch );
+		if (hit == count) {
+			return NO_POSITION;
+		}
+		pos += hit;
+		if (MatchSegment( segment, name + pos )) {
+			return pos;
+		}
+	}
+	return NO_POSITION;
+}
+
+//-----------------------------------------------------------------------------
+// Matches
+// -------
+//    The first segment is anchored at the start and the last one at the
+//    end of the name unless the expression starts or ends with '*'. All
+//    other segments are placed left-most in between.
+//-----------------------------------------------------------------------------
+bool WildcardFilter::Matches( const WCHAR* name, size_t length ) const
+{
+	if (m_fMatchAll) {
+		return true;
+	}
+
+	size_t pos   = 0;
+	size_t end   = length;
+	size_t first = 0;
+	size_t last  = m_segments.size();
+
+	if (!m_fLeadingStar) {
+		const Segment& segment = m_segments[0];
+		if (segment.length > length || !MatchSegment( segment, name )) {
+			return false;
+		}
+		if (last == 1 && !m_fTrailingStar) {
+			return segment.length == length;
+		}
+		pos   = segment.length;
+		first = 1;
+	}
+
+	if (!m_fTrailingStar && last > first) {
+		const Segment& segment = m_segments[last - 1];
+		if (segment.length > length - pos || !MatchSegment( segment, name + length - segment.length )) {
+			return false;
+		}
+		end = length - segment.length;
+		last--;
+	}
+
+	for (size_t i = first; i < last; ++i) {
+		size_t hit = FindSegment( m_segments[i], name, pos, end );
+		if (hit == NO_POSITION) {
+			return false;
+		}
+		pos = hit + m_segments[i].length;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// FindChar
+// --------
+//    Returns the index of the first occurrence of ch or length if not found.
+//    On x86/x64 eight characters are compared at once with SSE2.
+//-----------------------------------------------------------------------------
+size_t WildcardFilter::FindChar( const WCHAR* str, size_t length, WCHAR ch )
+{
+	size_t i = 0;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	const __m128i needle = _mm_set1_epi16( (short)ch );
+	for (; i + 8 <= length; i += 8) {
+		__m128i block = _mm_loadu_si128( (const __m128i*)(str + i) );
+		int     mask  = _mm_movemask_epi8( _mm_cmpeq_epi16( block, needle ) );
+		if (mask != 0) {
+			unsigned long bit;
+			_BitScanForward( &bit, (unsigned long)mask );
+			return i + bit / 2;
+		}
+	}
+#endif
+
+	for (; i < length; ++i) {
+		if (str[i] == ch) {
+			return i;
+		}
+	}
+	return length;
+}
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2011-2019 Technosoftware GmbH. All rights reserved
+ * Web: https://technosoftware.com
+ *
+ * Purpose: Compiled matcher for OPC browse filter expressions.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#if !defined(WILDCARDFILTER_H)
+#define WILDCARDFILTER_H
+
+#if _MSC_VER > 1000
+#pragma once
+#endif // _MSC_VER > 1000
+
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// CLASS WildcardFilter
+// --------------------
+//    Matcher for the filterCriteria of OnBrowseItemIds. The supported syntax
+//    is the one of the OPC specification:
+//       *          any number of characters (also none)
+//       ?          exactly one character
+//       #          exactly one digit
+//       [list]     one character of the list, ranges like [A-Z] are allowed
+//       [!list]    one character not in the list
+//    A bracket without a list ("[]") is taken literally, so the names of
+//    array items like "Boolean[]" can be used as filter.
+//
+//    The expression is compiled once into segments of fixed length tokens
+//    separated by '*'. Because every token matches exactly one character,
+//    the segments can be placed left-most without backtracking and a match
+//    is linear in the length of the name. Segments which contain literal
+//    text are located with a vectorized character scan.
+//
+//    LiteralPrefix() returns the text every matching name starts with. It
+//    is used by the BrowseIndex to skip whole ranges of sorted names and to
+//    prune subtrees during flat browsing.
+//-----------------------------------------------------------------------------
+class WildcardFilter
+{
+public:
+	explicit WildcardFilter( LPCWSTR pattern );
+	~WildcardFilter() {}
+
+	// Operations
+	bool Matches( const WCHAR* name, size_t length ) const;
+	bool Matches( const std::wstring& name ) const { return Matches( name.c_str(), name.length() ); }
+
+	// Attributes
+	bool                 MatchesAll() const { return m_fMatchAll; }
+	const std::wstring&  LiteralPrefix() const { return m_prefix; }
+
+	// Implementation
+protected:
+	enum TokenKind
+	{
+		TokenLiteral,                            // text in m_literals
+		TokenAnyChar,                            // ?
+		TokenDigit,                              // #
+		TokenCharList                            // [list] / [!list]
+	};
+
+	struct Token
+	{
+		TokenKind  kind;
+		size_t     offset;                       // TokenLiteral: start in m_literals,
+		                                         // TokenCharList: index in m_charLists
+		size_t     length;                       // number of matched characters
+	};
+
+	struct CharList
+	{
+		bool                                 fNegate;
+		DWORD                                ascii[4];    // bit set for characters < 128
+		std::vector<std::pair<WCHAR, WCHAR>> ranges;      // ranges with characters >= 128
+	};
+
+	struct Segment
+	{
+		size_t     firstToken;
+		size_t     tokenCount;
+		size_t     length;                       // number of matched characters
+		size_t     literalToken;                 // first literal token used for scanning
+		size_t     literalOffset;                // position of that token in the segment
+	};
+
+	void   Compile( LPCWSTR pattern );
+	bool   MatchSegment( const Segment& segment, const WCHAR* name ) const;
+	size_t FindSegment( const Segment& segment, const WCHAR* name, size_t from, size_t end ) const;
+	bool   MatchCharList( const CharList& list, WCHAR ch ) const;
+
+	static size_t FindChar( const WCHAR* str, size_t length, WCHAR ch );
+
+	std::vector<Token>     m_tokens;
+	std::vector<Segment>   m_segments;
+	std::vector<CharList>  m_charLists;
+	std::wstring           m_literals;
+	std::wstring           m_prefix;
+	bool                   m_fMatchAll;
+	bool                   m_fLeadingStar;
+	bool                   m_fTrailingStar;
+};
+
+#endif // !defined(WILDCARDFILTER_H)